@@ -0,0 +1,88 @@
+#include <string.h>
+#include <math.h>
+#include "allanDev.h"
+
+// NOTE: no pico-sdk dependency here, the engine is checked on the host against the offline formulas
+
+
+void adev_init(struct AllanDev* a) {
+    memset(a, 0, sizeof(*a));
+    uint8_t k = 0;
+    // level 0 serves m = 1, 2, 4 .. ADEV_SPAN, every other level one tau with the lag of ADEV_SPAN entries
+    for (uint8_t b = 0; b <= ADEV_SPAN_BITS; b++, k++) {
+        a->tau[k].m = 1u << b;
+        a->tau[k].level = 0;
+        a->tau[k].lag = 1u << b;
+    }
+    for (uint8_t l = 1; l < ADEV_LEVELS; l++, k++) {
+        a->tau[k].m = ADEV_SPAN << l;
+        a->tau[k].level = l;
+        a->tau[k].lag = ADEV_SPAN;
+    }
+}
+
+static inline void update_tau(struct AdevTau* tau, const struct AdevLevel* lv) {
+    uint32_t c = lv->count - 1;         // newest entry
+    uint32_t q = tau->lag;
+    const uint32_t mask = ADEV_RING - 1;
+    if (c >= 2*q) {
+        // x(i+2m) - 2x(i+m) + x(i), unsigned wrap-around keeps it exact
+        int64_t d = (int64_t)(lv->t[c & mask] - 2*lv->t[(c-q) & mask] + lv->t[(c-2*q) & mask]);
+        tau->sum_adev += (double)d * d;
+        tau->n_adev++;
+    }
+    if (c >= 3*q) {
+        // sum over m samples of the same second difference from the prefix sums
+        int64_t w = (int64_t)(lv->p[c & mask] - 3*lv->p[(c-q) & mask] + 3*lv->p[(c-2*q) & mask] - lv->p[(c-3*q) & mask]);
+        tau->sum_mdev += (double)w * w;
+        tau->n_mdev++;
+    }
+}
+
+void adev_add(struct AllanDev* a, uint64_t t) {
+    uint32_t k = a->samples++;
+    a->prefix += t;
+    if (k == 0) {
+        a->first = t;
+    }
+    a->last = t;
+    // level l takes every 2^l-th sample, on average less than two levels per sample
+    for (uint8_t l = 0; l < ADEV_LEVELS && (k & ((1u << l) - 1)) == 0; l++) {
+        struct AdevLevel* lv = &a->level[l];
+        lv->t[lv->count & (ADEV_RING - 1)] = t;
+        lv->p[lv->count & (ADEV_RING - 1)] = a->prefix;
+        lv->count++;
+        if (l == 0) {
+            for (uint8_t i = 0; i <= ADEV_SPAN_BITS; i++) {
+                update_tau(&a->tau[i], lv);
+            }
+        } else {
+            update_tau(&a->tau[ADEV_SPAN_BITS + l], lv);
+        }
+    }
+}
+
+// mean sample interval in clk_sys cycles
+double adev_tau0(const struct AllanDev* a) {
+    return (a->samples < 2)? 0: (double)(a->last - a->first) / (a->samples - 1);
+}
+
+// deviations of the k-th tau, false if there is no term summed yet
+bool adev_result(const struct AllanDev* a, uint8_t k, uint32_t clk_src_freq, struct AdevResult* r) {
+    if (k >= ADEV_TAUS) {
+        return false;
+    }
+    const struct AdevTau* tau = &a->tau[k];
+    double tau0 = adev_tau0(a);
+    if (tau->n_adev == 0 || tau0 <= 0) {
+        return false;
+    }
+    double m = tau->m;
+    r->tau = m * tau0 / clk_src_freq;
+    r->n = tau->n_adev;
+    // the phase is in cycles and so is tau0, the ratios need no clock frequency
+    r->adev = sqrt(tau->sum_adev / (2.0 * tau->n_adev)) / (m * tau0);
+    r->mdev = (tau->n_mdev == 0)? 0: sqrt(tau->sum_mdev / (2.0 * tau->n_mdev)) / (m * m * tau0);
+    r->tdev = r->tau / sqrt(3.0) * r->mdev;
+    return true;
+}
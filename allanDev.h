@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Streaming Allan, Modified Allan and Time deviation
+// The timemarks of one channel (in clk_sys cycles) are the phase stream with the sample
+// interval tau0 of the channel. Deviations are computed at octave spaced tau = m*tau0.
+// Each level keeps the last ADEV_RING timemarks and prefix sums of the timemarks, level l
+// stores every 2^l-th sample. The taus m = 1..ADEV_SPAN use level 0 and are fully
+// overlapping, every larger tau m = ADEV_SPAN*2^l uses level l, so only every 2^l-th
+// start point contributes. Memory per channel is constant and the work per sample O(1).
+// Second differences are exact integers (the linear phase term cancels), only their
+// squares are summed in doubles. No pico-sdk dependency, the engine runs on the host as well.
+
+#define ADEV_SPAN 8                     // lag in entries of the level for the tau, has to be power of 2
+#define ADEV_SPAN_BITS 3                // log2(ADEV_SPAN)
+#define ADEV_LEVELS 12                  // max. tau = ADEV_SPAN * 2^(ADEV_LEVELS-1) * tau0
+#define ADEV_RING 32                    // entries per level, power of 2 and more than 3*ADEV_SPAN
+#define ADEV_TAUS (ADEV_LEVELS + ADEV_SPAN_BITS)
+
+struct AdevLevel
+{
+    uint64_t t[ADEV_RING];              // timemarks
+    uint64_t p[ADEV_RING];              // prefix sums of all timemarks up to t, modulo 2^64
+    uint32_t count;                     // entries stored
+};
+
+struct AdevTau
+{
+    uint32_t m;                         // tau in samples
+    uint8_t level;
+    uint8_t lag;                        // m in entries of the level
+    uint32_t n_adev;                    // number of terms summed
+    uint32_t n_mdev;
+    double sum_adev;                    // sum of squared second differences of the phase
+    double sum_mdev;                    // sum of squared second differences of m phase averages (times m)
+};
+
+struct AllanDev
+{
+    struct AdevLevel level[ADEV_LEVELS];
+    struct AdevTau tau[ADEV_TAUS];
+    uint64_t prefix;
+    uint64_t first;
+    uint64_t last;
+    uint32_t samples;
+};
+
+struct AdevResult
+{
+    double tau;                         // seconds
+    double adev;
+    double mdev;
+    double tdev;                        // seconds
+    uint32_t n;                         // number of ADEV terms
+};
+
+void adev_init(struct AllanDev* a);
+
+void adev_add(struct AllanDev* a, uint64_t t);
+
+double adev_tau0(const struct AllanDev* a);
+
+bool adev_result(const struct AllanDev* a, uint8_t k, uint32_t clk_src_freq, struct AdevResult* r);
@@ -0,0 +1,310 @@
+#include <string.h>
+#include "binOut.h"
+
+// NOTE: shared by the firmware (encoder) and the host tools (decoder), keep it free of pico-sdk dependencies
+
+enum { DEC_SYNC, DEC_HDR, DEC_LEN, DEC_PAYLOAD, DEC_CRC };
+
+// CRC-8 (polynomial 0x07) of every byte value, one lookup per byte instead of eight shifts
+static const uint8_t crc8_table[256] = {
+    0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15, 0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+    0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65, 0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
+    0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5, 0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+    0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85, 0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
+    0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2, 0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
+    0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2, 0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+    0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32, 0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
+    0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42, 0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
+    0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c, 0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+    0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec, 0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
+    0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c, 0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
+    0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c, 0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+    0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b, 0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+    0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b, 0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
+    0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb, 0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+    0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb, 0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3,
+};
+
+uint8_t bin_crc8(uint8_t crc, const uint8_t* data, uint8_t len) {
+    for (uint8_t i = 0; i < len; i++) {
+        crc = crc8_table[crc ^ data[i]];
+    }
+    return crc;
+}
+
+static uint8_t put_u32(uint8_t* buf, uint32_t v) {
+    buf[0] = v;
+    buf[1] = v >> 8;
+    buf[2] = v >> 16;
+    buf[3] = v >> 24;
+    return 4;
+}
+
+static uint32_t get_u32(const uint8_t* buf) {
+    return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint8_t put_varint(uint8_t* buf, uint64_t zz) {
+    uint8_t len = 0;
+    do {
+        uint8_t b = zz & 0x7f;
+        zz >>= 7;
+        buf[len++] = zz? b | 0x80: b;
+    } while (zz);
+    return len;
+}
+
+static uint64_t get_varint(const uint8_t* buf, uint8_t len) {
+    uint64_t zz = 0;
+    for (uint8_t i = 0; i < len && i < 10; i++) {
+        zz |= (uint64_t)(buf[i] & 0x7f) << (7*i);
+    }
+    return zz;
+}
+
+static uint8_t frame(uint8_t* buf, uint8_t type, uint8_t channel, uint8_t len) {
+    // payload is already written at buf+3
+    buf[0] = BIN_SYNC;
+    buf[1] = (type << 4) | (channel & 0x0f);
+    buf[2] = len;
+    buf[3 + len] = bin_crc8(0, buf + 1, len + 2);
+    return len + 4;
+}
+
+void bin_encoder_init(struct BinEncoder* e, const struct BinConfig* cfg) {
+    memset(e, 0, sizeof(*e));
+    e->cfg = *cfg;
+}
+
+uint8_t bin_encode_config(struct BinEncoder* e, uint8_t* buf) {
+    uint8_t* p = buf + 3;
+    p += put_u32(p, e->cfg.clk_src_freq);
+    *p++ = e->cfg.avg_periods;
+    *p++ = e->cfg.avg_periods >> 8;
+    *p++ = e->cfg.mode;
+    *p++ = e->cfg.channels;
+    // next event of every channel goes absolute so the decoder can resynchronize here
+    e->synced = 0;
+    e->ts_synced = 0;
+    e->since_config = 0;
+    return frame(buf, BIN_FRAME_CONFIG, 0, p - buf - 3);
+}
+
+// writes the event frame to buf, preceded by a config frame if it is due; returns number of bytes written
+uint8_t bin_encode_event(struct BinEncoder* e, uint8_t* buf, uint8_t channel, uint32_t clk_cor) {
+    uint8_t n = 0;
+    if (e->since_config >= BIN_CONFIG_INTERVAL) {
+        n = bin_encode_config(e, buf);
+        buf += n;
+    }
+    e->since_config++;
+    e->ts_synced &= ~(1u << channel);
+    if ((e->synced & (1u << channel)) == 0) {
+        e->synced |= 1u << channel;
+        e->prev[channel] = clk_cor;
+        put_u32(buf + 3, clk_cor);
+        return n + frame(buf, BIN_FRAME_EVENT_ABS, channel, 4);
+    }
+    int32_t delta = (int32_t)(clk_cor - e->prev[channel]);
+    uint32_t zz = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+    e->prev[channel] = clk_cor;
+    return n + frame(buf, BIN_FRAME_EVENT_DELTA, channel, put_varint(buf + 3, zz));
+}
+
+// as bin_encode_event() for the timemark tm, cycles after the previous timemark of the channel
+uint8_t bin_encode_timestamp(struct BinEncoder* e, uint8_t* buf, uint8_t channel, uint64_t tm, uint64_t cycles) {
+    uint8_t n = 0;
+    if (e->since_config >= BIN_CONFIG_INTERVAL) {
+        n = bin_encode_config(e, buf);
+        buf += n;
+    }
+    e->since_config++;
+    bool delta = (e->ts_synced & (1u << channel)) && e->prev_tm[channel] + cycles == tm;
+    e->ts_synced |= 1u << channel;
+    e->prev_tm[channel] = tm;
+    if (!delta) {
+        put_u32(buf + 3, tm);
+        put_u32(buf + 7, tm >> 32);
+        return n + frame(buf, BIN_FRAME_TS_ABS, channel, 8 + put_varint(buf + 11, cycles));
+    }
+    return n + frame(buf, BIN_FRAME_TS_DELTA, channel, put_varint(buf + 3, cycles));
+}
+
+void bin_raw_encoder_init(struct BinRawEncoder* e, const struct BinRawConfig* cfg) {
+    memset(e, 0, sizeof(*e));
+    e->cfg = *cfg;
+    e->since_config = BIN_CONFIG_INTERVAL;      // config frame ahead of the first value
+}
+
+uint8_t bin_encode_raw_config(struct BinRawEncoder* e, uint8_t* buf) {
+    uint8_t* p = buf + 3;
+    p += put_u32(p, e->cfg.clk_src_freq);
+    *p++ = e->cfg.avg_periods;
+    *p++ = e->cfg.avg_periods >> 8;
+    *p++ = e->cfg.capture;
+    *p++ = e->cfg.channels;
+    for (uint8_t i = 0; i < BIN_RAW_CHANNELS; i++) {
+        p += put_u32(p, e->cfg.cor_offset[i]);
+    }
+    e->synced = 0;
+    e->since_config = 0;
+    return frame(buf, BIN_FRAME_RAW_CONFIG, 0, p - buf - 3);
+}
+
+// as bin_encode_event() for the raw value of a slot, buf has to hold two frames
+uint8_t bin_encode_raw(struct BinRawEncoder* e, uint8_t* buf, uint8_t slot, uint64_t value) {
+    uint8_t n = 0;
+    if (e->since_config >= BIN_CONFIG_INTERVAL) {
+        n = bin_encode_raw_config(e, buf);
+        buf += n;
+    }
+    e->since_config++;
+    if ((e->synced & (1u << slot)) == 0) {
+        e->synced |= 1u << slot;
+        e->prev[slot] = value;
+        put_u32(buf + 3, value);
+        put_u32(buf + 7, value >> 32);
+        return n + frame(buf, BIN_FRAME_RAW_ABS, slot, 8);
+    }
+    int64_t delta = (int64_t)(value - e->prev[slot]);
+    uint64_t zz = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+    e->prev[slot] = value;
+    return n + frame(buf, BIN_FRAME_RAW_DELTA, slot, put_varint(buf + 3, zz));
+}
+
+void bin_decoder_init(struct BinDecoder* d) {
+    memset(d, 0, sizeof(*d));
+}
+
+static bool decode_payload(struct BinDecoder* d, struct BinFrame* f) {
+    f->type = d->hdr >> 4;
+    f->channel = d->hdr & 0x0f;
+    switch (f->type) {
+        case BIN_FRAME_CONFIG:
+            if (d->len < 8) {
+                return false;
+            }
+            d->cfg.clk_src_freq = get_u32(d->payload);
+            d->cfg.avg_periods = d->payload[4] | (d->payload[5] << 8);
+            d->cfg.mode = d->payload[6];
+            d->cfg.channels = d->payload[7];
+            d->has_config = true;
+            f->cfg = d->cfg;
+            return true;
+        case BIN_FRAME_EVENT_ABS:
+            if (d->len < 4) {
+                return false;
+            }
+            f->clk_cor = get_u32(d->payload);
+            d->prev[f->channel] = f->clk_cor;
+            d->synced |= 1u << f->channel;
+            return true;
+        case BIN_FRAME_EVENT_DELTA: {
+            if ((d->synced & (1u << f->channel)) == 0) {
+                d->unsynced++;
+                return false;
+            }
+            uint32_t zz = get_varint(d->payload, (d->len < 5)? d->len: 5);
+            int32_t delta = (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+            f->clk_cor = (uint32_t)(d->prev[f->channel] + delta);
+            d->prev[f->channel] = f->clk_cor;
+            return true;
+        }
+        case BIN_FRAME_TS_ABS:
+            if (d->len < 9) {
+                return false;
+            }
+            f->tm = get_u32(d->payload) | ((uint64_t)get_u32(d->payload + 4) << 32);
+            f->clk_cor = get_varint(d->payload + 8, d->len - 8);
+            d->prev_tm[f->channel] = f->tm;
+            d->ts_synced |= 1u << f->channel;
+            return true;
+        case BIN_FRAME_TS_DELTA:
+            if ((d->ts_synced & (1u << f->channel)) == 0) {
+                d->unsynced++;
+                return false;
+            }
+            f->clk_cor = get_varint(d->payload, d->len);
+            f->tm = d->prev_tm[f->channel] + f->clk_cor;
+            d->prev_tm[f->channel] = f->tm;
+            return true;
+        case BIN_FRAME_RAW_CONFIG:
+            if (d->len < 8 + 4*BIN_RAW_CHANNELS) {
+                return false;
+            }
+            d->raw_cfg.clk_src_freq = get_u32(d->payload);
+            d->raw_cfg.avg_periods = d->payload[4] | (d->payload[5] << 8);
+            d->raw_cfg.capture = d->payload[6];
+            d->raw_cfg.channels = d->payload[7];
+            for (uint8_t i = 0; i < BIN_RAW_CHANNELS; i++) {
+                d->raw_cfg.cor_offset[i] = get_u32(d->payload + 8 + 4*i);
+            }
+            d->has_raw_config = true;
+            d->raw_synced = 0;
+            f->raw_cfg = d->raw_cfg;
+            return true;
+        case BIN_FRAME_RAW_ABS:
+            if (d->len < 8 || f->channel >= BIN_RAW_SLOTS) {
+                return false;
+            }
+            f->raw = get_u32(d->payload) | ((uint64_t)get_u32(d->payload + 4) << 32);
+            d->raw_prev[f->channel] = f->raw;
+            d->raw_synced |= 1u << f->channel;
+            return true;
+        case BIN_FRAME_RAW_DELTA: {
+            if (f->channel >= BIN_RAW_SLOTS || (d->raw_synced & (1u << f->channel)) == 0) {
+                d->unsynced++;
+                return false;
+            }
+            uint64_t zz = get_varint(d->payload, d->len);
+            int64_t delta = (int64_t)(zz >> 1) ^ -(int64_t)(zz & 1);
+            f->raw = d->raw_prev[f->channel] + delta;
+            d->raw_prev[f->channel] = f->raw;
+            return true;
+        }
+        default:
+            // unknown frame types are skipped, so older decoders survive newer firmware
+            return false;
+    }
+}
+
+// feeds one byte of the stream, returns true and fills f when a valid frame completes
+bool bin_decode(struct BinDecoder* d, uint8_t byte, struct BinFrame* f) {
+    switch (d->state) {
+        case DEC_SYNC:
+            d->state = (byte == BIN_SYNC)? DEC_HDR: DEC_SYNC;
+            return false;
+        case DEC_HDR:
+            d->hdr = byte;
+            d->state = DEC_LEN;
+            return false;
+        case DEC_LEN:
+            d->len = byte;
+            d->pos = 0;
+            d->state = (byte > BIN_MAX_PAYLOAD)? DEC_SYNC: (byte == 0)? DEC_CRC: DEC_PAYLOAD;
+            return false;
+        case DEC_PAYLOAD:
+            d->payload[d->pos++] = byte;
+            if (d->pos == d->len) {
+                d->state = DEC_CRC;
+            }
+            return false;
+        case DEC_CRC: {
+            d->state = DEC_SYNC;
+            uint8_t hl[2] = {d->hdr, d->len};
+            uint8_t crc = bin_crc8(bin_crc8(0, hl, 2), d->payload, d->len);
+            if (crc != byte) {
+                // lost bytes, the delta chains can not be trusted until the next absolute values
+                d->crc_errors++;
+                d->synced = 0;
+                d->ts_synced = 0;
+                d->raw_synced = 0;
+                return false;
+            }
+            d->frames++;
+            return decode_payload(d, f);
+        }
+    }
+    d->state = DEC_SYNC;
+    return false;
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Framed binary output
+// Every frame is  SYNC | HDR | LEN | payload[LEN] | CRC8
+//   SYNC   0xA5
+//   HDR    frame type in high nibble, channel index in low nibble
+//   LEN    payload length in bytes
+//   CRC8   CRC-8 (poly 0x07) over HDR, LEN and payload
+// Multibyte values are little endian. Event frames carry the corrected clk_cor either
+// absolute (first event of a channel after a config frame) or as zigzag varint delta
+// to the previous clk_cor of the same channel. Timestamp frames carry the timemark of the
+// shared timescale of timestamp capture (and intervals of 2^32 cycles or more) instead:
+// absolute with the cycles since the previous timemark, or only those cycles when the
+// previous frame of the channel was a timestamp frame. Config frames are repeated every
+// BIN_CONFIG_INTERVAL events so a decoder can join or resynchronize the stream.
+// The raw capture (FORMAT RAW) uses the same framing for the uncorrected values of the
+// counting state machines, one slot per state machine (channel + 4*phase in the low
+// nibble, the low times of dual-edge capture as phase 1), and its own config frame with the timebase and the corrections in use, so
+// tools/petreplay can redo the processing offline.
+
+#define BIN_SYNC 0xA5
+#define BIN_MAX_CHANNELS 16
+#define BIN_MAX_PAYLOAD 32
+#define BIN_MAX_FRAME (BIN_MAX_PAYLOAD + 4)
+#define BIN_CONFIG_INTERVAL 256
+
+#define BIN_FRAME_CONFIG 0x1            // payload: clk_src_freq u32, avg_periods u16, output mode u8, channels u8
+#define BIN_FRAME_EVENT_ABS 0x2         // payload: clk_cor u32
+#define BIN_FRAME_EVENT_DELTA 0x3       // payload: zigzag varint of clk_cor - previous clk_cor
+#define BIN_FRAME_RAW_CONFIG 0x4        // payload: clk_src_freq u32, avg_periods u16, capture u8, channels u8, cor_offset u32 per channel
+#define BIN_FRAME_RAW_ABS 0x5           // payload: raw value u64 of the slot
+#define BIN_FRAME_RAW_DELTA 0x6         // payload: zigzag varint of raw value - previous raw value of the slot
+#define BIN_FRAME_TS_ABS 0x7            // payload: timemark u64, varint of the cycles since the previous timemark
+#define BIN_FRAME_TS_DELTA 0x8          // payload: varint of the cycles since the previous timemark
+
+#define BIN_RAW_CHANNELS 4
+#define BIN_RAW_SLOTS (2*BIN_RAW_CHANNELS)
+
+#define BIN_MODE_TIMEMARK 0
+#define BIN_MODE_FREQUENCY 1
+#define BIN_MODE_CYCLE_COUNT 2
+
+struct BinConfig
+{
+    uint32_t clk_src_freq;
+    uint16_t avg_periods;
+    uint8_t mode;
+    uint8_t channels;
+};
+
+struct BinRawConfig
+{
+    uint32_t clk_src_freq;
+    uint16_t avg_periods;
+    uint8_t capture;                    // PET_CAPTURE_...
+    uint8_t channels;
+    uint32_t cor_offset[BIN_RAW_CHANNELS];      // clk_cor = 2*~value + cor_offset of period capture
+};
+
+struct BinEncoder
+{
+    struct BinConfig cfg;
+    uint32_t prev[BIN_MAX_CHANNELS];
+    uint16_t synced;                    // bit mask of channels with valid prev value
+    uint64_t prev_tm[BIN_MAX_CHANNELS];
+    uint16_t ts_synced;                 // bit mask of channels whose last frame was a timestamp frame
+    uint16_t since_config;
+};
+
+struct BinRawEncoder
+{
+    struct BinRawConfig cfg;
+    uint64_t prev[BIN_RAW_SLOTS];
+    uint8_t synced;                     // bit mask of slots with valid prev value
+    uint16_t since_config;
+};
+
+struct BinFrame
+{
+    uint8_t type;
+    uint8_t channel;                    // slot of raw frames
+    uint64_t clk_cor;                   // reconstructed value of event frames, cycles of timestamp frames
+    uint64_t tm;                        // timemark of timestamp frames
+    uint64_t raw;                       // reconstructed value of raw frames
+    struct BinConfig cfg;               // valid for config frames
+    struct BinRawConfig raw_cfg;        // valid for raw config frames
+};
+
+struct BinDecoder
+{
+    uint8_t state;
+    uint8_t hdr;
+    uint8_t len;
+    uint8_t pos;
+    uint8_t payload[BIN_MAX_PAYLOAD];
+    uint32_t prev[BIN_MAX_CHANNELS];
+    uint16_t synced;
+    uint64_t prev_tm[BIN_MAX_CHANNELS];
+    uint16_t ts_synced;
+    bool has_config;
+    struct BinConfig cfg;
+    uint64_t raw_prev[BIN_RAW_SLOTS];
+    uint8_t raw_synced;
+    bool has_raw_config;
+    struct BinRawConfig raw_cfg;
+    uint32_t frames;
+    uint32_t crc_errors;
+    uint32_t unsynced;                  // delta events dropped because the previous value was unknown
+};
+
+uint8_t bin_crc8(uint8_t crc, const uint8_t* data, uint8_t len);
+
+void bin_encoder_init(struct BinEncoder* e, const struct BinConfig* cfg);
+
+uint8_t bin_encode_config(struct BinEncoder* e, uint8_t* buf);
+
+uint8_t bin_encode_event(struct BinEncoder* e, uint8_t* buf, uint8_t channel, uint32_t clk_cor);
+
+uint8_t bin_encode_timestamp(struct BinEncoder* e, uint8_t* buf, uint8_t channel, uint64_t tm, uint64_t cycles);
+
+void bin_raw_encoder_init(struct BinRawEncoder* e, const struct BinRawConfig* cfg);
+
+uint8_t bin_encode_raw_config(struct BinRawEncoder* e, uint8_t* buf);
+
+uint8_t bin_encode_raw(struct BinRawEncoder* e, uint8_t* buf, uint8_t slot, uint64_t value);
+
+void bin_decoder_init(struct BinDecoder* d);
+
+bool bin_decode(struct BinDecoder* d, uint8_t byte, struct BinFrame* f);
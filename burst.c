@@ -0,0 +1,122 @@
+#include <string.h>
+#include "burst.h"
+
+// NOTE: no pico-sdk dependency here
+
+
+void burst_init(struct Burst* b, uint32_t* arena, uint32_t arena_words) {
+    memset(b, 0, sizeof(*b));
+    b->arena = arena;
+    b->arena_words = arena_words;
+    atomic_store_explicit(&b->state, BURST_OFF, memory_order_relaxed);
+}
+
+// longest pre + post of a burst over slots counting SMs
+uint32_t burst_max_words(const struct Burst* b, uint8_t slots) {
+    return (slots == 0)? 0: b->arena_words / slots;
+}
+
+// called with core 0 paused, returns false if pre + post does not fit the arena
+bool burst_arm(struct Burst* b, uint8_t channels, uint8_t sms, bool timestamps, uint16_t pre, uint16_t post, uint8_t trig, uint32_t threshold) {
+    uint8_t slots = channels * sms;
+    if (post == 0 || slots == 0 || slots > BURST_MAX_SLOTS || (uint32_t)pre + post > burst_max_words(b, slots)) {
+        return false;
+    }
+    b->slots = slots;
+    b->sms = sms;
+    b->timestamps = timestamps;
+    b->trig = trig;
+    b->threshold = threshold;
+    b->pre = pre;
+    b->post = post;
+    b->size = (uint32_t)pre + post;
+    b->pending = slots;
+    b->trig_slot = 255;
+    memset(b->slot, 0, sizeof(b->slot));
+    for (uint8_t s = 0; s < slots; s++) {
+        b->slot[s].words = b->arena + s * b->size;
+    }
+    atomic_store_explicit(&b->fire, false, memory_order_relaxed);
+    atomic_store_explicit(&b->state, BURST_ARMED, memory_order_release);
+    return true;
+}
+
+// command or GPIO IRQ, taken with the next value of any slot
+void burst_fire(struct Burst* b) {
+    atomic_store_explicit(&b->fire, true, memory_order_release);
+}
+
+static bool crossed(struct Burst* b, struct BurstSlot* s, uint32_t word) {
+    // the counting SMs count down, the interval is twice the negated value (period capture)
+    // or twice the difference of the negated timestamps, corrections of a few cycles aside
+    uint32_t cycles = 2*~word;
+    if (b->timestamps) {
+        bool first = s->count == 0;
+        cycles = 2*(~word - s->prev_ticks);
+        s->prev_ticks = ~word;
+        if (first) {
+            return false;
+        }
+    }
+    return (b->trig == BURST_TRIG_ABOVE)? cycles > b->threshold: (b->trig == BURST_TRIG_BELOW)? cycles < b->threshold: false;
+}
+
+static void trigger(struct Burst* b, uint8_t slot) {
+    for (uint8_t s = 0; s < b->slots; s++) {
+        b->slot[s].at_trigger = b->slot[s].count;
+    }
+    b->trig_slot = slot;
+    atomic_store_explicit(&b->state, BURST_TRIGGERED, memory_order_relaxed);
+}
+
+// core 0, every raw value of the slot while armed or triggered
+void burst_add(struct Burst* b, uint8_t slot, uint32_t word) {
+    uint8_t state = atomic_load_explicit(&b->state, memory_order_relaxed);
+    struct BurstSlot* s = &b->slot[slot];
+    if (state == BURST_ARMED) {
+        if (atomic_load_explicit(&b->fire, memory_order_acquire)) {
+            trigger(b, 255);
+            state = BURST_TRIGGERED;
+        } else if (b->trig >= BURST_TRIG_ABOVE && crossed(b, s, word)) {
+            // the crossing value is the first post-trigger one
+            trigger(b, slot);
+            state = BURST_TRIGGERED;
+        }
+    } else if (state != BURST_TRIGGERED || s->count - s->at_trigger >= b->post) {
+        return;
+    }
+    s->words[s->pos] = word;
+    s->pos = (s->pos + 1 == b->size)? 0: s->pos + 1;
+    s->count++;
+    if (state == BURST_TRIGGERED && s->count - s->at_trigger == b->post && --b->pending == 0) {
+        // the values are visible to core 1 before the state
+        atomic_store_explicit(&b->state, BURST_DONE, memory_order_release);
+    }
+}
+
+// called with core 0 paused, a triggered burst keeps what it has
+void burst_stop(struct Burst* b) {
+    uint8_t state = atomic_load_explicit(&b->state, memory_order_relaxed);
+    atomic_store_explicit(&b->state, (state == BURST_TRIGGERED)? BURST_DONE: (state == BURST_ARMED)? BURST_OFF: state,
+        memory_order_release);
+}
+
+// number of values of the slot in the burst, first is the index of the oldest one relative to the trigger
+uint32_t burst_words(const struct Burst* b, uint8_t slot, int32_t* first) {
+    const struct BurstSlot* s = &b->slot[slot];
+    uint32_t n = (s->count < b->size)? s->count: b->size;
+    *first = (int32_t)(s->count - n) - (int32_t)s->at_trigger;
+    if (*first < -(int32_t)b->pre) {
+        // stopped before the post-trigger values overwrote the older history
+        n -= -(int32_t)b->pre - *first;
+        *first = -(int32_t)b->pre;
+    }
+    return n;
+}
+
+// value k of the slot relative to the trigger, k from burst_words() first on
+uint32_t burst_word(const struct Burst* b, uint8_t slot, int32_t k) {
+    const struct BurstSlot* s = &b->slot[slot];
+    uint32_t back = s->count - (s->at_trigger + k);     // 1 is the last value written
+    return s->words[(s->pos + b->size - back) % b->size];
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Triggered burst capture
+// Short windows of edges faster than any output link are kept in RAM instead: while
+// armed, core 0 writes every raw value of the counting state machines into a circular
+// buffer per SM (slot) of the arena, next to the normal processing. The trigger (command,
+// GPIO edge or a period above/below a threshold on any channel) freezes the pre-trigger
+// history of each slot, then post values more are written and the burst is done; nothing
+// is dropped as long as core 0 keeps up with the PIO, whatever the output rate. Core 1
+// reads the burst afterwards at leisure. Only core 0 writes the slots, core 1 arms and
+// stops the burst with core 0 paused, or reads it once done.
+// No pico-sdk dependency here.
+
+#define BURST_MAX_SLOTS 8               // counting SMs, PET_MAX_CHANNELS with two per channel in interleaved capture
+
+#define BURST_OFF 0
+#define BURST_ARMED 1                   // pre-trigger history, waiting for the trigger
+#define BURST_TRIGGERED 2               // post-trigger values
+#define BURST_DONE 3                    // complete or stopped, read by core 1
+
+#define BURST_TRIG_CMD 0                // BURST FIRE only
+#define BURST_TRIG_GPIO 1               // rising edge of BURST_TRIGGER_GPIO
+#define BURST_TRIG_ABOVE 2              // an interval longer than the threshold
+#define BURST_TRIG_BELOW 3              // an interval shorter than the threshold
+
+struct BurstSlot
+{
+    uint32_t* words;                    // circular buffer of size words
+    uint32_t pos;                       // next write position in words
+    uint32_t count;                     // values written since armed
+    uint32_t at_trigger;                // count when triggered, the first post-trigger value
+    uint32_t prev_ticks;                // last timestamp, threshold of timestamp capture
+};
+
+struct Burst
+{
+    uint32_t* arena;
+    uint32_t arena_words;
+    uint8_t slots;                      // channels * SMs per channel, slot = channel * sms + SM
+    uint8_t sms;
+    bool timestamps;                    // picopet_ts words, the interval is the difference of two values
+    uint8_t trig;                       // BURST_TRIG_...
+    uint32_t threshold;                 // clk_sys cycles of the interval, 2*clk_cnt of period capture
+    uint16_t pre;
+    uint16_t post;
+    uint32_t size;                      // pre + post words per slot
+    uint8_t pending;                    // slots not complete after the trigger
+    uint8_t trig_slot;                  // slot which crossed the threshold, 255 for command and GPIO
+    _Atomic uint8_t state;              // BURST_..., written by core 0 once armed
+    _Atomic bool fire;                  // trigger request of the command or the GPIO IRQ
+    struct BurstSlot slot[BURST_MAX_SLOTS];
+};
+
+void burst_init(struct Burst* b, uint32_t* arena, uint32_t arena_words);
+
+uint32_t burst_max_words(const struct Burst* b, uint8_t slots);
+
+bool burst_arm(struct Burst* b, uint8_t channels, uint8_t sms, bool timestamps, uint16_t pre, uint16_t post, uint8_t trig, uint32_t threshold);
+
+void burst_fire(struct Burst* b);
+
+void burst_add(struct Burst* b, uint8_t slot, uint32_t word);
+
+void burst_stop(struct Burst* b);
+
+uint32_t burst_words(const struct Burst* b, uint8_t slot, int32_t* first);
+
+uint32_t burst_word(const struct Burst* b, uint8_t slot, int32_t k);
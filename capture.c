@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+#include "picoPET.h"
+#include "pioAlloc.h"
+#include "ringBuf.h"
+#include "capture.h"
+
+// DMA capture of the counting state machines RX FIFOs
+// Each counting SM has its own DMA channel paced by the SM RX DREQ. The channel writes
+// into a circular buffer using the DMA write address ring wrap, so the PIO FIFO is emptied
+// within few clk_sys cycles and "push noblock" never drops an edge while we are printing.
+// The number of words written is derived from the remaining transfer count.
+// Channels with phase interleaved capture have a ring per counting SM, source s = i*sms + k.
+
+#define DMA_TRANS_COUNT 0xffffffff
+#define CAPTURE_SOURCES (PET_MAX_CHANNELS*PIO_MAX_CHANNEL_SMS)
+
+extern struct PetInput inputs[];
+
+static uint32_t capture_buff[CAPTURE_SOURCES][CAPTURE_RING_WORDS] __attribute__((aligned(CAPTURE_RING_WORDS*4)));
+static struct PetRing rings[CAPTURE_SOURCES];
+static int dma_chan[CAPTURE_SOURCES];
+static uint32_t dma_base[CAPTURE_SOURCES];     // words written when the transfer count reaches 0
+static uint8_t dma_channels = 0;
+static uint8_t capture_sms = 1;         // counting SMs per channel
+
+
+static uint32_t words_written(uint8_t i) {
+    uint32_t remaining = dma_hw->ch[dma_chan[i]].transfer_count;
+    if (remaining == 0 && !dma_channel_is_busy(dma_chan[i])) {
+        // after 2^32-1 words the channel stops, re-arm it; the write address continues in the ring
+        dma_base[i] += DMA_TRANS_COUNT;
+        dma_channel_set_trans_count(dma_chan[i], DMA_TRANS_COUNT, true);
+        return dma_base[i] - DMA_TRANS_COUNT;
+    }
+    return dma_base[i] - remaining;
+}
+
+void capture_init(uint8_t channels, uint8_t sms) {
+    uint8_t ring_bits = 0;
+    while ((1u << ring_bits) < CAPTURE_RING_WORDS*4) {
+        ring_bits++;
+    }
+    capture_sms = sms;
+    dma_channels = channels*sms;
+    for (uint8_t s = 0; s < dma_channels; s++) {
+        struct PetInput* in = &inputs[s / sms];
+        uint sm = (s % sms == 0)? in->smc: in->smp;
+        ring_init(&rings[s], capture_buff[s], CAPTURE_RING_WORDS);
+        dma_chan[s] = dma_claim_unused_channel(true);
+        dma_base[s] = DMA_TRANS_COUNT;
+
+        dma_channel_config c = dma_channel_get_default_config(dma_chan[s]);
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+        channel_config_set_read_increment(&c, false);
+        channel_config_set_write_increment(&c, true);
+        channel_config_set_ring(&c, true, ring_bits);       // wrap the write address
+        channel_config_set_dreq(&c, pio_get_dreq(in->pio, sm, false));
+        dma_channel_configure(dma_chan[s], &c, capture_buff[s], &in->pio->rxf[sm], DMA_TRANS_COUNT, true);
+    }
+}
+
+void capture_stop() {
+    // the state machines have to be stopped already
+    for (uint8_t i = 0; i < dma_channels; i++) {
+        dma_channel_abort(dma_chan[i]);
+        dma_channel_unclaim(dma_chan[i]);
+    }
+    dma_channels = 0;
+}
+
+// k is the counting SM of the channel, 0 unless phase interleaved
+bool capture_get(uint8_t i, uint8_t k, uint32_t* word) {
+    uint8_t s = i*capture_sms + k;
+    return ring_get(&rings[s], words_written(s), word);
+}
+
+// values of the counting SM read or lost since capture_init(), the last value read is at position - 1
+uint32_t capture_position(uint8_t i, uint8_t k) {
+    return rings[i*capture_sms + k].rd;
+}
+
+uint32_t capture_overruns(uint8_t i) {
+    uint32_t n = 0;
+    for (uint8_t k = 0; k < capture_sms; k++) {
+        n += rings[i*capture_sms + k].overruns;
+    }
+    return n;
+}
@@ -0,0 +1,12 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+void capture_init(uint8_t channels, uint8_t sms);
+
+void capture_stop();
+
+bool capture_get(uint8_t i, uint8_t k, uint32_t* word);
+
+uint32_t capture_position(uint8_t i, uint8_t k);
+
+uint32_t capture_overruns(uint8_t i);
@@ -0,0 +1,33 @@
+#include <stddef.h>
+#include <string.h>
+#include "configStore.h"
+#include "binOut.h"
+
+// NOTE: no pico-sdk dependency here
+
+static uint8_t store_crc(const struct StoreBlock* b) {
+    // bin_crc8() takes up to 255 bytes at once
+    const uint8_t* data = (const uint8_t*)b;
+    uint16_t len = offsetof(struct StoreBlock, crc);
+    uint8_t crc = 0;
+    for (uint16_t k = 0; k < len; k += 255) {
+        crc = bin_crc8(crc, data + k, (len - k > 255)? 255: len - k);
+    }
+    return crc;
+}
+
+void store_init(struct StoreBlock* b) {
+    // zeroed, so the padding bytes covered by the CRC are defined
+    memset(b, 0, sizeof(*b));
+}
+
+void store_seal(struct StoreBlock* b) {
+    b->magic = STORE_MAGIC;
+    b->version = STORE_VERSION;
+    b->size = sizeof(*b);
+    b->crc = store_crc(b);
+}
+
+bool store_valid(const struct StoreBlock* b) {
+    return b->magic == STORE_MAGIC && b->version == STORE_VERSION && b->size == sizeof(*b) && b->crc == store_crc(b);
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "measure.h"
+#include "selfCal.h"
+
+// Persistent configuration
+// One block in the last flash sector keeps the power up configuration (mode, format,
+// channels, capture, averaging, gate, divider) and the self-calibration table, so the
+// counter restarts measuring as it was left without waiting for a host. The block is
+// versioned: a block of another STORE_VERSION, with a wrong size or CRC is ignored as a
+// whole and the compile time defaults are used. No pico-sdk dependency here.
+
+#define STORE_MAGIC 0x54455050          // "PPET"
+#define STORE_VERSION 3                 // increment whenever struct StoreBlock or PetConfig changes
+
+#define STORE_CONFIG 0x01               // cfg is valid
+#define STORE_CAL 0x02                  // cal is valid
+
+struct StoreBlock
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;                      // sizeof(struct StoreBlock)
+    uint8_t flags;                      // STORE_...
+    struct PetConfig cfg;
+    struct PetCal cal;
+    uint8_t crc;                        // CRC-8 of all the bytes before
+};
+
+void store_init(struct StoreBlock* b);
+
+void store_seal(struct StoreBlock* b);
+
+bool store_valid(const struct StoreBlock* b);
@@ -1,103 +1,386 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "pico/stdlib.h"
-#include "pico/divider.h"
+#include "hardware/dma.h"
+#include "hardware/uart.h"
 #include "picoPET.h"
-#include "pico/double.h"
+#include "capture.h"
+#include "measure.h"
+#include "spscQueue.h"
+#include "health.h"
+#include "timebase.h"
+#include "outWriter.h"
+#include "burst.h"
+#include "fixFmt.h"
 
-uint8_t first_sensed_input = 255;
 extern uint clk_src_freq;
 extern struct PetInput inputs[];
 
+struct SpscQueue records;               // core 0 -> core 1
+struct PetMeasure measure;              // core 1 only
+struct HealthCore0 health0;             // written by core 0 only
+struct HealthCore1 health1;             // written by core 1 only
+struct OutWriter output;                // core 1 only
+static uint32_t burst_arena[BURST_ARENA_WORDS];
+struct Burst burst = {.arena = burst_arena, .arena_words = BURST_ARENA_WORDS};   // written by core 0 while armed or triggered
+
+static uint8_t count_channels = SM_COUNT;               // channels drained by core 0
+static uint8_t count_sms = 1;                           // counting SMs per channel
+static bool count_timestamps = false;                   // picopet_ts capture
+static void (*enqueue)(uint8_t i, uint8_t k, uint32_t raw);     // per capture mode, k is the SM of the channel
+static uint8_t edge_rise = 0;           // bit mask of dual-edge channels whose next value is a low time, polled FIFOs
+static uint64_t ts_ref;                 // last extended timestamp in picopet_ts ticks (2 clk_sys cycles)
+static uint32_t ts_ref_us;              // time_us_32() when ts_ref was last updated
+static uint32_t pass_us;                // time_us_32() at the start of the drain pass
+static volatile bool count_pause_req = false;
+static volatile bool count_paused = false;
+static uint8_t count_epoch = 0;         // timebase epoch stamped on the records, changed with core 0 paused
+static uint8_t process_epoch = 0;       // epoch of the records processed by core 1
+static uint32_t epoch_freq[TIMEBASE_EPOCHS];    // clk_sys frequency of the epochs, written by core 1
+static const struct PetCal* process_cal = NULL;   // self-calibration table, kept over new timescales
+
 
 void inputs_init() {
     inputs[0].input_gpio = INPUT_SIGNALA_GPIO;
     inputs[0].led_gpio = INPUT_SIGNALA_LEDGPIO;
     inputs[0].name = "ChA";
-    if (SM_COUNT > 1) {
-        inputs[1].input_gpio = INPUT_SIGNALB_GPIO;
-        inputs[1].led_gpio = INPUT_SIGNALB_LEDGPIO;
-        inputs[1].name = "ChB";
-    }
-    if (SM_COUNT > 2) {
-        inputs[2].input_gpio = INPUT_SIGNALC_GPIO;
-        inputs[2].led_gpio = INPUT_SIGNALC_LEDGPIO;
-        inputs[2].name = "ChC";
-    }
-    if (SM_COUNT > 3) {
-        inputs[3].input_gpio = INPUT_SIGNALD_GPIO;
-        inputs[3].led_gpio = INPUT_SIGNALD_LEDGPIO;
-        inputs[3].name = "ChD";
+    inputs[1].input_gpio = INPUT_SIGNALB_GPIO;
+    inputs[1].led_gpio = INPUT_SIGNALB_LEDGPIO;
+    inputs[1].name = "ChB";
+    inputs[2].input_gpio = INPUT_SIGNALC_GPIO;
+    inputs[2].led_gpio = INPUT_SIGNALC_LEDGPIO;
+    inputs[2].name = "ChC";
+    inputs[3].input_gpio = INPUT_SIGNALD_GPIO;
+    inputs[3].led_gpio = INPUT_SIGNALD_LEDGPIO;
+    inputs[3].name = "ChD";
+}
+
+// CORE 1 - arithmetic and output
+
+#if defined OUTPUT_UART_DMA
+static int out_dma = -1;
+
+static void out_send(const uint8_t* buf, uint16_t len) {
+    dma_channel_config c = dma_channel_get_default_config(out_dma);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_dreq(&c, uart_get_dreq(uart_default, true));
+    dma_channel_configure(out_dma, &c, &uart_get_hw(uart_default)->dr, buf, len, true);
+}
+
+static bool out_busy() {
+    return dma_channel_is_busy(out_dma);
+}
+#else
+static void out_send(const uint8_t* buf, uint16_t len) {
+    // one stdio write per batch, the USB driver sends it as full CDC packets;
+    // raw write, printf would translate the 0x0a bytes of binary output to CRLF
+    fwrite(buf, 1, len, stdout);
+    fflush(stdout);
+}
+#endif
+
+static uint32_t out_clock() {
+    return time_us_32();
+}
+
+void process_output_init() {
+    #if defined OUTPUT_UART_DMA
+        out_dma = dma_claim_unused_channel(true);
+        out_init(&output, out_send, out_busy, out_clock);
+    #else
+        out_init(&output, out_send, NULL, out_clock);
+    #endif
+    out_set_policy(&output, OUT_FLUSH_BYTES, OUT_FLUSH_US);
+}
+
+void process_output_poll() {
+    out_poll(&output);
+}
+
+void process_output_flush() {
+    // before any output not going through process_write(), keeps the order of the lines
+    out_flush(&output);
+}
+
+void process_write(const char* buf, uint16_t len, bool binary) {
+    // text with CRLF line ends as printed by the stdio driver
+    out_write(&output, buf, len, !binary);
+}
+
+void process_init(const struct PetConfig* cfg) {
+    const char* names[PET_MAX_CHANNELS];
+    for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+        names[i] = inputs[i].name;
     }
-    for (uint8_t i = 0; i < SM_COUNT; i++) {
-        inputs[i].tm = 0;
-        inputs[i].ts = 0.0;
+    process_epoch = count_epoch;
+    epoch_freq[process_epoch & (TIMEBASE_EPOCHS - 1)] = clk_src_freq;
+    measure_init(&measure, cfg, clk_src_freq, names, process_write);
+    measure_set_cal(&measure, process_cal);
+    measure_header(&measure);
+}
+
+void process_set_cal(const struct PetCal* cal) {
+    process_cal = cal;
+    measure_set_cal(&measure, cal);
+}
+
+void process_records() {
+    struct PetRecord rec;
+    while (spsc_pop(&records, &rec)) {
+        if (rec.epoch != process_epoch) {
+            // first value counted with the new clock, the values before it used the old one
+            process_epoch = rec.epoch;
+            measure_set_clock(&measure, epoch_freq[process_epoch & (TIMEBASE_EPOCHS - 1)]);
+        }
+        if (measure.cfg.format == PET_FORMAT_RAW) {
+            measure_raw(&measure, rec.channel, (rec.flags & (REC_PHASE1 | REC_RISE))? 1: 0, ((uint64_t)rec.value_hi << 32) | rec.value);
+        }
+        if (rec.flags & REC_TIMESTAMP) {
+            measure_timestamp(&measure, rec.channel, ((uint64_t)rec.value_hi << 32) | rec.value);
+        } else if (rec.flags & (REC_PHASE0 | REC_PHASE1)) {
+            measure_count_phase(&measure, rec.channel, (rec.flags & REC_PHASE1)? 1: 0, rec.value);
+        } else if (rec.flags & (REC_FALL | REC_RISE)) {
+            measure_edge(&measure, rec.channel, (rec.flags & REC_RISE)? 1: 0, rec.value);
+        } else {
+            measure_count(&measure, rec.channel, rec.value);
+        }
     }
 }
 
-void do_count() {
-    #if defined OUTPUT_CYCLE_COUNT          // write header to output
-        printf("COUNT\t CHANNEL\n");    
-    #elif defined OUTPUT_FREQUENCY
-        printf("FREQ\t CHANNEL\n");
-    #elif defined OUTPUT_TIMEMARK
-        printf("TIMEMARK\t CHANNEL\n");
+// CORE 0 - draining of the counting state machines
+
+static void enqueue_count(uint8_t i, uint8_t k, uint32_t clk_cnt) {
+    struct PetRecord rec;
+    rec.channel = i;
+    rec.flags = 0;
+    rec.epoch = count_epoch;
+    rec.reserved = 0;
+    rec.value = clk_cnt;
+    rec.value_hi = 0;
+    spsc_push(&records, &rec);          // full only while a burst drains, accounted in records.dropped
+}
+
+static void enqueue_phase(uint8_t i, uint8_t k, uint32_t clk_cnt) {
+    // the pairing of both phases is done on core 1
+    struct PetRecord rec;
+    rec.channel = i;
+    rec.flags = (k == 0)? REC_PHASE0: REC_PHASE1;
+    rec.epoch = count_epoch;
+    rec.reserved = 0;
+    rec.value = clk_cnt;
+    rec.value_hi = 0;
+    spsc_push(&records, &rec);
+}
+
+static void enqueue_edge(uint8_t i, uint8_t k, uint32_t clk_cnt) {
+    // picopet_de pushes the high and low times in turns starting with a high time
+    struct PetRecord rec;
+    #if defined CAPTURE_DMA
+        // the ring position counts the values lost by an overrun too, so the turns stay right
+        bool rise = (capture_position(i, k) & 1) == 0;
     #else
-        printf("DEBUG\n");
+        bool rise = edge_rise & (1u << i);
+        edge_rise ^= 1u << i;
     #endif
+    rec.channel = i;
+    rec.flags = rise? REC_RISE: REC_FALL;
+    rec.epoch = count_epoch;
+    rec.reserved = 0;
+    rec.value = clk_cnt;
+    rec.value_hi = 0;
+    spsc_push(&records, &rec);
+}
+
+static void enqueue_timestamp(uint8_t i, uint8_t k, uint32_t x) {
+    // picopet_ts counts X down, the channels are drained out of order by less than half
+    // of the 32bit range, so the signed difference to the last timestamp extends the value
+    uint32_t ticks = ~x;
+    ts_ref += (int32_t)(ticks - (uint32_t)ts_ref);
+    ts_ref_us = pass_us;
+    struct PetRecord rec;
+    rec.channel = i;
+    rec.flags = REC_TIMESTAMP;
+    rec.epoch = count_epoch;
+    rec.reserved = 0;
+    rec.value = (uint32_t)ts_ref;
+    rec.value_hi = ts_ref >> 32;
+    spsc_push(&records, &rec);
+}
 
+static inline void refresh_timestamp() {
+    // without edges on any channel advance the reference by the elapsed time,
+    // so it stays within half of the counter range of the next timestamp
+    uint32_t elapsed = pass_us - ts_ref_us;
+    if (elapsed >= TIMESTAMP_REFRESH_US) {
+        ts_ref += (uint64_t)elapsed * clk_src_freq / 2000000;
+        ts_ref_us = pass_us;
+    }
+}
+
+void count_init(uint8_t channels, uint8_t capture) {
+    // called with core 0 paused (or not yet counting), right after the state machines were started
+    count_channels = channels;
+    count_sms = (capture == PET_CAPTURE_INTERLEAVED)? 2: 1;
+    count_timestamps = capture == PET_CAPTURE_TIMESTAMP;
+    enqueue = count_timestamps? enqueue_timestamp: (count_sms == 2)? enqueue_phase: (capture == PET_CAPTURE_EDGES)? enqueue_edge:
+        enqueue_count;
+    edge_rise = 0;
+    ts_ref = 0;
+    ts_ref_us = time_us_32();
+    pass_us = ts_ref_us;
+    spsc_init(&records);
+    burst_stop(&burst);                 // the slots are the SMs of the old configuration
+    #if defined CAPTURE_DMA
+        capture_init(channels, count_sms);
+    #endif
+}
+
+void count_set_clock(uint32_t freq) {
+    // called from core 1 with core 0 paused, after clk_sys was found changed to freq; the values
+    // drained before keep the old epoch, measure_set_clock() bridges those since the last good check
+    count_epoch++;
+    epoch_freq[count_epoch & (TIMEBASE_EPOCHS - 1)] = freq;
+}
+
+void count_pause() {
+    // called from core 1, returns when core 0 stopped draining the state machines
+    count_pause_req = true;
+    while (!count_paused) {
+        tight_loop_contents();
+    }
+}
+
+void count_resume() {
+    count_pause_req = false;
+    while (count_paused) {
+        tight_loop_contents();
+    }
+}
+
+static inline bool count_room() {
+    // a full queue leaves the values in the DMA ring (RX FIFO), so a slow output shows up as ring
+    // overruns only; a running burst keeps draining, it gets every value and the queue drops them
+    if (spsc_level(&records) <= SPSC_RECORDS - count_sms) {
+        return true;                    // room for one value of each SM, interleaved SMs stay in turns
+    }
+    uint8_t state = atomic_load_explicit(&burst.state, memory_order_relaxed);
+    return state == BURST_ARMED || state == BURST_TRIGGERED;
+}
+
+static inline void capture_burst(uint8_t i, uint8_t k, uint32_t clk_cnt) {
+    uint8_t state = atomic_load_explicit(&burst.state, memory_order_relaxed);
+    if (state == BURST_ARMED || state == BURST_TRIGGERED) {
+        burst_add(&burst, i*count_sms + k, clk_cnt);
+    }
+}
+
+void do_count() {
+    uint32_t loop_us = time_us_32();
+    loop_stats_init(&health0.loop);
     while (true) {
-        for (uint8_t i = 0; i < SM_COUNT; i++) {
-            if (!pio_sm_is_rx_fifo_empty(inputs[i].pio, inputs[i].smc)) {
-                uint32_t clk_cnt = pio_sm_get(inputs[i].pio, inputs[i].smc);            // read the register from ASM code
-                clk_cnt = ~clk_cnt;                                // negate the received value
-                uint32_t clk_cor = 0;
-                // PIO CALIBRATION CORRECTIONS
-                #if AVG_PERIODS == 1
-                    clk_cor = (clk_cnt+2)*2;
-                #else
-                    clk_cor = 2*(clk_cnt + 1.5*AVG_PERIODS + 1.5);
-                #endif
-                #if defined OUTPUT_CYCLE_COUNT
-                    printf("%u\t %s\n", clk_cor, inputs[i].name);
-                #elif defined OUTPUT_FREQUENCY
-                    double fc = ufix2double(clk_src_freq, 0) * ufix2double(AVG_PERIODS, 0)/ufix2double(clk_cor, 0);
-//                    double fc = ((double)clk_src_freq*(double)AVG_PERIODS)/((double)clk_cor);
-                    printf("%.9f\t %s\n", fc, inputs[i].name);
-                #elif defined OUTPUT_TIMEMARK
-                    if (first_sensed_input == 255) {
-                        // save the first sensed impulse input for later use
-                        // this happens only once
-                        first_sensed_input = i;
-                    }
-                    if (inputs[i].tm == 0 && first_sensed_input != i && first_sensed_input != 255) {
-                        // offset the start of the timescale by the timemark of the first sensed input
-                        // this happens only once for each input
-                        inputs[i].tm = inputs[first_sensed_input].tm;
+        pass_us = time_us_32();
+        loop_stats_add(&health0.loop, pass_us - loop_us);
+        loop_us = pass_us;
+        if (count_timestamps && count_room()) {
+            refresh_timestamp();        // not past values still waiting in the rings
+        }
+        for (uint8_t i = 0; i < count_channels; i++) {
+            uint32_t clk_cnt;
+            #if defined CAPTURE_DMA
+                // read everything the DMA captured for this channel since the last pass,
+                // the SMs of an interleaved channel are read in turns to keep their values in order
+                bool more = true;
+                while (more && count_room()) {
+                    more = false;
+                    for (uint8_t k = 0; k < count_sms; k++) {
+                        if (capture_get(i, k, &clk_cnt)) {
+                            enqueue(i, k, clk_cnt);
+                            capture_burst(i, k, clk_cnt);
+                            health0.events[i]++;
+                            more = true;
+                        }
                     }
-                    uint64_t rem;
-                    uint64_t div;
-                    inputs[i].tm += clk_cor;
-                    div = divmod_u64u64_rem(inputs[i].tm, (uint64_t) clk_src_freq, &rem);
-                    inputs[i].ts = ufix642double(div, 0) + ufix642double(rem, 0)/ufix2double(clk_src_freq, 0);
-//                    inputs[i].ts = (double)div + (double)((uint32_t)rem)/(double)clk_src_freq;
-                    printf("%.9f\t %s\n", inputs[i].ts, inputs[i].name);
-                #else
-                    // this is a DEBUG output
-                    uint32_t cnt = MHZ;
-                    tm[i] = tm[i] + clk_cor;
-                    uint64_t rem;
-                    uint64_t div;
-                    div = divmod_u64u64_rem(tm[i], (uint64_t) clk_src_freq, &rem);
-                    ts[i] = (double)div + (double)((uint32_t)rem)/(double)clk_src_freq;
-                    double fs = ((double)clk_src_freq*(double)AVG_PERIODS)/((double)clk_cnt);
-                    double fc = ((double)clk_src_freq*(double)AVG_PERIODS)/((double)clk_cor);
-                    printf("@%u\t %i\t %u\t %u\t %.6f\t %.6f\t %u\t %.10f\t", clk_src_freq, i, clk_cnt, clk_cor, fs, fc, tm[i], ts[i]);
-                    for (uint8_t x = 0; x < SM_COUNT; x++) {
-                        printf("%u\t %u\t %.10f\t ", x, tm[x], ts[x]);
+                }
+            #else
+                bool room = count_room();
+                for (uint8_t k = 0; k < count_sms && room; k++) {
+                    uint sm = (k == 0)? inputs[i].smc: inputs[i].smp;
+                    if (!pio_sm_is_rx_fifo_empty(inputs[i].pio, sm)) {
+                        clk_cnt = pio_sm_get(inputs[i].pio, sm);            // read the register from ASM code
+                        enqueue(i, k, clk_cnt);
+                        capture_burst(i, k, clk_cnt);
+                        health0.events[i]++;
                     }
-                #endif
-            } 
+                }
+            #endif
+        }
+        if (count_pause_req) {
+            // core 1 reconfigures the state machines
+            count_paused = true;
+            while (count_pause_req) {
+                tight_loop_contents();
+            }
+            count_paused = false;
+            loop_us = time_us_32();     // the pause is not a drain pass
+        }
+    }
+}
+
+// BURST - armed, stopped and read by core 1, written by core 0
+
+bool process_burst_arm(const struct PetConfig* cfg) {
+    count_pause();
+    bool armed = burst_arm(&burst, count_channels, count_sms, count_timestamps, cfg->burst_pre, cfg->burst_post, cfg->burst_trig,
+        cfg->burst_cycles);
+    count_resume();
+    return armed;
+}
+
+void process_burst_fire() {
+    // from the command or the GPIO IRQ
+    burst_fire(&burst);
+}
+
+void process_burst_stop() {
+    count_pause();
+    burst_stop(&burst);
+    count_resume();
+}
+
+uint8_t process_burst_state() {
+    return atomic_load_explicit(&burst.state, memory_order_acquire);
+}
+
+uint32_t process_burst_max() {
+    return burst_max_words(&burst, count_channels * count_sms);
+}
+
+void process_burst_dump() {
+    // a triggered burst is stopped with the values it has, per slot a header and the values
+    // relative to the trigger, the corrected cycles of period capture or the cycles since the
+    // first value of timestamp capture
+    char line[PET_LINE_LEN];
+    process_burst_stop();
+    if (process_burst_state() != BURST_DONE) {
+        return;
+    }
+    for (uint8_t s = 0; s < burst.slots; s++) {
+        uint8_t i = s / burst.sms;
+        int32_t first;
+        uint32_t n = burst_words(&burst, s, &first);
+        process_write(line, snprintf(line, sizeof(line), "BURST %s SM=%u FIRST=%ld N=%lu%s\n", inputs[i].name, s % burst.sms, (long)first,
+            (unsigned long)n, (s == burst.trig_slot)? " TRIG": ""), false);
+        uint32_t ticks0 = ~burst_word(&burst, s, first);
+        for (int32_t k = first; k < first + (int32_t)n; k++) {
+            uint32_t w = burst_word(&burst, s, k);
+            uint64_t cycles = burst.timestamps? 2*(uint64_t)(~w - ticks0): 2*(uint64_t)(~w) + measure.cor_offset[i];
+            uint8_t len = snprintf(line, sizeof(line), "%ld\t ", (long)k);
+            len += fmt_u64(line + len, cycles);
+            line[len++] = '\n';
+            process_write(line, len, false);
         }
     }
+    process_output_flush();
 }
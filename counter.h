@@ -1,4 +1,37 @@
+#include "measure.h"
 
 void inputs_init();
 
-void do_count();
\ No newline at end of file
+void process_init(const struct PetConfig* cfg);
+
+void process_records();
+
+void process_set_cal(const struct PetCal* cal);
+
+void process_output_init();
+
+void process_output_poll();
+
+void process_output_flush();
+
+void count_init(uint8_t channels, uint8_t capture);
+
+void count_set_clock(uint32_t freq);
+
+void count_pause();
+
+void count_resume();
+
+void do_count();
+
+bool process_burst_arm(const struct PetConfig* cfg);
+
+void process_burst_fire();
+
+void process_burst_stop();
+
+uint8_t process_burst_state();
+
+uint32_t process_burst_max();
+
+void process_burst_dump();
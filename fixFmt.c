@@ -0,0 +1,64 @@
+#include "fixFmt.h"
+
+// writes decimal representation of v to buf, returns number of chars written (no terminating zero)
+uint8_t fmt_u64(char* buf, uint64_t v) {
+    char tmp[20];
+    uint8_t n = 0;
+    if (v <= 0xffffffff) {
+        // 32bit division is much cheaper on the M0+
+        uint32_t v32 = (uint32_t)v;
+        do {
+            tmp[n++] = '0' + v32 % 10;
+            v32 /= 10;
+        } while (v32);
+    } else {
+        do {
+            tmp[n++] = '0' + v % 10;
+            v /= 10;
+        } while (v);
+    }
+    for (uint8_t i = 0; i < n; i++) {
+        buf[i] = tmp[n-1-i];
+    }
+    buf[n] = '\0';
+    return n;
+}
+
+// writes ip.frac with FMT_DECIMALS decimals where frac = rem/den rounded half up, also
+// exactly half way between two decimals, where the double based output rounded the
+// double nearest to the quotient either way
+static uint8_t fmt_fraction(char* buf, uint64_t ip, uint64_t rem, uint32_t den) {
+    // rem < den < 2^32 and FMT_SCALE < 2^30, the product fits 64 bits
+    uint64_t scaled = rem * FMT_SCALE;
+    uint64_t fp = scaled / den;
+    uint64_t fr = scaled - fp * den;
+    if (2*fr >= den) {
+        fp++;
+    }
+    if (fp >= FMT_SCALE) {
+        fp -= FMT_SCALE;
+        ip++;
+    }
+    uint8_t n = fmt_u64(buf, ip);
+    buf[n++] = '.';
+    uint32_t f = (uint32_t)fp;
+    for (int8_t d = FMT_DECIMALS - 1; d >= 0; d--) {
+        buf[n + d] = '0' + f % 10;
+        f /= 10;
+    }
+    n += FMT_DECIMALS;
+    buf[n] = '\0';
+    return n;
+}
+
+// writes num/den (e.g. frequency as clk_src_freq*AVG_PERIODS/clk_cor), returns number of chars written
+uint8_t fmt_quotient(char* buf, uint64_t num, uint32_t den) {
+    uint64_t ip = num / den;
+    return fmt_fraction(buf, ip, num - ip * den, den);
+}
+
+// writes cycles/freq seconds (e.g. timemark of PetInput.tm), returns number of chars written
+uint8_t fmt_seconds(char* buf, uint64_t cycles, uint32_t freq) {
+    uint64_t ip = cycles / freq;
+    return fmt_fraction(buf, ip, cycles - ip * freq, freq);
+}
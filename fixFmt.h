@@ -0,0 +1,16 @@
+#pragma once
+#include <stdint.h>
+
+// Integer only number formatting
+// The RP2040 has no FPU, so timemarks and frequencies are printed from integer cycle
+// counts with exact decimal digits instead of going through soft-float doubles.
+
+#define FMT_DECIMALS 9
+#define FMT_SCALE 1000000000u           // 10^FMT_DECIMALS
+#define FMT_MAX_LEN 32                  // max. length of a formatted number including terminating zero
+
+uint8_t fmt_u64(char* buf, uint64_t v);
+
+uint8_t fmt_quotient(char* buf, uint64_t num, uint32_t den);
+
+uint8_t fmt_seconds(char* buf, uint64_t cycles, uint32_t freq);
@@ -0,0 +1,38 @@
+#include <stdio.h>
+#include "health.h"
+
+// NOTE: no pico-sdk dependency here
+
+
+void loop_stats_init(struct LoopStats* s) {
+    s->count = 0;
+    s->min_us = UINT32_MAX;
+    s->max_us = 0;
+    for (uint8_t k = 0; k < HEALTH_HIST_BINS; k++) {
+        s->hist[k] = 0;
+    }
+}
+
+void loop_stats_add(struct LoopStats* s, uint32_t us) {
+    uint8_t k = 0;
+    while (k < HEALTH_HIST_BINS - 1 && (us >> k) != 0) {
+        k++;
+    }
+    s->hist[k]++;
+    s->count++;
+    s->min_us = (us < s->min_us)? us: s->min_us;
+    s->max_us = (us > s->max_us)? us: s->max_us;
+}
+
+// "LOOP <name> N= MIN= MAX= HIST=h0,h1,..." the histogram bins are below 1, 2, 4, ... us
+uint8_t loop_stats_format(char* buf, uint8_t len, const char* name, const struct LoopStats* s) {
+    int n = snprintf(buf, len, "LOOP %s N=%lu MIN=%lu MAX=%lu HIST=", name, (unsigned long)s->count,
+        (unsigned long)((s->count > 0)? s->min_us: 0), (unsigned long)s->max_us);
+    for (uint8_t k = 0; k < HEALTH_HIST_BINS && n < len; k++) {
+        n += snprintf(buf + n, len - n, (k == 0)? "%lu": ",%lu", (unsigned long)s->hist[k]);
+    }
+    if (n < len) {
+        n += snprintf(buf + n, len - n, "\n");
+    }
+    return (n < len)? n: len - 1;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "measure.h"
+
+// Health counters
+// Always-on counters of the capture and output path. Every counter has one writer core,
+// so plain 32bit increments are enough and the other core reads consistent words (the
+// M0+ has no read-modify-write atomics and none are needed). The core 0 part costs a few
+// stores per drain pass. No pico-sdk dependency, the formatting is checked on the host.
+
+#define HEALTH_HIST_BINS 12             // loop time histogram, bin k counts iterations of 2^(k-1) to 2^k-1 us, the last one all longer
+
+struct LoopStats
+{
+    uint32_t count;                     // loop iterations
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t hist[HEALTH_HIST_BINS];
+};
+
+struct HealthCore0                      // written by core 0 only
+{
+    uint32_t events[PET_MAX_CHANNELS];  // values drained per channel
+    struct LoopStats loop;              // do_count() drain pass
+};
+
+struct HealthCore1                      // written by core 1 only
+{
+    uint32_t stalls[PET_MAX_CHANNELS];  // monitor ticks in which a counting SM dropped a value (FDEBUG RXSTALL)
+    uint32_t switches;                  // timebase switches
+    struct LoopStats loop;              // monitor() loop
+};
+
+void loop_stats_init(struct LoopStats* s);
+
+void loop_stats_add(struct LoopStats* s, uint32_t us);
+
+uint8_t loop_stats_format(char* buf, uint8_t len, const char* name, const struct LoopStats* s);
@@ -0,0 +1,49 @@
+#include <string.h>
+#include <math.h>
+#include "histogram.h"
+
+// NOTE: no pico-sdk dependency here
+
+
+// a new run, the nominal interval is taken from the next value
+void hist_init(struct Histogram* h) {
+    memset(h, 0, sizeof(*h));
+}
+
+// a new gate starting at the timemark t0, the nominal interval is kept
+void hist_start(struct Histogram* h, uint64_t t0) {
+    uint64_t ref = h->ref;
+    memset(h, 0, sizeof(*h));
+    h->ref = ref;
+    h->t0 = t0;
+    h->min = INT32_MAX;
+    h->max = INT32_MIN;
+}
+
+void hist_add(struct Histogram* h, int64_t x, uint16_t width) {
+    int32_t v = (x < INT32_MIN)? INT32_MIN: (x > INT32_MAX)? INT32_MAX: (int32_t)x;
+    // floor division, the quotient of a negative value rounds towards zero
+    int32_t k = (v >= 0)? v / width: -(int32_t)(((uint32_t)-(v + 1)) / width) - 1;
+    if (k < -HIST_BINS/2) {
+        h->below++;
+    } else if (k >= HIST_BINS/2) {
+        h->above++;
+    } else {
+        h->bins[k + HIST_BINS/2]++;
+    }
+    h->n++;
+    h->min = (v < h->min)? v: h->min;
+    h->max = (v > h->max)? v: h->max;
+    h->sum += v;
+    uint64_t sq = (uint64_t)((int64_t)v * v);
+    h->sum_sq = (sq > UINT64_MAX - h->sum_sq)? UINT64_MAX: h->sum_sq + sq;
+}
+
+void hist_moments(const struct Histogram* h, struct HistMoments* r) {
+    r->mean = (h->n > 0)? (double)h->sum / h->n: 0;
+    r->std = NAN;
+    if (h->n > 1 && h->sum_sq != UINT64_MAX) {
+        double var = ((double)h->sum_sq - (double)h->sum * r->mean) / (h->n - 1);
+        r->std = (var > 0)? sqrt(var): 0;
+    }
+}
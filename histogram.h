@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Histogram of the sample intervals or time interval error
+// For jitter the distribution is enough, so instead of every value only the bin counts
+// and the moments of a gate are kept. The values are signed offsets in clk_sys cycles
+// from the nominal interval of the channel; per value there is one hardware divide, a
+// few integer additions and one 32x32 multiply, no floating point. Values outside the
+// HIST_BINS bins are counted in below/above but still enter the moments and min/max.
+// The sum of squares saturates, a gate of many widely spread values reports std nan.
+// No pico-sdk dependency here.
+
+#define HIST_BINS 64                    // bins per channel, the offset 0 is the lower edge of bin HIST_BINS/2
+#define HIST_REF_BITS 16                // fraction bits of the nominal interval
+
+struct Histogram
+{
+    uint32_t bins[HIST_BINS];
+    uint32_t below;                     // values below the first bin
+    uint32_t above;                     // values above the last bin
+    uint32_t n;
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint64_t sum_sq;                    // UINT64_MAX once saturated
+    uint64_t t0;                        // timemark of the gate start
+    uint64_t ref;                       // nominal interval in 1/2^HIST_REF_BITS cycles, 0 until the first value
+};
+
+struct HistMoments
+{
+    double mean;                        // cycles
+    double std;                         // cycles, NAN if the sum of squares saturated
+};
+
+void hist_init(struct Histogram* h);
+
+void hist_start(struct Histogram* h, uint64_t t0);
+
+void hist_add(struct Histogram* h, int64_t x, uint16_t width);
+
+void hist_moments(const struct Histogram* h, struct HistMoments* r);
@@ -0,0 +1,621 @@
+#include <stdio.h>
+#include <string.h>
+#include "measure.h"
+#include "timebase.h"
+#include "selfCal.h"
+#include "fixFmt.h"
+
+static const char* mode_names[] = {"TIMEMARK", "FREQ", "COUNT", "STAB", "OMEGA", "TIC", "HIST", "WIDTH", "DUTY"};  // in PET_MODE_... order, also parsed by MODE
+
+
+// PIO CALIBRATION CORRECTIONS
+//   picopet_sp  clk_cor = (clk_cnt+2)*2
+//   picopet_mp  clk_cor = 2*(clk_cnt + 1.5*AVG_PERIODS + 1.5)
+//   picopet_hr  each phase as picopet_mp, also with AVG_PERIODS 1; clk_cor is the mean of both phases
+//   picopet_de  high and low time each as picopet_sp, the period is their sum
+// all written as 2*clk_cnt + offset to keep the soft-float out of the hot path
+// a self-calibration table (selfCal.h) replaces them per channel
+uint32_t pet_cor_offset(uint16_t avg_periods, uint8_t capture) {
+    return ((avg_periods == 1 && capture != PET_CAPTURE_INTERLEAVED) || capture == PET_CAPTURE_EDGES)? 4: 3*avg_periods + 3;
+}
+
+static inline uint64_t correct(struct PetMeasure* m, uint8_t i, uint32_t clk_cnt) {
+    return 2*(uint64_t)(~clk_cnt) + m->cor_offset[i];   // negate the received value and correct, up to 2^33 cycles
+}
+
+// picopet_ts counts 2 clk_sys cycles per tick on every path, no correction is needed
+static inline uint64_t ticks_to_cycles(uint64_t ticks) {
+    return 2*ticks;
+}
+
+static inline void add_timemark(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    if (m->first_sensed_input == 255) {
+        // save the first sensed impulse input for later use
+        // this happens only once
+        m->first_sensed_input = i;
+    }
+    if (m->tm[i] == 0 && m->first_sensed_input != i) {
+        // offset the start of the timescale by the timemark of the first sensed input
+        // this happens only once for each input
+        m->tm[i] = m->tm[m->first_sensed_input];
+    }
+    m->tm[i] += clk_cor;
+    m->check_values[i]++;
+}
+
+// the interval spanning a clock switch counted cycles of both clocks (and the disturbed clk_sys
+// while the PLL locks), it is bridged by the previous interval of the channel
+static inline uint64_t bridge(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    if (m->bridge & (1u << i)) {
+        m->bridge &= ~(1u << i);
+        clk_cor = (m->last_cor[i] != 0)? m->last_cor[i]: clk_cor;
+    }
+    m->last_cor[i] = clk_cor;
+    return clk_cor;
+}
+
+static inline void write_line(struct PetMeasure* m, char* line, uint8_t n, uint8_t i) {
+    line[n++] = '\t';
+    line[n++] = ' ';
+    const char* name = m->names[i];
+    while (*name) {
+        line[n++] = *name++;
+    }
+    line[n++] = '\n';
+    line[n] = '\0';
+    m->write(line, n, false);
+}
+
+// the timescale is maintained in every mode, so switching the mode keeps it
+// the routines get the corrected cycles since the previous output of the channel, m->tm[i] is already updated
+
+static void process_timemark(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    char line[PET_LINE_LEN];
+    write_line(m, line, fmt_seconds(line, m->tm[i], m->clk_src_freq), i);
+}
+
+static void process_utc_timemark(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    // edges of the other channels before the anchor edge are less than its second earlier
+    char line[PET_LINE_LEN];
+    uint64_t cycles = m->tm[i] + (uint64_t)m->utc_sec * m->clk_src_freq - m->utc_tm;
+    write_line(m, line, fmt_seconds(line, cycles, m->clk_src_freq), i);
+}
+
+static void process_fall_timemark(struct PetMeasure* m, uint8_t i, uint64_t tm) {
+    // "<seconds>\t <name>-FALL", the rising edges are output by process_timemark()
+    char line[PET_LINE_LEN];
+    uint8_t n = fmt_seconds(line, tm, m->clk_src_freq);
+    line[n++] = '\t';
+    line[n++] = ' ';
+    n += snprintf(line + n, sizeof(line) - n, "%s-FALL\n", m->names[i]);
+    m->write(line, n, false);
+}
+
+static void process_utc_fall_timemark(struct PetMeasure* m, uint8_t i, uint64_t tm) {
+    process_fall_timemark(m, i, tm + (uint64_t)m->utc_sec * m->clk_src_freq - m->utc_tm);
+}
+
+static inline void write_quotient(struct PetMeasure* m, uint8_t i, uint64_t num, uint64_t den) {
+    char line[PET_LINE_LEN];
+    while (den >> 32) {
+        // intervals over 2^32 cycles (long gates, timestamp capture) are scaled to the 32bit divisor
+        den >>= 1;
+        num >>= 1;
+    }
+    write_line(m, line, fmt_quotient(line, num, den), i);
+}
+
+static inline void write_frequency(struct PetMeasure* m, uint8_t i, uint64_t periods, uint64_t cycles) {
+    write_quotient(m, i, m->clk_src_freq * periods, cycles);
+}
+
+static void process_frequency(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    write_frequency(m, i, m->cfg.avg_periods, clk_cor);
+}
+
+static void process_gated_frequency(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    // reciprocal counting, the gate opens and closes on an input edge, so it is at least gate_len long
+    m->gate_cycles[i] += clk_cor;
+    m->gate_periods[i] += m->cfg.avg_periods;
+    if (m->gate_cycles[i] >= m->gate_len) {
+        write_frequency(m, i, m->gate_periods[i], m->gate_cycles[i]);
+        m->gate_cycles[i] = 0;
+        m->gate_periods[i] = 0;
+    }
+}
+
+static void process_cycle_count(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    char line[PET_LINE_LEN];
+    write_line(m, line, fmt_u64(line, clk_cor), i);
+}
+
+static void process_binary(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    // the host decoder does the timemark/frequency arithmetic, event frames carry 32 bits; the
+    // shared timescale of timestamp capture (the first edge of a channel is not an interval) and
+    // longer intervals can not be rebuilt from them, the timemark goes in a timestamp frame
+    uint8_t buf[2*BIN_MAX_FRAME];
+    if (m->cfg.capture == PET_CAPTURE_TIMESTAMP || (clk_cor >> 32) != 0) {
+        m->write((const char*)buf, bin_encode_timestamp(&m->bin, buf, i, m->tm[i], clk_cor), true);
+    } else {
+        m->write((const char*)buf, bin_encode_event(&m->bin, buf, i, clk_cor), true);
+    }
+}
+
+static void process_omega(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    // gates as process_gated_frequency(), every sample is an avg_periods long interval of the fit
+    struct OmegaFit* f = &m->omega[i];
+    if (m->gate_periods[i] == 0) {
+        omega_start(f, m->tm[i] - clk_cor, clk_cor);
+    }
+    omega_add(f, m->tm[i]);
+    m->gate_cycles[i] += clk_cor;
+    m->gate_periods[i] += m->cfg.avg_periods;
+    if (m->gate_cycles[i] >= m->gate_len) {
+        char line[PET_LINE_LEN];
+        double period;
+        if (omega_period(f, &period)) {
+            // period in fixed point with as many fraction bits as the 32bit divisor allows
+            uint64_t num = (uint64_t)m->clk_src_freq * m->cfg.avg_periods;
+            while (period + 0.5 >= 4294967296.0) {
+                // periods over 2^32 cycles (timestamp capture with a long AVG) are scaled to the 32bit divisor
+                period /= 2;
+                num >>= 1;
+            }
+            while (period < (double)(1u << 30) && num < ((uint64_t)1 << 62)) {
+                period *= 2;
+                num <<= 1;
+            }
+            write_line(m, line, fmt_quotient(line, num, (uint32_t)(period + 0.5)), i);
+        } else {
+            write_frequency(m, i, m->gate_periods[i], m->gate_cycles[i]);
+        }
+        m->gate_cycles[i] = 0;
+        m->gate_periods[i] = 0;
+    }
+}
+
+static void write_interval(struct PetMeasure* m, uint8_t i, uint64_t stop, uint64_t start) {
+    char line[PET_LINE_LEN];
+    uint8_t n = 0;
+    if (stop < start) {
+        line[n++] = '-';
+    }
+    n += fmt_seconds(line + n, (stop < start)? start - stop: stop - start, m->clk_src_freq);
+    write_line(m, line, n, i);
+}
+
+static inline uint64_t distance(uint64_t a, uint64_t b) {
+    return (a < b)? b - a: a - b;
+}
+
+static void process_tic(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    // a stop edge pairs with the reference edge closer than half of the reference period, the channels
+    // are processed out of order, so whichever edge of a pair comes second outputs the interval
+    // unpaired edges (missing on the other channel) are dropped by the next reference edge
+    uint8_t bit = 1u << i;
+    if (i == m->cfg.tic_ref) {
+        // a missing reference edge makes the interval a multiple of the period
+        uint64_t n = (m->tic_period == 0)? m->cfg.avg_periods: (clk_cor + m->tic_period/2) / m->tic_period;
+        m->tic_period = clk_cor / ((n == 0)? 1: n);
+        m->tic_start = m->tm[i];
+        m->tic_open = ((1u << m->cfg.channels) - 1) & ~bit;
+        for (uint8_t j = 0; j < m->cfg.channels; j++) {
+            if (((m->tic_pending >> j) & 1) && distance(m->tic_stop[j], m->tic_start) <= m->tic_period/2) {
+                write_interval(m, j, m->tic_stop[j], m->tic_start);
+                m->tic_open &= ~(1u << j);
+            }
+        }
+        m->tic_pending = 0;
+    } else if ((m->tic_open & bit) && distance(m->tm[i], m->tic_start) <= m->tic_period/2) {
+        write_interval(m, i, m->tm[i], m->tic_start);
+        m->tic_open &= ~bit;
+    } else {
+        m->tic_stop[i] = m->tm[i];
+        m->tic_pending |= bit;
+    }
+}
+
+static void process_width(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    // mean high time of the periods in seconds
+    write_quotient(m, i, m->edge_high[i], (uint64_t)m->clk_src_freq * m->cfg.avg_periods);
+}
+
+static void process_duty(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    write_quotient(m, i, m->edge_high[i], clk_cor);
+}
+
+static void process_none(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    // raw capture, the timescale is kept for the modes selected later
+}
+
+static void process_stability(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    // no output per sample, measure_stability_report() prints the summary
+    adev_add(&m->adev[i], m->tm[i]);
+}
+
+// "HIST <name> PERIOD|TIE N= REF= MEAN= STD= MIN= MAX= BELOW= ABOVE=" in seconds, then the
+// lower edge and count of the non-empty bins
+static void write_hist(struct PetMeasure* m, uint8_t i) {
+    char line[3*PET_LINE_LEN];
+    const struct Histogram* h = &m->hist[i];
+    double f = m->clk_src_freq;
+    struct HistMoments r;
+    hist_moments(h, &r);
+    m->write(line, snprintf(line, sizeof(line), "HIST %s %s N=%lu REF=%.9e MEAN=%.4e STD=%.4e MIN=%.4e MAX=%.4e BELOW=%lu ABOVE=%lu\n",
+        m->names[i], (m->cfg.hist_value == PET_HIST_TIE)? "TIE": "PERIOD", (unsigned long)h->n, h->ref / (f * (1u << HIST_REF_BITS)),
+        r.mean / f, r.std / f, h->min / f, h->max / f, (unsigned long)h->below, (unsigned long)h->above), false);
+    for (int16_t k = 0; k < HIST_BINS; k++) {
+        if (h->bins[k] > 0) {
+            m->write(line, snprintf(line, sizeof(line), "%.4e\t %lu\n", (double)(k - HIST_BINS/2) * m->cfg.hist_width / f,
+                (unsigned long)h->bins[k]), false);
+        }
+    }
+}
+
+static void process_hist(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    // gates as process_gated_frequency(), one histogram per channel per gate; the nominal
+    // interval is the mean interval of the previous gate, the first gate takes its first interval
+    struct Histogram* h = &m->hist[i];
+    const uint64_t half = 1u << (HIST_REF_BITS - 1);
+    int64_t x;
+    if (m->gate_periods[i] == 0) {
+        if (h->ref == 0) {
+            h->ref = clk_cor << HIST_REF_BITS;
+        }
+        hist_start(h, m->tm[i] - clk_cor);
+    }
+    if (m->cfg.hist_value == PET_HIST_TIE) {
+        // the edge against the ideal edge n nominal intervals after the gate start
+        x = (int64_t)(m->tm[i] - h->t0) - (int64_t)(((h->n + 1) * h->ref + half) >> HIST_REF_BITS);
+    } else {
+        x = (int64_t)clk_cor - (int64_t)((h->ref + half) >> HIST_REF_BITS);
+    }
+    hist_add(h, x, m->cfg.hist_width);
+    m->gate_cycles[i] += clk_cor;
+    m->gate_periods[i] += m->cfg.avg_periods;
+    if (m->gate_cycles[i] >= m->gate_len) {
+        write_hist(m, i);
+        h->ref = (m->gate_cycles[i] << HIST_REF_BITS) / h->n;
+        m->gate_cycles[i] = 0;
+        m->gate_periods[i] = 0;
+    }
+}
+
+// period capture, clk_cnt is the raw value pushed by picopet_sp/picopet_mp
+void measure_count(struct PetMeasure* m, uint8_t i, uint32_t clk_cnt) {
+    uint64_t clk_cor = bridge(m, i, correct(m, i, clk_cnt));
+    add_timemark(m, i, clk_cor);
+    m->process(m, i, clk_cor);
+}
+
+// phase interleaved capture, both state machines of a channel count the same edges one cycle apart
+// the counts are paired by the time they span, so an edge missed by one of them is bridged
+// by summing the counts of the other until both end on the same edge again
+void measure_count_phase(struct PetMeasure* m, uint8_t i, uint8_t phase, uint32_t clk_cnt) {
+    uint64_t* sum = m->hr_sum[i];
+    sum[phase] += correct(m, i, clk_cnt);
+    int64_t diff = (int64_t)(sum[0] - sum[1]);
+    int64_t max_diff = 2;
+    if (m->bridge & (1u << i)) {
+        // one phase may have ended its interval on either side of a clock switch
+        max_diff = ((sum[0] < sum[1])? sum[0]: sum[1]) / 2;
+    }
+    if (sum[0] == 0 || sum[1] == 0 || diff > max_diff || diff < -max_diff) {
+        return;                         // the other phase has not counted up to this edge yet
+    }
+    uint64_t clk_cor = bridge(m, i, (sum[0] + sum[1]) / 2);
+    sum[0] = 0;
+    sum[1] = 0;
+    add_timemark(m, i, clk_cor);
+    m->process(m, i, clk_cor);
+}
+
+// dual-edge capture, clk_cnt is the value pushed by picopet_de on the falling edge (the high time,
+// edge 0) or on the rising edge (the low time, edge 1); the rising edges are processed as the
+// periods of period capture, every avg_periods-th of them, the falling edges get a timemark
+// once the channel has one
+void measure_edge(struct PetMeasure* m, uint8_t i, uint8_t edge, uint32_t clk_cnt) {
+    uint64_t* sum = m->hr_sum[i];
+    sum[edge] += correct(m, i, clk_cnt);
+    if (edge == 0) {
+        if (m->tm[i] != 0) {
+            m->fall(m, i, m->tm[i] + sum[0] + sum[1]);
+        }
+        return;
+    }
+    if (++m->edge_periods[i] < m->cfg.avg_periods) {
+        return;
+    }
+    uint64_t clk_cor = bridge(m, i, sum[0] + sum[1]);
+    m->edge_periods[i] = 0;
+    m->edge_high[i] = sum[0];
+    sum[0] = 0;
+    sum[1] = 0;
+    add_timemark(m, i, clk_cor);
+    m->process(m, i, clk_cor);
+}
+
+// timestamp capture, ticks is the extended counter of picopet_ts latched on the rising edge
+// every avg_periods-th edge is processed, the first edge of a channel only starts its interval
+void measure_timestamp(struct PetMeasure* m, uint8_t i, uint64_t ticks) {
+    uint64_t t = ticks_to_cycles(ticks);
+    if (m->first_sensed_input == 255) {
+        // all channels share the counter, the first edge of any of them starts the timescale
+        m->first_sensed_input = i;
+        m->ts_base = t;
+        m->ts_last = t;
+    }
+    if (m->bridge) {
+        // first edge after a clock switch, the counter continues from it
+        if (m->last_cor[i] != 0) {
+            m->ts_base = t - (m->tm[i] + m->last_cor[i] * m->ts_edges[i] / m->cfg.avg_periods);
+        }
+        m->bridge = 0;
+    }
+    if ((int64_t)(t - m->ts_last) > 0) {
+        m->ts_last = t;
+    }
+    t -= m->ts_base;
+    if (m->ts_edges[i] == 0) {
+        m->tm[i] = t;
+        m->ts_edges[i] = 1;
+        return;
+    }
+    if (m->ts_edges[i]++ < m->cfg.avg_periods) {
+        return;
+    }
+    m->ts_edges[i] = 1;
+    uint64_t clk_cor = t - m->tm[i];
+    m->last_cor[i] = clk_cor;
+    m->tm[i] = t;
+    m->check_values[i]++;
+    m->process(m, i, clk_cor);
+}
+
+static void bin_config(struct PetMeasure* m) {
+    struct BinConfig cfg;
+    struct BinRawConfig raw;
+    cfg.clk_src_freq = m->clk_src_freq;
+    cfg.avg_periods = m->cfg.avg_periods;
+    cfg.mode = m->cfg.mode;
+    cfg.channels = m->cfg.channels;
+    bin_encoder_init(&m->bin, &cfg);
+    raw.clk_src_freq = m->clk_src_freq;
+    raw.avg_periods = m->cfg.avg_periods;
+    raw.capture = m->cfg.capture;
+    raw.channels = m->cfg.channels;
+    memcpy(raw.cor_offset, m->cor_offset, sizeof(raw.cor_offset));
+    bin_raw_encoder_init(&m->raw, &raw);
+}
+
+static void write_raw_config(struct PetMeasure* m) {
+    uint8_t buf[BIN_MAX_FRAME];
+    m->write((const char*)buf, bin_encode_raw_config(&m->raw, buf), true);
+}
+
+// raw capture, the uncorrected value of the counting SM (phase 1 of picopet_hr, the low time of
+// picopet_de) or the extended timestamp, written before the value is processed
+void measure_raw(struct PetMeasure* m, uint8_t i, uint8_t phase, uint64_t value) {
+    uint8_t buf[2*BIN_MAX_FRAME];
+    m->write((const char*)buf, bin_encode_raw(&m->raw, buf, i + BIN_RAW_CHANNELS*phase, value), true);
+}
+
+static void set_gate(struct PetMeasure* m) {
+    // the running gates are restarted
+    uint16_t gate_ms = (m->cfg.gate_ms > 0)? m->cfg.gate_ms: (m->cfg.mode == PET_MODE_OMEGA)? PET_OMEGA_GATE_MS:
+        (m->cfg.mode == PET_MODE_HIST)? PET_HIST_GATE_MS: 0;
+    m->gate_len = (uint64_t)m->clk_src_freq * gate_ms / 1000;
+    memset(m->gate_cycles, 0, sizeof(m->gate_cycles));
+    memset(m->gate_periods, 0, sizeof(m->gate_periods));
+}
+
+void measure_init(struct PetMeasure* m, const struct PetConfig* cfg, uint32_t clk_src_freq, const char* const* names, pet_write_fn write) {
+    memset(m, 0, sizeof(*m));
+    m->first_sensed_input = 255;
+    m->clk_src_freq = clk_src_freq;
+    m->write = write;
+    for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+        m->names[i] = names[i];
+    }
+    measure_set_config(m, cfg);
+}
+
+static void set_cor_offsets(struct PetMeasure* m) {
+    for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+        m->cor_offset[i] = (m->cal != NULL)? cal_cor_offset(m->cal, i, m->cfg.avg_periods, m->cfg.capture):
+            pet_cor_offset(m->cfg.avg_periods, m->cfg.capture);
+    }
+}
+
+static void select_process(struct PetMeasure* m) {
+    if (m->cfg.format == PET_FORMAT_RAW) {
+        m->process = process_none;
+    } else if (m->cfg.mode == PET_MODE_STABILITY) {
+        m->process = process_stability;
+    } else if (m->cfg.mode == PET_MODE_OMEGA) {
+        m->process = process_omega;
+    } else if (m->cfg.mode == PET_MODE_TIC) {
+        m->process = process_tic;
+    } else if (m->cfg.mode == PET_MODE_HIST) {
+        m->process = process_hist;
+    } else if (m->cfg.mode == PET_MODE_WIDTH) {
+        m->process = process_width;
+    } else if (m->cfg.mode == PET_MODE_DUTY) {
+        m->process = process_duty;
+    } else if (m->cfg.format == PET_FORMAT_BINARY) {
+        m->process = process_binary;
+    } else if (m->cfg.mode == PET_MODE_FREQUENCY) {
+        m->process = (m->cfg.gate_ms > 0)? process_gated_frequency: process_frequency;
+    } else if (m->cfg.mode == PET_MODE_CYCLE_COUNT) {
+        m->process = process_cycle_count;
+    } else if (m->cfg.utc && m->utc_anchored) {
+        m->process = process_utc_timemark;
+    } else {
+        m->process = process_timemark;
+    }
+    m->fall = (m->process == process_timemark)? process_fall_timemark: (m->process == process_utc_timemark)? process_utc_fall_timemark:
+        process_none;
+}
+
+// selects the processing routine, the timescale is kept
+void measure_set_config(struct PetMeasure* m, const struct PetConfig* cfg) {
+    if (cfg->mode == PET_MODE_STABILITY && m->cfg.mode != PET_MODE_STABILITY) {
+        // a new stability run
+        for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+            adev_init(&m->adev[i]);
+        }
+    }
+    if (cfg->mode == PET_MODE_HIST) {
+        // a new histogram run with every change, the gates restart as well
+        for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+            hist_init(&m->hist[i]);
+        }
+    }
+    m->cfg = *cfg;
+    set_cor_offsets(m);
+    set_gate(m);
+    m->tic_open = 0;
+    m->tic_pending = 0;
+    select_process(m);
+    bin_config(m);
+}
+
+// the clock is right, the values processed so far were counted with clk_src_freq
+void measure_clock_checked(struct PetMeasure* m) {
+    for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+        if (m->check_tm[i] != 0 && m->check_values[i] > 0) {
+            m->check_cycles[i] = m->tm[i] - m->check_tm[i];
+            m->check_count[i] = m->check_values[i];
+        }
+        m->check_tm[i] = m->tm[i];
+        m->check_values[i] = 0;
+    }
+}
+
+// the values since the last clock check may have been counted with either clock, they span the switch:
+// the timemark continues from the one at the check by their number of mean intervals before it
+static void bridge_since_check(struct PetMeasure* m, uint8_t i) {
+    uint32_t n = m->check_values[i];
+    if (n == 0 || m->check_count[i] == 0) {
+        return;
+    }
+    uint64_t q = m->check_cycles[i] / m->check_count[i];
+    uint64_t r = m->check_cycles[i] % m->check_count[i];
+    m->tm[i] = m->check_tm[i] + n * q + (n * r + m->check_count[i] / 2) / m->check_count[i];
+    m->last_cor[i] = (m->check_cycles[i] + m->check_count[i] / 2) / m->check_count[i];
+}
+
+// the clock changed, the values from now on are cycles of clk_src_freq
+// the timescale is converted, so the timemarks continue; gates, the stability and histogram runs restart
+// with measure_clock_checked() the values since the last check are bridged, the switch happened among them
+void measure_set_clock(struct PetMeasure* m, uint32_t clk_src_freq) {
+    uint32_t from = m->clk_src_freq;
+    for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+        bridge_since_check(m, i);
+        m->tm[i] = timebase_convert(m->tm[i], from, clk_src_freq);
+        m->check_tm[i] = m->tm[i];
+        m->check_values[i] = 0;
+        m->check_cycles[i] = timebase_convert(m->check_cycles[i], from, clk_src_freq);
+        m->hr_sum[i][0] = timebase_convert(m->hr_sum[i][0], from, clk_src_freq);
+        m->hr_sum[i][1] = timebase_convert(m->hr_sum[i][1], from, clk_src_freq);
+        m->tic_stop[i] = timebase_convert(m->tic_stop[i], from, clk_src_freq);
+        m->last_cor[i] = timebase_convert(m->last_cor[i], from, clk_src_freq);
+        adev_init(&m->adev[i]);
+        hist_init(&m->hist[i]);
+    }
+    m->bridge = (1u << PET_MAX_CHANNELS) - 1;
+    if (m->first_sensed_input != 255) {
+        // the shared counter continues at the new rate from the last timestamp before the switch,
+        // unless the first edge after it has a previous interval to bridge the switch
+        m->ts_base = m->ts_last - timebase_convert(m->ts_last - m->ts_base, from, clk_src_freq);
+    }
+    m->tic_start = timebase_convert(m->tic_start, from, clk_src_freq);
+    m->tic_period = timebase_convert(m->tic_period, from, clk_src_freq);
+    m->utc_tm = timebase_convert(m->utc_tm, from, clk_src_freq);
+    m->clk_src_freq = clk_src_freq;
+    set_gate(m);
+    if (m->cfg.format == PET_FORMAT_RAW) {
+        bin_config(m);                  // announced ahead of the next raw value
+    } else if (m->cfg.format == PET_FORMAT_BINARY && m->cfg.mode < PET_MODE_STABILITY) {
+        // announce the new frequency to the decoder
+        uint8_t buf[BIN_MAX_FRAME];
+        bin_config(m);
+        m->write((const char*)buf, bin_encode_config(&m->bin, buf), true);
+    } else {
+        char line[PET_LINE_LEN];
+        m->write(line, snprintf(line, sizeof(line), "TIMEBASE %lu\t SWITCH\n", (unsigned long)clk_src_freq), false);
+    }
+}
+
+// cal is kept by the caller, NULL returns to the constants
+void measure_set_cal(struct PetMeasure* m, const struct PetCal* cal) {
+    m->cal = cal;
+    set_cor_offsets(m);
+    if (m->cfg.format == PET_FORMAT_RAW) {
+        // the raw values are replayed with the corrections of the latest raw config frame
+        bin_config(m);
+    }
+}
+
+// anchors the timescale to UTC, utc_sec is the UTC second of the last edge of the reference
+// channel which carries the GNSS PPS, once per timescale
+void measure_set_utc(struct PetMeasure* m, uint32_t utc_sec) {
+    uint8_t ref = m->cfg.tic_ref;
+    if (m->utc_anchored || m->first_sensed_input == 255 || (m->tm[ref] == 0 && m->first_sensed_input != ref)) {
+        return;
+    }
+    m->utc_tm = m->tm[ref];
+    m->utc_sec = utc_sec;
+    m->utc_anchored = true;
+    pet_process_fn process = m->process;
+    select_process(m);
+    if (m->process != process) {
+        measure_header(m);
+    }
+}
+
+// writes the header of the output
+void measure_header(struct PetMeasure* m) {
+    if (m->cfg.format == PET_FORMAT_RAW) {
+        write_raw_config(m);
+    } else if (m->cfg.format == PET_FORMAT_BINARY && m->cfg.mode < PET_MODE_STABILITY) {
+        uint8_t buf[BIN_MAX_FRAME];
+        m->write((const char*)buf, bin_encode_config(&m->bin, buf), true);
+    } else if (m->cfg.mode == PET_MODE_TIC) {
+        char line[PET_LINE_LEN];
+        m->write(line, snprintf(line, sizeof(line), "TIC %s\t CHANNEL\n", m->names[m->cfg.tic_ref]), false);
+    } else if (m->process == process_utc_timemark) {
+        char line[PET_LINE_LEN];
+        m->write(line, snprintf(line, sizeof(line), "TIMEMARK UTC\t CHANNEL\n"), false);
+    } else {
+        char line[PET_LINE_LEN];
+        m->write(line, snprintf(line, sizeof(line), "%s\t CHANNEL\n", measure_mode_name(m->cfg.mode)), false);
+    }
+}
+
+// summary table of the stability run of channel i, tau and TDEV in seconds
+void measure_stability_channel(struct PetMeasure* m, uint8_t i) {
+    char line[2*PET_LINE_LEN];
+    struct AllanDev* a = &m->adev[i];
+    m->write(line, snprintf(line, sizeof(line), "STAB %s N=%lu TAU0=%.9e\n", m->names[i], (unsigned long)a->samples,
+        adev_tau0(a) / m->clk_src_freq), false);
+    m->write(line, snprintf(line, sizeof(line), "TAU\t ADEV\t MDEV\t TDEV\t N\n"), false);
+    struct AdevResult r;
+    for (uint8_t k = 0; adev_result(a, k, m->clk_src_freq, &r); k++) {
+        m->write(line, snprintf(line, sizeof(line), "%.4e\t %.4e\t %.4e\t %.4e\t %lu\n", r.tau, r.adev, r.mdev, r.tdev,
+            (unsigned long)r.n), false);
+    }
+}
+
+void measure_stability_report(struct PetMeasure* m) {
+    if (m->cfg.format == PET_FORMAT_RAW) {
+        return;                         // nothing but raw frames in the stream
+    }
+    for (uint8_t i = 0; i < m->cfg.channels; i++) {
+        measure_stability_channel(m, i);
+    }
+}
+
+const char* measure_mode_name(uint8_t mode) {
+    return (mode < sizeof(mode_names)/sizeof(mode_names[0]))? mode_names[mode]: "?";
+}
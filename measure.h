@@ -0,0 +1,148 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "binOut.h"
+#include "allanDev.h"
+#include "omegaFit.h"
+#include "histogram.h"
+
+// Measurement engine
+// Turns the raw values of the counting state machines into timemarks, frequencies or
+// cycle counts. Every output mode is a separate routine selected by function pointer
+// when the configuration changes, so the per-sample path has no mode branches.
+// Period capture (picopet_sp/mp) delivers the cycles counted per period, timestamp
+// capture (picopet_ts) the 64-bit extended value of a counter shared by all channels,
+// phase interleaved capture (picopet_hr) the counts of two state machines per channel,
+// dual-edge capture (picopet_de) the high and low time of every period in turns.
+// No pico-sdk dependency, the same code runs on core 1 and in the host tools.
+
+#define PET_MAX_CHANNELS 4
+#define PET_MAX_AVG_PERIODS 10000
+#define PET_MAX_GATE_MS 60000
+#define PET_LINE_LEN 64
+
+#define PET_MODE_TIMEMARK BIN_MODE_TIMEMARK
+#define PET_MODE_FREQUENCY BIN_MODE_FREQUENCY
+#define PET_MODE_CYCLE_COUNT BIN_MODE_CYCLE_COUNT
+#define PET_MODE_STABILITY 3            // ADEV/MDEV/TDEV summary only, this and the following modes are text only
+#define PET_MODE_OMEGA 4                // least-squares frequency per gate
+#define PET_OMEGA_GATE_MS 1000          // gate of PET_MODE_OMEGA if no gate time set
+#define PET_MODE_TIC 5                  // signed interval from the reference channel edge to the other channels
+#define PET_MODE_HIST 6                 // histogram and moments of the intervals or their TIE per gate
+#define PET_HIST_GATE_MS 1000           // gate of PET_MODE_HIST if no gate time set
+#define PET_MODE_WIDTH 7                // mean pulse (high time) width, needs PET_CAPTURE_EDGES
+#define PET_MODE_DUTY 8                 // duty cycle, high time over the period, needs PET_CAPTURE_EDGES
+#define PET_MODES 9
+
+#define PET_HIST_PERIOD 0               // histogram of the sample intervals
+#define PET_HIST_TIE 1                  // histogram of the time interval error against the nominal interval
+
+#define PET_FORMAT_TEXT 0
+#define PET_FORMAT_BINARY 1
+#define PET_FORMAT_RAW 2                // uncorrected values of the counting SMs, replayed by tools/petreplay
+
+#define PET_CAPTURE_PERIOD 0            // cycles per period counted by picopet_sp/picopet_mp
+#define PET_CAPTURE_TIMESTAMP 1         // free-running timestamps by picopet_ts
+#define PET_CAPTURE_INTERLEAVED 2       // two picopet_hr state machines per channel one cycle apart, 1 cycle resolution
+#define PET_CAPTURE_EDGES 3             // high and low time of every period by picopet_de
+#define PET_CAPTURES 4
+
+struct PetConfig
+{
+    uint8_t mode;                       // PET_MODE_...
+    uint8_t format;                     // PET_FORMAT_...
+    uint8_t channels;                   // number of active input channels
+    uint8_t capture;                    // PET_CAPTURE_...
+    uint16_t avg_periods;               // number of input periods counted by the SM
+    uint16_t gate_ms;                   // frequency gate time, 0 for one frequency per sample
+    uint8_t tic_ref;                    // reference channel, start of PET_MODE_TIC and GNSS PPS for the UTC anchor
+    uint8_t utc;                        // TIMEMARK in UTC seconds since 1970 once anchored
+    uint32_t div_freq;                  // divided reference output in Hz, 0 set by the DIP switches
+    uint16_t hist_width;                // bin width of PET_MODE_HIST in clk_sys cycles
+    uint8_t hist_value;                 // PET_HIST_...
+    uint16_t burst_pre;                 // burst values kept before the trigger per counting SM
+    uint16_t burst_post;                // burst values from the trigger on per counting SM
+    uint8_t burst_trig;                 // BURST_TRIG_... of burst.h
+    uint32_t burst_cycles;              // interval threshold of BURST_TRIG_ABOVE/BELOW in clk_sys cycles
+};
+
+struct PetMeasure;
+struct PetCal;
+
+typedef void (*pet_process_fn)(struct PetMeasure* m, uint8_t i, uint64_t clk_cor);
+typedef void (*pet_write_fn)(const char* buf, uint16_t len, bool binary);
+
+struct PetMeasure
+{
+    struct PetConfig cfg;
+    uint32_t clk_src_freq;
+    const struct PetCal* cal;           // self-calibration table, NULL for the constants of pet_cor_offset()
+    uint32_t cor_offset[PET_MAX_CHANNELS];      // PIO calibration, clk_cor = 2*clk_cnt + cor_offset
+    uint8_t first_sensed_input;
+    const char* names[PET_MAX_CHANNELS];
+    uint64_t tm[PET_MAX_CHANNELS];      // timemark of the last edge in clk_sys cycles
+    uint64_t last_cor[PET_MAX_CHANNELS];        // last interval of the channel, bridges a clock switch
+    uint8_t bridge;                     // bit mask of channels whose next interval spans a clock switch
+    uint64_t check_tm[PET_MAX_CHANNELS];        // timemark at the last clock check
+    uint32_t check_values[PET_MAX_CHANNELS];    // values since the last clock check
+    uint64_t check_cycles[PET_MAX_CHANNELS];    // cycles and values between the last two clock checks,
+    uint32_t check_count[PET_MAX_CHANNELS];     // their mean interval bridges the values since then on a switch
+    uint64_t ts_base;                   // timestamp of the first edge, start of the timescale
+    uint64_t ts_last;                   // latest timestamp, where the counter continues after a clock switch
+    uint16_t ts_edges[PET_MAX_CHANNELS];    // edges since the last output, 0 before the first edge
+    uint64_t hr_sum[PET_MAX_CHANNELS][2];   // corrected cycles of each phase not yet output, interleaved capture,
+                                            // of the high and low times with dual-edge capture
+    uint16_t edge_periods[PET_MAX_CHANNELS];    // periods since the last output, dual-edge capture
+    uint64_t edge_high[PET_MAX_CHANNELS];   // high time of the periods output last
+    uint64_t gate_len;                  // gate time in clk_sys cycles
+    uint64_t gate_cycles[PET_MAX_CHANNELS];     // corrected cycles accumulated in the running gate
+    uint32_t gate_periods[PET_MAX_CHANNELS];    // input periods accumulated in the running gate
+    struct OmegaFit omega[PET_MAX_CHANNELS];    // fit of the running gate, PET_MODE_OMEGA
+    uint64_t tic_start;                 // last edge of the reference channel, PET_MODE_TIC
+    uint64_t tic_period;                // last input period of the reference channel
+    uint64_t tic_stop[PET_MAX_CHANNELS];        // stop edges waiting for their start edge
+    uint8_t tic_open;                   // bit mask of stop channels not paired with tic_start yet
+    uint8_t tic_pending;                // bit mask of stop channels with an edge in tic_stop
+    bool utc_anchored;                  // utc_tm is the edge of the UTC second utc_sec
+    uint64_t utc_tm;
+    uint32_t utc_sec;
+    pet_process_fn process;
+    pet_process_fn fall;                // falling edges of dual-edge capture, gets their timemark
+    pet_write_fn write;
+    struct BinEncoder bin;
+    struct BinRawEncoder raw;
+    struct AllanDev adev[PET_MAX_CHANNELS];     // stability of the timemarks, PET_MODE_STABILITY
+    struct Histogram hist[PET_MAX_CHANNELS];    // running gate, PET_MODE_HIST
+};
+
+uint32_t pet_cor_offset(uint16_t avg_periods, uint8_t capture);
+
+void measure_count(struct PetMeasure* m, uint8_t i, uint32_t clk_cnt);
+
+void measure_count_phase(struct PetMeasure* m, uint8_t i, uint8_t phase, uint32_t clk_cnt);
+
+void measure_edge(struct PetMeasure* m, uint8_t i, uint8_t edge, uint32_t clk_cnt);
+
+void measure_timestamp(struct PetMeasure* m, uint8_t i, uint64_t ticks);
+
+void measure_init(struct PetMeasure* m, const struct PetConfig* cfg, uint32_t clk_src_freq, const char* const* names, pet_write_fn write);
+
+void measure_set_config(struct PetMeasure* m, const struct PetConfig* cfg);
+
+void measure_set_clock(struct PetMeasure* m, uint32_t clk_src_freq);
+
+void measure_clock_checked(struct PetMeasure* m);
+
+void measure_set_cal(struct PetMeasure* m, const struct PetCal* cal);
+
+void measure_set_utc(struct PetMeasure* m, uint32_t utc_sec);
+
+void measure_header(struct PetMeasure* m);
+
+void measure_raw(struct PetMeasure* m, uint8_t i, uint8_t phase, uint64_t value);
+
+void measure_stability_channel(struct PetMeasure* m, uint8_t i);
+
+void measure_stability_report(struct PetMeasure* m);
+
+const char* measure_mode_name(uint8_t mode);
@@ -0,0 +1,198 @@
+#include <string.h>
+#include <stdatomic.h>
+#include "nmea.h"
+
+// NOTE: no pico-sdk dependency here, the parser is exercised on the host as well
+
+enum { NMEA_IDLE, NMEA_BODY, NMEA_SUM_HI, NMEA_SUM_LO };
+enum { NMEA_OTHER, NMEA_GGA, NMEA_RMC, NMEA_ZDA };
+
+
+void nmea_init(struct NmeaParser* p) {
+    memset(p, 0, sizeof(*p));
+    p->fix.quality = -1;
+    p->fix.status = -1;
+}
+
+static int8_t hex_digit(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+// value of n decimal digits at s, -1 if not all digits
+static int32_t digits(const char* s, uint8_t n) {
+    int32_t v = 0;
+    for (uint8_t k = 0; k < n; k++) {
+        if (s[k] < '0' || s[k] > '9') {
+            return -1;
+        }
+        v = 10*v + (s[k] - '0');
+    }
+    return v;
+}
+
+// hhmmss[.sss]
+static void parse_time(struct NmeaFix* f, const char* s, uint8_t len) {
+    int32_t hour = (len >= 6)? digits(s, 2): -1;
+    int32_t min = (len >= 6)? digits(s + 2, 2): -1;
+    int32_t sec = (len >= 6)? digits(s + 4, 2): -1;
+    f->time_valid = hour >= 0 && min >= 0 && sec >= 0 && hour <= 23 && min <= 59 && sec <= 60;
+    if (!f->time_valid) {
+        return;                         // empty before the receiver knows the time
+    }
+    f->hour = hour;
+    f->min = min;
+    f->sec = sec;
+    f->ms = 0;
+    uint16_t scale = 100;
+    for (uint8_t k = 7; len > 6 && s[6] == '.' && k < len && digits(s + k, 1) >= 0 && scale > 0; k++, scale /= 10) {
+        f->ms += (s[k] - '0') * scale;
+    }
+}
+
+static void set_date(struct NmeaFix* f, int32_t day, int32_t month, int32_t year) {
+    if (day >= 1 && day <= 31 && month >= 1 && month <= 12 && year >= 1970) {
+        f->day = day;
+        f->month = month;
+        f->year = year;
+    }
+}
+
+static void parse_field(struct NmeaParser* p) {
+    struct NmeaFix* f = &p->next;
+    const char* s = p->buf;
+    if (p->field == 0) {
+        // address field, talker + type, e.g. GNGGA
+        const char* type = (p->len == 5)? s + 2: "";
+        p->type = (strcmp(type, "GGA") == 0)? NMEA_GGA: (strcmp(type, "RMC") == 0)? NMEA_RMC: (strcmp(type, "ZDA") == 0)? NMEA_ZDA: NMEA_OTHER;
+        return;
+    }
+    if (p->field == 1 && p->type != NMEA_OTHER) {
+        parse_time(f, s, p->len);
+    } else if (p->type == NMEA_GGA && p->field == 6) {
+        int32_t quality = (p->len == 1)? digits(s, 1): 0;
+        f->quality = (quality < 0)? 0: quality;
+    } else if (p->type == NMEA_GGA && p->field == 7) {
+        int32_t sats = (p->len == 2)? digits(s, 2): (p->len == 1)? digits(s, 1): -1;
+        f->sats = (sats < 0)? 0: sats;
+    } else if (p->type == NMEA_RMC && p->field == 2) {
+        f->status = (s[0] == 'A')? 1: 0;
+    } else if (p->type == NMEA_RMC && p->field == 9 && p->len == 6) {
+        set_date(f, digits(s, 2), digits(s + 2, 2), 2000 + digits(s + 4, 2));
+    } else if (p->type == NMEA_ZDA && p->field == 2) {
+        p->zda_day = (p->len == 2)? digits(s, 2): 0;
+    } else if (p->type == NMEA_ZDA && p->field == 3) {
+        p->zda_month = (p->len == 2)? digits(s, 2): 0;
+    } else if (p->type == NMEA_ZDA && p->field == 4 && p->len == 4) {
+        set_date(f, p->zda_day, p->zda_month, digits(s, 4));
+    }
+}
+
+static void end_field(struct NmeaParser* p) {
+    p->buf[p->len] = '\0';
+    parse_field(p);
+    p->field++;
+    p->len = 0;
+}
+
+static void start(struct NmeaParser* p) {
+    p->state = NMEA_BODY;
+    p->type = NMEA_OTHER;
+    p->field = 0;
+    p->sum = 0;
+    p->len = 0;
+    p->next = p->fix;
+}
+
+static void fail(struct NmeaParser* p) {
+    p->errors++;
+    p->state = NMEA_IDLE;
+}
+
+void nmea_feed(struct NmeaParser* p, char c) {
+    if (c == '$') {
+        if (p->state != NMEA_IDLE) {
+            p->errors++;                // sentence cut off
+        }
+        start(p);
+        return;
+    }
+    switch (p->state) {
+        case NMEA_BODY:
+            if (c == '*') {
+                end_field(p);
+                p->state = NMEA_SUM_HI;
+            } else if (c == '\r' || c == '\n' || c < ' ' || c > '~') {
+                fail(p);                // no checksum or garbage
+            } else {
+                p->sum ^= c;
+                if (c == ',') {
+                    end_field(p);
+                } else if (p->len < NMEA_FIELD_LEN - 1) {
+                    p->buf[p->len++] = c;
+                } else {
+                    fail(p);
+                }
+            }
+            break;
+        case NMEA_SUM_HI:
+            if (hex_digit(c) < 0) {
+                fail(p);
+            } else {
+                p->rx_sum = hex_digit(c) << 4;
+                p->state = NMEA_SUM_LO;
+            }
+            break;
+        case NMEA_SUM_LO:
+            if (hex_digit(c) < 0 || (p->rx_sum | hex_digit(c)) != p->sum) {
+                fail(p);
+            } else {
+                p->state = NMEA_IDLE;
+                if (p->type != NMEA_OTHER) {
+                    p->fix = p->next;
+                    p->sentences++;
+                    p->updates++;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// copy of the last fix, consistent even if the IRQ replaces it meanwhile
+// returns false if no sentence was decoded yet
+bool nmea_read(struct NmeaParser* p, struct NmeaFix* fix) {
+    uint32_t updates;
+    do {
+        updates = p->updates;
+        atomic_signal_fence(memory_order_acquire);     // copy between the two reads of updates
+        *fix = p->fix;
+        atomic_signal_fence(memory_order_acquire);
+    } while (updates != p->updates);
+    return updates > 0;
+}
+
+// seconds since 1970-01-01 of the fix time, false if the date is not known
+bool nmea_unix_time(const struct NmeaFix* fix, uint32_t* sec) {
+    if (fix->year < 1970) {
+        return false;
+    }
+    // days from civil, the year starts in March so the leap day is the last one
+    int32_t y = fix->year - (fix->month <= 2);
+    int32_t era = y / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (fix->month + ((fix->month > 2)? -3: 9)) + 2) / 5 + fix->day - 1;
+    uint32_t doe = yoe * 365 + yoe/4 - yoe/100 + doy;
+    int32_t days = era * 146097 + (int32_t)doe - 719468;
+    *sec = (uint32_t)days * 86400 + fix->hour * 3600 + fix->min * 60 + fix->sec;
+    return true;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Streaming NMEA 0183 parser
+// Fed one character at a time from the GNSS UART IRQ. Fields are interpreted as soon as
+// their delimiter arrives, only the current field is buffered, nothing is allocated and
+// no character is looked at twice. GGA, RMC and ZDA of any talker (GP, GN, GL, ...) are
+// decoded into a copy of the last fix, which replaces the fix only if the checksum of
+// the sentence matches. No pico-sdk dependency, tools/petnmea runs it over recorded logs.
+
+#define NMEA_FIELD_LEN 16               // longest field kept, longer fields discard the sentence
+
+struct NmeaFix
+{
+    uint8_t hour;                       // UTC time of the fix
+    uint8_t min;
+    uint8_t sec;
+    uint16_t ms;
+    bool time_valid;                    // the last sentence had a time field
+    uint8_t day;                        // UTC date, year 0 if not received yet
+    uint8_t month;
+    uint16_t year;
+    int8_t quality;                     // GGA fix quality, 0 no fix, -1 not received yet
+    int8_t status;                      // RMC status, 1 valid (A), 0 invalid (V), -1 not received yet
+    uint8_t sats;                       // GGA satellites used
+};
+
+struct NmeaParser
+{
+    uint8_t state;
+    uint8_t type;                       // sentence type being parsed
+    uint8_t field;                      // index of the current field, 0 is the address
+    uint8_t sum;                        // XOR of the characters between $ and *
+    uint8_t rx_sum;                     // checksum received after *
+    uint8_t len;
+    char buf[NMEA_FIELD_LEN];           // current field
+    uint8_t zda_day;                    // ZDA date fields until the year completes the date
+    uint8_t zda_month;
+    struct NmeaFix next;                // fix updated by the sentence being parsed
+    struct NmeaFix fix;                 // fix of the last valid sentence
+    volatile uint32_t updates;          // incremented after fix was replaced
+    uint32_t sentences;                 // valid GGA/RMC/ZDA sentences
+    uint32_t errors;                    // checksum mismatches and malformed sentences
+};
+
+void nmea_init(struct NmeaParser* p);
+
+void nmea_feed(struct NmeaParser* p, char c);
+
+bool nmea_read(struct NmeaParser* p, struct NmeaFix* fix);
+
+bool nmea_unix_time(const struct NmeaFix* fix, uint32_t* sec);
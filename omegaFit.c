@@ -0,0 +1,77 @@
+#include <math.h>
+#include "omegaFit.h"
+
+// NOTE: no pico-sdk dependency here, the estimator is checked on the host against synthetic edges (tools/petomega)
+
+
+void omega_start(struct OmegaFit* f, uint64_t t0, uint64_t p0) {
+    f->t0 = t0;
+    f->expected = 0;
+    f->p0 = p0;
+    f->n = 1;                           // r(0) = 0
+    f->sum_r = 0;
+    f->run_r = 0;
+    f->sum_run_lo = 0;
+    f->sum_run_hi = 0;
+}
+
+static inline void add_sum_run(struct OmegaFit* f, int64_t v) {
+    uint64_t lo = f->sum_run_lo + (uint64_t)v;
+    f->sum_run_hi += ((v < 0)? -1: 0) + (lo < f->sum_run_lo);
+    f->sum_run_lo = lo;
+}
+
+static void recenter(struct OmegaFit* f) {
+    // r'(k) = r(k) - k*d for p0' = p0 + d, the sums over k = 0..n-1 change by d times
+    // sum k = n(n-1)/2 and sum k(k+1)/2 = (n-1)n(n+1)/6, all exact in integers
+    double period;
+    if (!omega_period(f, &period)) {
+        return;
+    }
+    int64_t d = llround(period - (double)f->p0);
+    int64_t n = f->n;
+    f->p0 += d;
+    f->expected += d * (n - 1);
+    f->sum_r -= d * (n * (n - 1) / 2);
+    f->run_r -= d * (n * (n - 1) / 2);
+    add_sum_run(f, -d * ((n - 1) * n * (n + 1) / 6));
+}
+
+void omega_add(struct OmegaFit* f, uint64_t t) {
+    f->expected += f->p0;
+    int64_t r = (int64_t)(t - f->t0 - f->expected);
+    f->sum_r += r;
+    f->run_r += r;
+    add_sum_run(f, f->run_r);
+    f->n++;
+    if (f->n == OMEGA_RECENTER) {
+        recenter(f);
+    }
+}
+
+static double sum_run_double(const struct OmegaFit* f) {
+    // converted as magnitude, so a small negative sum does not cancel against 2^64
+    uint64_t lo = f->sum_run_lo;
+    uint64_t hi = (uint64_t)f->sum_run_hi;
+    bool negative = f->sum_run_hi < 0;
+    if (negative) {
+        lo = ~lo + 1;
+        hi = ~hi + (lo == 0);
+    }
+    double v = ldexp((double)hi, 64) + (double)lo;
+    return negative? -v: v;
+}
+
+// slope of the fit in the units of the timestamps, false if less than 3 timestamps
+bool omega_period(const struct OmegaFit* f, double* period) {
+    if (f->n < 3) {
+        return false;
+    }
+    double n = f->n;
+    double sum_k = n * (n - 1) / 2;
+    double sum_run = sum_run_double(f);
+    double sum_kr = n * (double)f->sum_r - sum_run;
+    // n*sum(k^2) - sum(k)^2 = n^2*(n^2-1)/12
+    *period = f->p0 + (n * sum_kr - sum_k * (double)f->sum_r) / (n * n * (n * n - 1) / 12);
+    return true;
+}
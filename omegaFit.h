@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Least-squares (Omega counter) period estimate
+// Fits a line through all edge timestamps t(k) = t(0) + k*period inside a gate instead of
+// using only the first and the last one. With white timestamp noise (the 2 cycle PIO
+// quantization) the resolution improves by sqrt(N/6) against reciprocal counting over the same gate.
+// Per edge only integer additions are done, the residuals r(k) = t(k) - t(0) - k*p0 of
+// the nominal period p0 are summed together with their running sums, so no k*r products
+// are needed. The slope is evaluated once per gate.
+// The residuals drift by k*(period - p0), so after OMEGA_RECENTER timestamps p0 is moved
+// to the nearest integer of the fitted period, and the sum of the running sums, growing
+// with n^3 even then, is kept in 128 bits (two words).
+
+#define OMEGA_RECENTER 256              // timestamps fitted before p0 is re-centered
+
+struct OmegaFit
+{
+    uint64_t t0;                        // timestamp of the edge opening the gate
+    uint64_t expected;                  // k*p0
+    uint64_t p0;                        // nominal period, the first interval of the gate until re-centered
+    uint32_t n;                         // number of timestamps including t0
+    int64_t sum_r;                      // sum of r(k)
+    int64_t run_r;                      // running sum of r(j), j <= k
+    uint64_t sum_run_lo;                // sum of the running sums, sum k*r(k) = n*sum_r - sum_run,
+    int64_t sum_run_hi;                 // 128 bit two's complement
+};
+
+void omega_start(struct OmegaFit* f, uint64_t t0, uint64_t p0);
+
+void omega_add(struct OmegaFit* f, uint64_t t);
+
+bool omega_period(const struct OmegaFit* f, double* period);
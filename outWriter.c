@@ -0,0 +1,86 @@
+#include <string.h>
+#include "outWriter.h"
+
+// NOTE: no pico-sdk dependency here
+
+
+void out_init(struct OutWriter* w, out_send_fn send, out_busy_fn busy, out_clock_fn now) {
+    memset(w, 0, sizeof(*w));
+    w->send = send;
+    w->busy = busy;
+    w->now = now;
+    w->flush_bytes = 1;
+}
+
+void out_set_policy(struct OutWriter* w, uint16_t flush_bytes, uint32_t flush_us) {
+    out_flush(w);
+    w->flush_bytes = (flush_bytes < 1)? 1: (flush_bytes > OUT_HALF_SIZE)? OUT_HALF_SIZE: flush_bytes;
+    w->flush_us = flush_us;
+}
+
+static void wait_idle(struct OutWriter* w) {
+    if (w->busy != NULL && w->busy()) {
+        uint32_t start_us = w->now();
+        w->stats.waits++;
+        while (w->busy()) {
+        }
+        w->stats.blocked_us += w->now() - start_us;
+    }
+}
+
+// sends the first n bytes of the filling half, the rest moves to the other half
+static void send_batch(struct OutWriter* w, uint16_t n) {
+    uint8_t* b = w->buf[w->fill];
+    uint16_t rest = w->len - n;
+    wait_idle(w);                       // the other half is filled next
+    uint32_t start_us = w->now();
+    w->send(b, n);
+    w->stats.blocked_us += w->now() - start_us;
+    w->stats.bytes += n;
+    w->stats.batches++;
+    w->fill ^= 1;
+    memcpy(w->buf[w->fill], b + n, rest);
+    w->len = rest;
+    w->first_us = w->now();
+}
+
+static void check_size(struct OutWriter* w) {
+    if (w->len >= w->flush_bytes) {
+        // whole packets, unless every write is sent on its own
+        uint16_t n = (w->flush_bytes >= OUT_PACKET)? w->len - w->len % OUT_PACKET: w->len;
+        send_batch(w, n);
+    }
+}
+
+void out_write(struct OutWriter* w, const char* data, uint16_t len, bool crlf) {
+    // crlf as the stdio text output: a CR before every LF
+    if (w->len == 0) {
+        w->first_us = w->now();
+    }
+    for (uint16_t k = 0; k < len; k++) {
+        if (w->len >= OUT_HALF_SIZE - 1) {
+            send_batch(w, w->len - w->len % OUT_PACKET);
+        }
+        if (crlf && data[k] == '\n') {
+            w->buf[w->fill][w->len++] = '\r';
+        }
+        w->buf[w->fill][w->len++] = data[k];
+    }
+    check_size(w);
+}
+
+// sends the batch if its oldest byte is due
+void out_poll(struct OutWriter* w) {
+    if (w->len > 0 && w->flush_us > 0 && w->now() - w->first_us >= w->flush_us) {
+        w->stats.deadline_batches++;
+        send_batch(w, w->len);
+    }
+}
+
+// sends everything and waits until it left, other output may follow directly
+void out_flush(struct OutWriter* w) {
+    if (w->len > 0) {
+        send_batch(w, w->len);
+    }
+    wait_idle(w);
+}
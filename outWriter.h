@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Batched output writer
+// The output of core 1 is collected in one half of a double buffer and handed to the link
+// in blocks: whole 64 byte USB CDC packets instead of a small packet per value, or one DMA
+// transfer to the UART while the other half fills. A batch is sent once flush_bytes are
+// buffered (rounded down to whole packets, the rest stays for the next batch), once its
+// oldest byte waited flush_us, or on out_flush() before other output. If the previous
+// batch is still in flight the writer waits for it and accounts the wait; the values
+// queue up on core 0 meanwhile. No pico-sdk dependency, the link is given by callbacks.
+
+#define OUT_HALF_SIZE 2048              // bytes per buffer half, the largest batch
+#define OUT_PACKET 64                   // USB CDC full speed packet
+
+typedef void (*out_send_fn)(const uint8_t* buf, uint16_t len);     // starts sending, may return before it is done
+typedef bool (*out_busy_fn)();                                      // the last send is still in flight, NULL if send blocks
+typedef uint32_t (*out_clock_fn)();                                 // microseconds
+
+struct OutStats
+{
+    uint32_t bytes;                     // bytes sent
+    uint32_t batches;                   // sends
+    uint32_t deadline_batches;          // sends by flush_us
+    uint32_t waits;                     // batches ready while the previous one was in flight
+    uint32_t blocked_us;                // time spent in the sends and waits
+};
+
+struct OutWriter
+{
+    uint8_t buf[2][OUT_HALF_SIZE];
+    uint8_t fill;                       // half being filled
+    uint16_t len;                       // bytes in the filling half
+    uint32_t first_us;                  // time of the oldest byte in the filling half
+    uint16_t flush_bytes;               // send when this many bytes are buffered, 1 sends every write
+    uint32_t flush_us;                  // send when the oldest byte waited this long, 0 only by size
+    out_send_fn send;
+    out_busy_fn busy;
+    out_clock_fn now;
+    struct OutStats stats;
+};
+
+void out_init(struct OutWriter* w, out_send_fn send, out_busy_fn busy, out_clock_fn now);
+
+void out_set_policy(struct OutWriter* w, uint16_t flush_bytes, uint32_t flush_us);
+
+void out_write(struct OutWriter* w, const char* data, uint16_t len, bool crlf);
+
+void out_poll(struct OutWriter* w);
+
+void out_flush(struct OutWriter* w);
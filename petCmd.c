@@ -0,0 +1,277 @@
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include "petCmd.h"
+#include "burst.h"
+
+// NOTE: no pico-sdk dependency here, the parser is exercised on the host as well
+
+static const char* format_names[] = {"TEXT", "BIN", "RAW"};            // in PET_FORMAT_... order
+static const char* capture_names[] = {"PERIOD", "TS", "HR", "EDGE"};     // in PET_CAPTURE_... order
+static const char* channel_names[] = {"A", "B", "C", "D"};
+static const char* onoff_names[] = {"OFF", "ON"};
+static const char* hist_names[] = {"PERIOD", "TIE"};                     // in PET_HIST_... order
+static const char* burst_names[] = {"STATUS", "ARM", "FIRE", "DUMP", "OFF"};    // in CMD_BURST_... order
+static const char* trig_names[] = {"CMD", "GPIO", "ABOVE", "BELOW"};     // in BURST_TRIG_... order
+static const char* burst_state_names[] = {"OFF", "ARMED", "TRIGGERED", "DONE"};    // in BURST_... order
+
+
+void cmd_init(struct CmdParser* p) {
+    p->len = 0;
+    p->overflow = false;
+    p->error = NULL;
+    p->use_default = false;
+    p->burst = CMD_BURST_STATUS;
+}
+
+static uint16_t error(struct CmdParser* p, const char* msg) {
+    p->error = msg;
+    return CMD_ERROR;
+}
+
+static int8_t lookup(const char* s, const char* const* names, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        if (strcmp(s, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int8_t lookup_mode(const char* s) {
+    // the mode names are the ones of the output header, measure_mode_name()
+    for (uint8_t i = 0; i < PET_MODES; i++) {
+        if (strcmp(s, measure_mode_name(i)) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static bool parse_uint(const char* s, uint32_t min, uint32_t max, uint32_t* v) {
+    if (s == NULL || *s == '\0') {
+        return false;
+    }
+    char* end;
+    unsigned long n = strtoul(s, &end, 10);
+    if (*end != '\0' || n < min || n > max) {
+        return false;
+    }
+    *v = n;
+    return true;
+}
+
+// parses one upper-cased line; cfg is modified only if the command is valid
+uint16_t cmd_parse(struct CmdParser* p, char* line, struct PetConfig* cfg) {
+    char* name = strtok(line, " \t");
+    char* arg = strtok(NULL, " \t");
+    uint32_t v;
+    if (name == NULL) {
+        return CMD_NONE;
+    }
+    if (strcmp(name, "MODE") == 0) {
+        int8_t mode = (arg == NULL)? -1: lookup_mode(arg);
+        if (mode < 0) {
+            return error(p, "MODE TIMEMARK|FREQ|COUNT|STAB|OMEGA|TIC|HIST|WIDTH|DUTY");
+        }
+        cfg->mode = mode;
+        return CMD_CHANGED;
+    } else if (strcmp(name, "FORMAT") == 0) {
+        int8_t format = (arg == NULL)? -1: lookup(arg, format_names, 3);
+        if (format < 0) {
+            return error(p, "FORMAT TEXT|BIN|RAW");
+        }
+        cfg->format = format;
+        return CMD_CHANGED;
+    } else if (strcmp(name, "AVG") == 0) {
+        if (!parse_uint(arg, 1, PET_MAX_AVG_PERIODS, &v)) {
+            return error(p, "AVG 1..10000");
+        }
+        cfg->avg_periods = v;
+        return CMD_RELOAD;
+    } else if (strcmp(name, "CH") == 0) {
+        if (!parse_uint(arg, 1, PET_MAX_CHANNELS, &v)) {
+            return error(p, "CH 1..4");
+        }
+        cfg->channels = v;
+        return CMD_RELOAD;
+    } else if (strcmp(name, "GATE") == 0) {
+        if (!parse_uint(arg, 0, PET_MAX_GATE_MS, &v)) {
+            return error(p, "GATE 0..60000");
+        }
+        cfg->gate_ms = v;
+        return CMD_CHANGED;
+    } else if (strcmp(name, "CAPTURE") == 0) {
+        int8_t capture = (arg == NULL)? -1: lookup(arg, capture_names, PET_CAPTURES);
+        if (capture < 0) {
+            return error(p, "CAPTURE PERIOD|TS|HR|EDGE");
+        }
+        cfg->capture = capture;
+        return CMD_RELOAD;
+    } else if (strcmp(name, "REF") == 0) {
+        int8_t ref = (arg == NULL)? -1: lookup(arg, channel_names, PET_MAX_CHANNELS);
+        if (ref < 0) {
+            return error(p, "REF A|B|C|D");
+        }
+        cfg->tic_ref = ref;
+        return CMD_CHANGED;
+    } else if (strcmp(name, "UTC") == 0) {
+        int8_t utc = (arg == NULL)? -1: lookup(arg, onoff_names, 2);
+        if (utc < 0) {
+            return error(p, "UTC ON|OFF");
+        }
+        cfg->utc = utc;
+        return CMD_CHANGED;
+    } else if (strcmp(name, "HIST") == 0) {
+        int8_t value = (arg == NULL)? -1: lookup(arg, hist_names, 2);
+        if (value < 0) {
+            return error(p, "HIST PERIOD|TIE");
+        }
+        cfg->hist_value = value;
+        return CMD_CHANGED;
+    } else if (strcmp(name, "BINW") == 0) {
+        if (!parse_uint(arg, 1, UINT16_MAX, &v)) {
+            return error(p, "BINW 1..65535");
+        }
+        cfg->hist_width = v;
+        return CMD_CHANGED;
+    } else if (strcmp(name, "DIV") == 0) {
+        if (arg != NULL && strcmp(arg, "SW") == 0) {
+            v = 0;
+        } else if (!parse_uint(arg, 1, CMD_MAX_DIV_FREQ, &v)) {
+            return error(p, "DIV 1..12000000|SW");
+        }
+        cfg->div_freq = v;
+        return CMD_CHANGED;
+    } else if (strcmp(name, "BURST") == 0) {
+        int8_t action = (arg == NULL)? CMD_BURST_STATUS: lookup(arg, burst_names, 5);
+        if (action < 0) {
+            char* pre = strtok(NULL, " \t");
+            if (!parse_uint(arg, 1, UINT16_MAX, &v)) {
+                return error(p, "BURST [ARM|FIRE|DUMP|OFF] or BURST 1..65535 [0..65535]");
+            }
+            cfg->burst_post = v;
+            if (pre != NULL && !parse_uint(pre, 0, UINT16_MAX, &v)) {
+                return error(p, "BURST 1..65535 [0..65535]");
+            }
+            cfg->burst_pre = (pre != NULL)? v: cfg->burst_pre;
+            action = CMD_BURST_STATUS;
+        }
+        p->burst = action;
+        return CMD_BURST;
+    } else if (strcmp(name, "TRIG") == 0) {
+        int8_t trig = (arg == NULL)? -1: lookup(arg, trig_names, 4);
+        if (trig < 0) {
+            return error(p, "TRIG CMD|GPIO|ABOVE <cycles>|BELOW <cycles>");
+        }
+        if (trig >= BURST_TRIG_ABOVE && !parse_uint(strtok(NULL, " \t"), 1, UINT32_MAX, &v)) {
+            return error(p, "TRIG ABOVE|BELOW 1..4294967295");
+        }
+        cfg->burst_trig = trig;
+        cfg->burst_cycles = (trig >= BURST_TRIG_ABOVE)? v: 0;
+        p->burst = CMD_BURST_STATUS;
+        return CMD_BURST;
+    } else if (strcmp(name, "CONFIG") == 0) {
+        return CMD_QUERY;
+    } else if (strcmp(name, "PIO") == 0) {
+        return CMD_QUERY_PIO;
+    } else if (strcmp(name, "STAB") == 0) {
+        return CMD_QUERY_STAB;
+    } else if (strcmp(name, "STATUS") == 0) {
+        return CMD_QUERY_STATUS;
+    } else if (strcmp(name, "CAL") == 0) {
+        if (arg != NULL && strcmp(arg, "DEFAULT") != 0) {
+            return error(p, "CAL [DEFAULT]");
+        }
+        p->use_default = arg != NULL;
+        return CMD_CALIBRATE;
+    } else if (strcmp(name, "BENCH") == 0) {
+        return CMD_BENCH;
+    } else if (strcmp(name, "SAVE") == 0) {
+        if (arg != NULL && strcmp(arg, "DEFAULT") != 0) {
+            return error(p, "SAVE [DEFAULT]");
+        }
+        p->use_default = arg != NULL;
+        return CMD_SAVE | CMD_QUERY;
+    }
+    return error(p, "unknown command");
+}
+
+// the rule a configuration with valid fields breaks, NULL if none: only the timestamps of one shared
+// counter give the phase between the channels, only picopet_de counts the high time, the reference
+// channel of TIC and of the UTC anchor has to be counted, TIC needs a stop channel besides it, the
+// binary event frames carry every sample, so they cannot report per gate
+static const char* combination_error(const struct PetConfig* cfg) {
+    if (cfg->tic_ref >= cfg->channels) {
+        return "REF needs one of the CH active channels";
+    } else if (cfg->mode == PET_MODE_TIC && cfg->channels < 2) {
+        return "MODE TIC needs CH 2..4";
+    } else if (cfg->mode == PET_MODE_TIC && cfg->capture != PET_CAPTURE_TIMESTAMP) {
+        return "MODE TIC needs CAPTURE TS";
+    } else if ((cfg->mode == PET_MODE_WIDTH || cfg->mode == PET_MODE_DUTY) && cfg->capture != PET_CAPTURE_EDGES) {
+        return "MODE WIDTH|DUTY needs CAPTURE EDGE";
+    } else if (cfg->mode == PET_MODE_FREQUENCY && cfg->format == PET_FORMAT_BINARY && cfg->gate_ms > 0) {
+        return "GATE needs FORMAT TEXT in MODE FREQ";
+    }
+    return NULL;
+}
+
+uint16_t cmd_feed(struct CmdParser* p, char c, struct PetConfig* cfg) {
+    if (c == '\r' || c == '\n') {
+        uint16_t res = CMD_NONE;
+        p->line[p->len] = '\0';
+        if (p->overflow) {
+            res = error(p, "line too long");
+        } else if (p->len > 0) {
+            // work on a copy, so an invalid command leaves the configuration untouched
+            struct PetConfig tmp = *cfg;
+            res = cmd_parse(p, p->line, &tmp);
+            if ((res & CMD_ERROR) == 0 && !cmd_config_valid(&tmp)) {
+                // the commands check their own ranges, what is left is the combination
+                res = error(p, combination_error(&tmp));
+            }
+            if ((res & CMD_ERROR) == 0) {
+                *cfg = tmp;
+            }
+        }
+        p->len = 0;
+        p->overflow = false;
+        return res;
+    }
+    if (p->len < CMD_LINE_LEN - 1) {
+        p->line[p->len++] = toupper((unsigned char)c);
+    } else {
+        p->overflow = true;
+    }
+    return CMD_NONE;
+}
+
+uint8_t cmd_format_config(char* buf, uint8_t len, const struct PetConfig* cfg) {
+    char div[12] = "SW";
+    if (cfg->div_freq > 0) {
+        snprintf(div, sizeof(div), "%lu", (unsigned long)cfg->div_freq);
+    }
+    return snprintf(buf, len, "CONFIG MODE=%s FORMAT=%s AVG=%u GATE=%u CH=%u CAPTURE=%s REF=%s UTC=%s DIV=%s HIST=%s BINW=%u\n", measure_mode_name(cfg->mode),
+        format_names[(cfg->format < 3)? cfg->format: 0], cfg->avg_periods, cfg->gate_ms, cfg->channels, capture_names[(cfg->capture < PET_CAPTURES)? cfg->capture: 0],
+        channel_names[cfg->tic_ref & 3], onoff_names[cfg->utc & 1], div, hist_names[cfg->hist_value & 1], cfg->hist_width);
+}
+
+// state of the burst capture and its settings, max_words is the longest PRE + POST of the channels
+uint8_t cmd_format_burst(char* buf, uint8_t len, const struct PetConfig* cfg, uint8_t state, uint32_t max_words) {
+    char trig[20] = "";
+    if (cfg->burst_trig >= BURST_TRIG_ABOVE) {
+        snprintf(trig, sizeof(trig), " %lu", (unsigned long)cfg->burst_cycles);
+    }
+    return snprintf(buf, len, "BURST STATE=%s POST=%u PRE=%u TRIG=%s%s MAX=%lu\n", burst_state_names[state & 3], cfg->burst_post,
+        cfg->burst_pre, trig_names[cfg->burst_trig & 3], trig, (unsigned long)max_words);
+}
+
+// the ranges of the commands, e.g. for a configuration read back from flash
+bool cmd_config_valid(const struct PetConfig* cfg) {
+    return cfg->mode < PET_MODES && cfg->format < 3 && cfg->channels >= 1 && cfg->channels <= PET_MAX_CHANNELS && cfg->capture < PET_CAPTURES
+        && cfg->avg_periods >= 1 && cfg->avg_periods <= PET_MAX_AVG_PERIODS && cfg->gate_ms <= PET_MAX_GATE_MS
+        && cfg->tic_ref < PET_MAX_CHANNELS && cfg->utc < 2 && cfg->div_freq <= CMD_MAX_DIV_FREQ
+        && cfg->hist_width >= 1 && cfg->hist_value < 2 && cfg->burst_post >= 1 && cfg->burst_trig < 4
+        && combination_error(cfg) == NULL;
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h>
+#include "measure.h"
+
+// Command interface on the stdio/USB link
+// Line based, case insensitive, e.g.
+//   MODE TIMEMARK|FREQ|COUNT|STAB|OMEGA|TIC|HIST|WIDTH|DUTY  output type, TIC needs CAPTURE TS and CH 2..4, WIDTH and DUTY CAPTURE EDGE
+//   FORMAT TEXT|BIN|RAW          text lines, framed binary stream or framed uncorrected values
+//   AVG <n>                      number of periods averaged by the counting SM
+//   GATE <ms>                    one frequency (FREQ, OMEGA) or histogram (HIST) per gate time, 0 for one per sample,
+//                                FREQ with a gate needs FORMAT TEXT
+//   CH <n>                       number of active input channels
+//   CAPTURE PERIOD|TS|HR|EDGE    cycles counted per period, free-running timestamps, interleaved periods or high and low times
+//   REF A|B|C|D                  start channel of the TIC intervals, GNSS PPS channel of UTC, one of the CH active
+//   UTC ON|OFF                   TIMEMARK in UTC seconds once anchored to the GNSS time
+//   HIST PERIOD|TIE              histogram of the sample intervals or of their time interval error
+//   BINW <cycles>                histogram bin width in clk_sys cycles
+//   DIV <Hz>|SW                  frequency of the divided reference output, SW for the DIP switches
+//   CONFIG                       print the current configuration
+//   PIO                          print the PIO blocks usage and state machines of the channels
+//   STAB                         print the ADEV/MDEV/TDEV summary of the stability run now
+//   STATUS                       print the health counters
+//   CAL [DEFAULT]                run the self-calibration and store it, or return to the constants
+//   BENCH                        output rate of the modes and formats, unbatched and batched
+//   SAVE [DEFAULT]               store the configuration as the power up one, or return to the defaults
+//   BURST [ARM|FIRE|DUMP|OFF]    burst capture state, arm it, trigger it, print the captured values or stop it
+//   BURST <post> [<pre>]         values per counting SM captured from the trigger on and kept before it
+//   TRIG CMD|GPIO|ABOVE <cycles>|BELOW <cycles>  burst trigger, BURST FIRE, GPIO edge or an interval threshold
+// cmd_feed() collects characters and parses a complete line into a copy of the configuration.
+
+#define CMD_LINE_LEN 48
+#define CMD_MAX_DIV_FREQ 12000000       // XOSC_MHZ, the divided output at the reference frequency
+
+#define CMD_NONE 0x00                   // line not complete yet
+#define CMD_CHANGED 0x01                // configuration changed, new processing routine
+#define CMD_RELOAD 0x02                 // configuration changed, PIO programs have to be reloaded
+#define CMD_QUERY 0x04                  // print the configuration
+#define CMD_QUERY_PIO 0x08              // print the PIO layout
+#define CMD_QUERY_STAB 0x10             // print the stability summary
+#define CMD_QUERY_STATUS 0x20           // print the health counters
+#define CMD_CALIBRATE 0x40              // run the self-calibration, or return to the constants if use_default
+#define CMD_ERROR 0x80
+#define CMD_SAVE 0x100                  // store the configuration, or erase the stored one if use_default
+#define CMD_BENCH 0x200                 // run the output benchmark
+#define CMD_BURST 0x400                 // burst settings changed or burst action of the parser
+
+#define CMD_BURST_STATUS 0              // burst actions
+#define CMD_BURST_ARM 1
+#define CMD_BURST_FIRE 2
+#define CMD_BURST_DUMP 3
+#define CMD_BURST_OFF 4
+
+struct CmdParser
+{
+    char line[CMD_LINE_LEN];
+    uint8_t len;
+    bool overflow;
+    const char* error;                  // reason of the last CMD_ERROR
+    bool use_default;                   // CAL DEFAULT, SAVE DEFAULT
+    uint8_t burst;                      // CMD_BURST_... action of CMD_BURST
+};
+
+void cmd_init(struct CmdParser* p);
+
+uint16_t cmd_feed(struct CmdParser* p, char c, struct PetConfig* cfg);
+
+uint16_t cmd_parse(struct CmdParser* p, char* line, struct PetConfig* cfg);
+
+uint8_t cmd_format_config(char* buf, uint8_t len, const struct PetConfig* cfg);
+
+uint8_t cmd_format_burst(char* buf, uint8_t len, const struct PetConfig* cfg, uint8_t state, uint32_t max_words);
+
+bool cmd_config_valid(const struct PetConfig* cfg);
@@ -1,6 +1,7 @@
 /*
     PicoPET is a simple time interval counter that outputs number of clk_sys cycles 
-    between two pulses and outputs to USB/serial port. It has a resolution of 2 system clock cycles.
+    between two pulses and outputs to USB/serial port. It has a resolution of 2 system clock cycles,
+    1 cycle with phase interleaved capture (CAPTURE HR) using two state machines per channel.
 
     USB and UART output is available but USB works only if clk_sys is above 48 MHz. 
     If below only serial output is working. You may change the output in CMakeLists.txt file.
@@ -37,6 +38,9 @@
 #include "pico/divider.h"
 #include "pico/int64_ops.h"
 #include "pico/multicore.h"
+#if LIB_PICO_STDIO_USB
+#include "pico/stdio_usb.h"
+#endif
 #include "hardware/timer.h"
 #include "hardware/clocks.h"
 #include "hardware/pio.h"
@@ -44,25 +48,118 @@
 #include "hardware/xosc.h"
 #include "hardware/vreg.h"
 #include "hardware/irq.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
 #include "hardware/uart.h"
 #include "picoPET_sp.pio.h"
 #include "picoPET_mp.pio.h"
+#include "picoPET_ts.pio.h"
+#include "picoPET_hr.pio.h"
+#include "picoPET_de.pio.h"
 #include "indicator_led.pio.h"
 #include "extClk.h"
 #include "counter.h"
+#include "capture.h"
+#include "measure.h"
+#include "petCmd.h"
+#include "pioAlloc.h"
+#include "spscQueue.h"
+#include "health.h"
+#include "nmea.h"
+#include "selfCal.h"
+#include "configStore.h"
+#include "outWriter.h"
+#include "burst.h"
 
 // CORE 1 - initialization and monitoring
 
 uint xosc_mhz = XOSC_MHZ;
 uint32_t clk_src_freq = XOSC_MHZ * MHZ;
 uint div_freq = 1;
-struct PetInput inputs[SM_COUNT];
+struct PetInput inputs[PET_MAX_CHANNELS];
+struct PetConfig config = {
+    #if defined OUTPUT_WIDTH
+        .mode = PET_MODE_WIDTH,
+    #elif defined OUTPUT_DUTY
+        .mode = PET_MODE_DUTY,
+    #elif defined OUTPUT_HISTOGRAM
+        .mode = PET_MODE_HIST,
+    #elif defined OUTPUT_TIC
+        .mode = PET_MODE_TIC,
+    #elif defined OUTPUT_STABILITY
+        .mode = PET_MODE_STABILITY,
+    #elif defined OUTPUT_OMEGA
+        .mode = PET_MODE_OMEGA,
+    #elif defined OUTPUT_CYCLE_COUNT
+        .mode = PET_MODE_CYCLE_COUNT,
+    #elif defined OUTPUT_FREQUENCY
+        .mode = PET_MODE_FREQUENCY,
+    #else
+        .mode = PET_MODE_TIMEMARK,
+    #endif
+    #if defined OUTPUT_BINARY
+        .format = PET_FORMAT_BINARY,
+    #else
+        .format = PET_FORMAT_TEXT,
+    #endif
+    .channels = SM_COUNT,
+    #if defined CAPTURE_TIMESTAMP
+        .capture = PET_CAPTURE_TIMESTAMP,
+    #elif defined CAPTURE_INTERLEAVED
+        .capture = PET_CAPTURE_INTERLEAVED,
+    #elif defined CAPTURE_EDGES
+        .capture = PET_CAPTURE_EDGES,
+    #else
+        .capture = PET_CAPTURE_PERIOD,
+    #endif
+    .avg_periods = AVG_PERIODS,
+    .gate_ms = GATE_MS,
+    .tic_ref = TIC_REF_CHANNEL,
+    #if defined TIMEMARK_UTC
+        .utc = 1,
+    #endif
+    .div_freq = DIV_FREQ,
+    .hist_width = HIST_WIDTH,
+    #if defined HIST_TIE
+        .hist_value = PET_HIST_TIE,
+    #endif
+    .burst_pre = BURST_PRE,
+    .burst_post = BURST_POST,
+    .burst_trig = BURST_TRIG_CMD,
+};
+extern struct PetMeasure measure;
+extern struct SpscQueue records;
+extern struct HealthCore0 health0;
+extern struct HealthCore1 health1;
+extern struct OutWriter output;
 
-static int uart_gnss_rxstate = 0;
 static int gnss_state = -1;        // -1 - unknown, 0 - not fixed, 1 - GNSS FIX
+static struct NmeaParser nmea;          // fed by the UART IRQ on core 1
+static uint32_t nmea_updates = 0;       // nmea.updates seen by check_gnss
 static int ext_clk_state = 0;     // -1 - not connected, 0 - connected, 1 - connected and used
 static bool indleds_state = false;       // 0 - LOW, 1 - HIGH (used for blinking with timer)
-static char uart_buff[8];
+static int clk_ext_verify = 0;
+static volatile uint32_t monitor_ticks = 0;     // incremented by timer on core 1
+static uint32_t monitor_ticks_done = 0;
+static uint8_t pio_channels = 0;                // channels loaded in PIOs
+static struct CmdParser cmd_parser;
+static struct PetCal cal_table;                 // self-calibration, used when measure.cal points to it
+static struct StoreBlock store;                 // RAM copy of the flash block, updated by SAVE and CAL
+static bool usb_connected = false;
+
+enum { PROG_SP, PROG_MP, PROG_TS, PROG_HR, PROG_DE, PROG_LED, PROG_COUNT };
+static const pio_program_t* pio_programs[PROG_COUNT] = {&picopet_sp_program, &picopet_mp_program, &picopet_ts_program, &picopet_hr_program,
+    &picopet_de_program,
+    &indicator_led_program};
+static uint pio_offsets[PIO_BLOCKS][PROG_COUNT];
+static struct PioPlan pio_layout;
+
+struct MonitorTask
+{
+    uint16_t period;
+    uint16_t elapsed;
+    void (*run)();
+};
 
 
 void pins_init() {
@@ -91,6 +188,10 @@ void pins_init() {
     gpio_init(INPUT_SIGNALD_LEDGPIO);
     gpio_set_dir(INPUT_SIGNALD_LEDGPIO, GPIO_OUT);
 
+    gpio_init(BURST_TRIGGER_GPIO);
+    gpio_set_dir(BURST_TRIGGER_GPIO, GPIO_IN);
+    gpio_pull_down(BURST_TRIGGER_GPIO);
+
     uint8_t swio[] = {SW1_GPIO, SW2_GPIO, SW3_GPIO, SW4_GPIO};
     for (uint8_t i=1; i < 4; i++) {
         gpio_init(swio[i]);
@@ -102,12 +203,15 @@ void pins_init() {
     gpio_set_function(GNSS_RXGPIO, GPIO_FUNC_UART);
 }
 
+static uint8_t div_switches;             // DIP switch setting read last by xosc_div_setting()
+
 uint xosc_div_setting() {
+    // no output here, at power up the switches are read before stdio is initialised
     uint8_t s1 = gpio_get(SW2_GPIO);
     uint8_t s2 = gpio_get(SW3_GPIO);
     uint8_t s3 = gpio_get(SW4_GPIO);
     uint8_t s = s1 + (s2 << 1) + (s3 << 2);
-    printf("Switch Setting %d (%d%d%d) \n", s, s1, s2, s3);
+    div_switches = s;
     switch (s) {
         case DIVF_XOSC:
             return XOSC_MHZ;
@@ -130,15 +234,30 @@ uint xosc_div_setting() {
     }
 }
 
-void configure_clocks(uint div_freq) {
-    uint xosc_divider = xosc_mhz*MHZ/div_freq;
+void print_div_setting(bool switches) {
+    if (switches) {
+        printf("Switch Setting %d (%d%d%d) \n", div_switches, div_switches & 1, (div_switches >> 1) & 1, (div_switches >> 2) & 1);
+    }
+    printf("Div Freq %d\n", div_freq);
+}
+
+void divclk_init(uint div_freq) {
+    // reference divided by the DIV or DIP switch setting on DIVCLK_GPIO
+    uint xosc_divider = (div_freq < xosc_mhz*MHZ)? xosc_mhz*MHZ/div_freq: 1;
+    #if defined CLK_SRC_EXT_CLOCK
+        clock_gpio_init(DIVCLK_GPIO, CLOCKS_CLK_GPOUT1_CTRL_AUXSRC_VALUE_CLKSRC_GPIN0, xosc_divider);
+    #else
+        clock_gpio_init(DIVCLK_GPIO, CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, xosc_divider);
+    #endif
+}
 
+void configure_clocks(uint div_freq) {
     #if defined CLK_SRC_XOSC
         xosc_init();
         clk_src_freq = XOSC_MHZ*MHZ;  // 12MHz is the internal XOSC
         clock_configure(clk_ref, CLOCKS_CLK_REF_CTRL_SRC_VALUE_XOSC_CLKSRC, 0, clk_src_freq, clk_src_freq);
         clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF, CLOCKS_CLK_SYS_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, clk_src_freq, clk_src_freq);
-        clock_gpio_init(DIVCLK_GPIO, CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, xosc_divider);
+        divclk_init(div_freq);
         clock_configure(clk_adc, 0, CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_CLKSRC_GPIN0, XOSC_MHZ*MHZ, XOSC_MHZ*MHZ);
         pll_deinit(pll_sys);
     #elif defined CLK_SRC_EXT_CLOCK
@@ -147,27 +266,42 @@ void configure_clocks(uint div_freq) {
         clock_configure_gpin(clk_sys, CLKREF_GNSS_GPIO, clk_src_freq, clk_src_freq);
         clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLKSRC_GPIN0, clk_src_freq, clk_src_freq);
         clock_configure(clk_adc, 0, CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_CLKSRC_GPIN0, XOSC_MHZ*MHZ, XOSC_MHZ*MHZ);
-        clock_gpio_init(DIVCLK_GPIO, CLOCKS_CLK_GPOUT1_CTRL_AUXSRC_VALUE_CLKSRC_GPIN0, xosc_divider);
+        divclk_init(div_freq);
         xosc_disable();
         pll_deinit(pll_sys);
     #else
         xosc_init();
         clk_src_freq = SYS_PLL_FREQ;
         set_sys_clock_khz(SYS_PLL_FREQ/1000, true);
-        clock_gpio_init(DIVCLK_GPIO, CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_XOSC_CLKSRC, xosc_divider);
+        divclk_init(div_freq);
         clock_configure_gpin(clk_adc, CLKREF_GNSS_GPIO, XOSC_MHZ*MHZ, XOSC_MHZ*MHZ);
 //        clock_configure(clk_adc, 0, CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_CLKSRC_GPIN0, XOSC_MHZ*MHZ, XOSC_MHZ*MHZ);
     #endif
 }
 
-void countpet_forever(PIO pio, uint sm, uint offset, uint pin) {
-    #if AVG_PERIODS == 1
+void countpet_forever(const struct PetConfig* cfg, PIO pio, uint sm, uint offset, uint pin) {
+    if (cfg->capture == PET_CAPTURE_TIMESTAMP) {
+        // enabled by configure_pios() together with the other channels
+        picopet_ts_program_init(pio, sm, offset, pin);
+        return;
+    }
+    if (cfg->capture == PET_CAPTURE_EDGES) {
+        picopet_de_program_init(pio, sm, offset, pin);
+    } else if (cfg->avg_periods == 1) {
         picopet_sp_program_init(pio, sm, offset, pin);
-    #else
+    } else {
         picopet_mp_program_init(pio, sm, offset, pin);
-    #endif
+    }
     pio_sm_set_enabled(pio, sm, true);
-    pio->txf[sm] = AVG_PERIODS-1; 
+    pio->txf[sm] = cfg->avg_periods-1; 
+}
+
+void countpet_interleaved(const struct PetConfig* cfg, PIO pio, uint sm0, uint sm1, uint offset, uint pin) {
+    // enabled by configure_pios() in sync, so both see the first edge in the same cycle
+    picopet_hr_program_init(pio, sm0, offset, pin, 0);
+    picopet_hr_program_init(pio, sm1, offset, pin, 1);
+    pio->txf[sm0] = cfg->avg_periods-1;
+    pio->txf[sm1] = cfg->avg_periods-1;
 }
 
 void led_indicate_forever(PIO pio, uint sm, uint offset, uint pin, uint led_pin) {
@@ -176,72 +310,162 @@ void led_indicate_forever(PIO pio, uint sm, uint offset, uint pin, uint led_pin)
     pio->txf[sm] = clk_src_freq/20;         // max led blinking frequency will be 10 Hz
 }
 
-void configure_pios() {
-    uint off[2];
-    uint lind[2];
-    #if AVG_PERIODS == 1
-        for (uint8_t i = 0; i < SM_COUNT; i++) {
-            inputs[i].pio = (i % 2 == 0)? pio0: pio1;
-            off[i%2] = pio_add_program(inputs[i].pio, &picopet_sp_program);
-            lind[i%2] = pio_add_program(inputs[i].pio, &indicator_led_program);
+uint8_t counting_program(const struct PetConfig* cfg) {
+    if (cfg->capture == PET_CAPTURE_TIMESTAMP) {
+        return PROG_TS;             // averaging is done on core 1
+    } else if (cfg->capture == PET_CAPTURE_INTERLEAVED) {
+        return PROG_HR;
+    } else if (cfg->capture == PET_CAPTURE_EDGES) {
+        return PROG_DE;             // averaging is done on core 1
+    }
+    return (cfg->avg_periods == 1)? PROG_SP: PROG_MP;
+}
+
+bool plan_pios(const struct PetConfig* cfg, struct PioPlan* plan) {
+    uint8_t prog_len[PROG_COUNT];
+    for (uint8_t p = 0; p < PROG_COUNT; p++) {
+        prog_len[p] = pio_programs[p]->length;
+    }
+    // timestamp state machines share one counter, they have to be started in sync in one PIO block
+    // interleaved capture uses two state machines per channel, the allocator keeps them in one block
+    uint8_t sms = (cfg->capture == PET_CAPTURE_INTERLEAVED)? 2: 1;
+    return pio_plan_layout(plan, cfg->channels, counting_program(cfg), sms, cfg->capture == PET_CAPTURE_TIMESTAMP, PROG_LED, prog_len);
+}
+
+void configure_pios(const struct PetConfig* cfg, bool loopback) {
+    // the plan was checked by plan_pios() before, each program is loaded once per PIO block
+    // with loopback the counting state machines read DIVCLK_GPIO instead of their input
+    PIO blocks[PIO_BLOCKS] = {pio0, pio1};
+    uint8_t prog = counting_program(cfg);
+    uint32_t sync_mask[PIO_BLOCKS] = {0, 0};
+    plan_pios(cfg, &pio_layout);
+    for (uint8_t b = 0; b < PIO_BLOCKS; b++) {
+        for (uint8_t p = 0; p < PROG_COUNT; p++) {
+            if ((pio_layout.loaded[b] >> p) & 1) {
+                pio_offsets[b][p] = pio_add_program(blocks[b], pio_programs[p]);
+            }
         }
-    #else
-        for (uint8_t i = 0; i < SM_COUNT; i++) {
-            inputs[i].pio = (i % 2 == 0)? pio0: pio1;
-            off[i%2] = pio_add_program(inputs[i].pio, &picopet_mp_program);
-            lind[i%2] = pio_add_program(inputs[i].pio, &indicator_led_program);
+    }
+    for (uint8_t i = 0; i < cfg->channels; i++) {
+        struct PioChannelPlan* ch = &pio_layout.ch[i];
+        uint pin = loopback? DIVCLK_GPIO: inputs[i].input_gpio;
+        inputs[i].pio = blocks[ch->pio];
+        inputs[i].smc = ch->sm[0];
+        inputs[i].smp = ch->sm[1];
+        pio_sm_claim(inputs[i].pio, inputs[i].smc);
+        sync_mask[ch->pio] |= 1u << inputs[i].smc;
+        if (inputs[i].smp != PIO_NO_SM) {
+            pio_sm_claim(inputs[i].pio, inputs[i].smp);
+            countpet_interleaved(cfg, inputs[i].pio, inputs[i].smc, inputs[i].smp, pio_offsets[ch->pio][prog], pin);
+            sync_mask[ch->pio] |= 1u << inputs[i].smp;
+        } else {
+            countpet_forever(cfg, inputs[i].pio, inputs[i].smc, pio_offsets[ch->pio][prog], pin);
+        }
+        inputs[i].led_pio = blocks[ch->led_pio];
+        inputs[i].smi = ch->led_sm;
+        if (inputs[i].smi != PIO_NO_SM) {
+            pio_sm_claim(inputs[i].led_pio, inputs[i].smi);
+            led_indicate_forever(inputs[i].led_pio, inputs[i].smi, pio_offsets[ch->led_pio][PROG_LED], inputs[i].input_gpio, inputs[i].led_gpio);
         }
-    #endif
-    for (uint8_t i = 0; i < SM_COUNT; i++) {
-        inputs[i].smc = ((2*i) / 2) - (i%2);
-        inputs[i].smi = ((2*i) / 2) - (i%2) + 1;
-        countpet_forever(inputs[i].pio, inputs[i].smc, off[i%2], inputs[i].input_gpio);
-        led_indicate_forever(inputs[i].pio, inputs[i].smi, lind[i%2], inputs[i].input_gpio, inputs[i].led_gpio);
     }
+    if (cfg->capture == PET_CAPTURE_TIMESTAMP) {
+        // same X in all state machines from the same clk_sys cycle
+        pio_enable_sm_mask_in_sync(pio0, sync_mask[0]);
+    } else if (cfg->capture == PET_CAPTURE_INTERLEAVED) {
+        // both phases of a channel in the same clk_sys cycle
+        for (uint8_t b = 0; b < PIO_BLOCKS; b++) {
+            pio_enable_sm_mask_in_sync(blocks[b], sync_mask[b]);
+        }
+    }
+    pio_channels = cfg->channels;
 }
 
-void on_uart_rx() {
-    while (uart_is_readable(uart0)) {
-        char ch = uart_getc(uart0);
-//        printf("%c", ch);
-        switch (uart_gnss_rxstate) {
-            case 0:            
-                    uart_gnss_rxstate = (ch =='$') ? 1: 0;
-                    break;
-            case 1 ... 5:
-                    uart_buff[uart_gnss_rxstate-1] = ch;
-                    uart_buff[uart_gnss_rxstate] = '\0';
-                    uart_gnss_rxstate++;
-                    break;
-            case 10 ... 15:
-                    uart_gnss_rxstate = (ch ==',') ? uart_gnss_rxstate+1: uart_gnss_rxstate;
-                    uart_gnss_rxstate = (ch =='$') ? 1: uart_gnss_rxstate;
-                    break;
-            case 16:
-                    gnss_state = ((uint8_t)ch)-48;
-//                    printf("\ngnss_state %u\n", gnss_state);
-                    uart_gnss_rxstate = 0;
-            default:
-                    uart_gnss_rxstate = 0;
+void unconfigure_pios() {
+    for (uint8_t i = 0; i < pio_channels; i++) {
+        pio_sm_set_enabled(inputs[i].pio, inputs[i].smc, false);
+        pio_sm_unclaim(inputs[i].pio, inputs[i].smc);
+        if (inputs[i].smp != PIO_NO_SM) {
+            pio_sm_set_enabled(inputs[i].pio, inputs[i].smp, false);
+            pio_sm_unclaim(inputs[i].pio, inputs[i].smp);
+        }
+        if (inputs[i].smi != PIO_NO_SM) {
+            pio_sm_set_enabled(inputs[i].led_pio, inputs[i].smi, false);
+            pio_sm_unclaim(inputs[i].led_pio, inputs[i].smi);
+        }
+    }
+    pio_clear_instruction_memory(pio0);
+    pio_clear_instruction_memory(pio1);
+    pio_channels = 0;
+}
 
+void print_pio_layout() {
+    process_output_flush();
+    for (uint8_t b = 0; b < PIO_BLOCKS; b++) {
+        printf("PIO%u MEM=%u/%u SM=%x\n", b, pio_layout.used_mem[b], PIO_MEM_WORDS, pio_layout.used_sms[b]);
+    }
+    for (uint8_t i = 0; i < pio_layout.channels; i++) {
+        struct PioChannelPlan* ch = &pio_layout.ch[i];
+        printf("%s PIO%u SM%u", inputs[i].name, ch->pio, ch->sm[0]);
+        if (ch->sm[1] != PIO_NO_SM) {
+            printf("+%u", ch->sm[1]);
         }
-        if (uart_gnss_rxstate == 6) {
-            if  (strcmp((char*)"GNGGA", uart_buff)==0) {
-                uart_gnss_rxstate = 10;   // we are on the start of our $GPGGA sentence
-            } else {
-                uart_gnss_rxstate = 0;
-            }
+        if (ch->led_sm == PIO_NO_SM) {
+            printf(" LED none\n");
+        } else {
+            printf(" LED PIO%u SM%u\n", ch->led_pio, ch->led_sm);
         }
     }
 }
 
-// CORE 1 - monitoring
+void print_status() {
+    // the core 0 counters are read while core 0 updates them, each word is consistent on its own
+    char line[3*PET_LINE_LEN];
+    process_output_flush();
+    printf("STATUS UP=%lu OUT=%lu BLOCKED_US=%lu SWITCHES=%lu QUEUE=%lu MAX=%lu DROPPED=%lu\n", (unsigned long)(time_us_64() / 1000000),
+        (unsigned long)output.stats.bytes, (unsigned long)output.stats.blocked_us, (unsigned long)health1.switches,
+        (unsigned long)spsc_level(&records), (unsigned long)records.high_water, (unsigned long)records.dropped);
+    printf("STATUS OUTPUT BATCHES=%lu DEADLINE=%lu WAITS=%lu\n", (unsigned long)output.stats.batches,
+        (unsigned long)output.stats.deadline_batches, (unsigned long)output.stats.waits);
+    for (uint8_t i = 0; i < pio_channels; i++) {
+        #if defined CAPTURE_DMA
+            uint32_t overruns = capture_overruns(i);
+        #else
+            uint32_t overruns = 0;
+        #endif
+        printf("STATUS %s EVENTS=%lu STALLS=%lu OVERRUNS=%lu\n", inputs[i].name, (unsigned long)health0.events[i],
+            (unsigned long)health1.stalls[i], (unsigned long)overruns);
+    }
+    struct NmeaFix fix;
+    nmea_read(&nmea, &fix);
+    printf("STATUS GNSS FIX=%d STATUS=%d SATS=%u UTC=%04u-%02u-%02uT%02u:%02u:%02u NMEA=%lu ERRORS=%lu\n", fix.quality, fix.status, fix.sats,
+        fix.year, fix.month, fix.day, fix.hour, fix.min, fix.sec, (unsigned long)nmea.sentences, (unsigned long)nmea.errors);
+    loop_stats_format(line, sizeof(line), "CORE0", &health0.loop);
+    printf("%s", line);
+    loop_stats_format(line, sizeof(line), "CORE1", &health1.loop);
+    printf("%s", line);
+}
+
+void on_uart_rx() {
+    while (uart_is_readable(uart0)) {
+        nmea_feed(&nmea, uart_getc(uart0));
+    }
+}
+
+// CORE 1 - monitoring, arithmetic and output
 
 void switch_time_base(bool external) {
     xosc_mhz = (external)? CLK_EXT_MHZ: XOSC_MHZ;
-    clk_src_freq = SYS_PLL_FREQ/XOSC_MHZ * xosc_mhz;
     printf("Switching timebase to %u MHz, \n", xosc_mhz, external);
+    // clk_sys changed with the reference somewhere since the last good check, the values drained
+    // until the pause are bridged by measure_set_clock(); core 0 stays paused while the PLL is set up,
+    // the values drained after it are tagged with the new epoch and core 1 converts the timescale
+    // when it gets the first of them
+    count_pause();
+    clk_src_freq = SYS_PLL_FREQ/XOSC_MHZ * xosc_mhz;
     set_xosc_freq(xosc_mhz, div_freq);
+    count_set_clock(clk_src_freq);
+    count_resume();
+    health1.switches++;
     printf("Switched timebase to %u MHz, %i \n", xosc_mhz, external);
 }
 
@@ -251,6 +475,432 @@ bool update_status_leds_timer_callback(struct repeating_timer *t) {
     bool extclkled = (ext_clk_state == 1)? 1: (ext_clk_state == 0)? indleds_state: 0;
     gpio_put(GNSS_LOCKED_INDICATOR_GPIO, gnssled);
     gpio_put(CLKREF_EXT_INDICATOR_GPIO, extclkled);
+    return true;
+}
+
+bool monitor_tick_timer_callback(struct repeating_timer *t) {
+    monitor_ticks++;
+    return true;
+}
+
+void check_ext_clock() {
+    // check ext ref signal availability
+    if (ext_clock_available()) {
+        clk_ext_verify ++;
+        // do not change state immediately, only after some iterations confirm it
+        if (clk_ext_verify >= 10) {
+            ext_clk_state = (ext_clk_state == 1)? 1: 0;
+            clk_ext_verify = 0;
+        }
+    } else {
+        clk_ext_verify--;
+        if (clk_ext_verify <= -10) {
+            clk_ext_verify = 0;
+            ext_clk_state = -1;
+        }
+    }
+}
+
+void check_gnss() {
+    struct NmeaFix fix;
+    if (!nmea_read(&nmea, &fix) || nmea.updates == nmea_updates) {
+        return;
+    }
+    nmea_updates = nmea.updates;
+    gnss_state = (fix.quality > 0 || fix.status == 1)? 1: (fix.quality == 0 || fix.status == 0)? 0: -1;
+    uint32_t utc_sec;
+    if (config.utc && gnss_state == 1 && fix.time_valid && fix.ms == 0 && nmea_unix_time(&fix, &utc_sec)) {
+        // the sentence follows the PPS edge of its second, take the edge in before anchoring
+        process_records();
+        measure_set_utc(&measure, utc_sec);
+    }
+}
+
+void check_timebase() {
+    // do we need to check timebase, because manual switch selection changed?
+    // every tick, the values drained since the last good check may be counted with the new clock
+    process_records();
+    int tb = get_timebase();
+    if (tb == 0) {
+        measure_clock_checked(&measure);    // the values processed above were counted before the check
+    } else if ((tb > 0) && (ext_clk_state >= 0)) {
+        // if internal clk used change to ext
+        process_output_flush();
+        printf("Switch timebase to ext, %u -> 1\n", ext_clk_state);
+        switch_time_base(true);
+        ext_clk_state = 1;
+    } else if (tb < 0) {
+        // if ext clk used change to internal
+        process_output_flush();
+        printf("Switch timebase to int, %u\n", ext_clk_state);
+        switch_time_base(false);
+        ext_clk_state = -1;
+    }
+}
+
+void load_store() {
+    // at power up on core 0, before the clocks and PIOs are configured
+    const struct StoreBlock* b = (const struct StoreBlock*)(XIP_BASE + STORE_FLASH_OFFSET);
+    store_init(&store);
+    if (!store_valid(b)) {
+        return;                         // erased, or written by another firmware version
+    }
+    store = *b;
+    if ((store.flags & STORE_CONFIG) && cmd_config_valid(&store.cfg)) {
+        config = store.cfg;
+    } else {
+        store.flags &= ~STORE_CONFIG;
+    }
+    if (store.flags & STORE_CAL) {
+        cal_table = store.cal;
+        process_set_cal(&cal_table);
+    }
+}
+
+void save_store() {
+    // core 0 executes from flash as well, it waits in RAM while the sector is written
+    static uint8_t page[FLASH_PAGE_SIZE];
+    _Static_assert(sizeof(struct StoreBlock) <= FLASH_PAGE_SIZE, "StoreBlock has to fit one flash page");
+    store_seal(&store);
+    memset(page, 0xff, sizeof(page));
+    memcpy(page, &store, sizeof(store));
+    multicore_lockout_start_blocking();
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_erase(STORE_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+    if (store.flags != 0) {
+        flash_range_program(STORE_FLASH_OFFSET, page, FLASH_PAGE_SIZE);
+    }
+    restore_interrupts(ints);
+    multicore_lockout_end_blocking();
+}
+
+bool collect_calibration(struct CalRun* run, uint8_t point, uint8_t channels) {
+    // values are read directly from the RX FIFOs, a value dropped on a full FIFO only loses a sample
+    // the first value of each state machine spans its start and is skipped
+    uint8_t sms = (cal_points[point].capture == PET_CAPTURE_INTERLEAVED)? 2: 1;
+    uint16_t got[PET_MAX_CHANNELS][2] = {{0}};
+    uint32_t start_us = time_us_32();
+    bool done = false;
+    while (!done) {
+        if (time_us_32() - start_us > CAL_TIMEOUT_MS*1000) {
+            return false;
+        }
+        done = true;
+        for (uint8_t i = 0; i < channels; i++) {
+            for (uint8_t k = 0; k < sms; k++) {
+                uint sm = (k == 0)? inputs[i].smc: inputs[i].smp;
+                if (got[i][k] <= CAL_SAMPLES && !pio_sm_is_rx_fifo_empty(inputs[i].pio, sm)) {
+                    uint32_t raw = pio_sm_get(inputs[i].pio, sm);
+                    if (got[i][k]++ > 0) {
+                        cal_run_add(run, point, i, raw);
+                    }
+                }
+                done = done && got[i][k] > CAL_SAMPLES;
+            }
+        }
+    }
+    return true;
+}
+
+void run_calibration() {
+    // the clock output divided from clk_sys is looped back to the counting state machines of all
+    // active channels, point by point; the measurement restarts with a new timescale afterwards
+    struct CalRun run;
+    struct PetConfig cfg = config;
+    char line[2*PET_LINE_LEN];
+    cal_run_init(&run);
+    count_pause();
+    process_records();
+    process_output_flush();
+    #if defined CAPTURE_DMA
+        capture_stop();
+    #endif
+    unconfigure_pios();
+    clock_gpio_init(DIVCLK_GPIO, CLOCKS_CLK_GPOUT0_CTRL_AUXSRC_VALUE_CLK_SYS, CAL_DIV);
+    for (uint8_t p = 0; p < CAL_POINTS; p++) {
+        struct PioPlan plan;
+        cfg.capture = cal_points[p].capture;
+        cfg.avg_periods = cal_points[p].avg_periods;
+        if (!plan_pios(&cfg, &plan)) {
+            continue;                   // reported as missing values
+        }
+        configure_pios(&cfg, true);
+        collect_calibration(&run, p, cfg.channels);
+        unconfigure_pios();
+    }
+    divclk_init(div_freq);
+    if (cal_run_solve(&run, cfg.channels, &cal_table)) {
+        store.cal = cal_table;
+        store.flags |= STORE_CAL;
+        save_store();
+        process_set_cal(&cal_table);
+        for (uint8_t i = 0; i < cfg.channels; i++) {
+            cal_format(line, sizeof(line), &cal_table, i, inputs[i].name);
+            printf("%s", line);
+        }
+    } else {
+        printf("ERR calibration values missing, table not changed\n");
+    }
+    configure_pios(&config, false);
+    count_init(config.channels, config.capture);
+    process_init(&config);
+    count_resume();
+}
+
+void run_benchmark() {
+    // synthetic 1 kHz periods on all channels through the measurement and the output, as fast
+    // as the link takes them, BENCH_MS per mode, format and flush policy; the values of the
+    // runs are printed, the rates follow, the measurement restarts with a new timescale
+    static const uint8_t modes[] = {PET_MODE_TIMEMARK, PET_MODE_FREQUENCY, PET_MODE_CYCLE_COUNT};
+    uint32_t rate[3][2][2];             // mode, format, unbatched/batched
+    count_pause();
+    process_records();
+    process_output_flush();
+    #if defined CAPTURE_DMA
+        capture_stop();
+    #endif
+    for (uint8_t m = 0; m < 3; m++) {
+        for (uint8_t f = 0; f < 2; f++) {
+            for (uint8_t b = 0; b < 2; b++) {
+                struct PetConfig cfg = config;
+                uint32_t n = 0;
+                cfg.mode = modes[m];
+                cfg.format = f;
+                cfg.capture = PET_CAPTURE_PERIOD;
+                cfg.gate_ms = 0;
+                cfg.utc = 0;
+                out_set_policy(&output, (b == 0)? 1: OUT_FLUSH_BYTES, (b == 0)? 0: OUT_FLUSH_US);
+                process_init(&cfg);
+                uint32_t raw[PET_MAX_CHANNELS];
+                for (uint8_t i = 0; i < cfg.channels; i++) {
+                    // the value the SM pushes for avg 1 kHz periods, correct() negates it and adds the offset
+                    raw[i] = ~((clk_src_freq / 1000 * cfg.avg_periods - measure.cor_offset[i]) / 2);
+                }
+                uint32_t start_us = time_us_32();
+                while (time_us_32() - start_us < BENCH_MS*1000) {
+                    measure_count(&measure, n % cfg.channels, raw[n % cfg.channels]);
+                    process_output_poll();
+                    n++;
+                }
+                process_output_flush();
+                rate[m][f][b] = (uint64_t)n * 1000 / BENCH_MS;
+            }
+        }
+    }
+    out_set_policy(&output, OUT_FLUSH_BYTES, OUT_FLUSH_US);
+    for (uint8_t m = 0; m < 3; m++) {
+        for (uint8_t f = 0; f < 2; f++) {
+            printf("BENCH %s %s UNBATCHED=%lu BATCHED=%lu /s\n", measure_mode_name(modes[m]), (f == PET_FORMAT_BINARY)? "BIN": "TEXT",
+                (unsigned long)rate[m][f][0], (unsigned long)rate[m][f][1]);
+        }
+    }
+    unconfigure_pios();
+    configure_pios(&config, false);
+    count_init(config.channels, config.capture);
+    process_init(&config);
+    count_resume();
+}
+
+void burst_gpio_irq(uint gpio, uint32_t events) {
+    gpio_set_irq_enabled(gpio, GPIO_IRQ_EDGE_RISE, false);     // one trigger per BURST ARM
+    process_burst_fire();
+}
+
+void run_burst(uint8_t action) {
+    char line[2*PET_LINE_LEN];
+    if (action == CMD_BURST_ARM) {
+        gpio_set_irq_enabled(BURST_TRIGGER_GPIO, GPIO_IRQ_EDGE_RISE, false);
+        if (!process_burst_arm(&config)) {
+            printf("ERR BURST POST+PRE max. %lu values per SM with CH=%u CAPTURE=%u\n", (unsigned long)process_burst_max(), config.channels,
+                config.capture);
+            return;
+        }
+        if (config.burst_trig == BURST_TRIG_GPIO) {
+            // IRQ on core 1, core 0 takes the trigger with its next value
+            gpio_set_irq_enabled_with_callback(BURST_TRIGGER_GPIO, GPIO_IRQ_EDGE_RISE, true, burst_gpio_irq);
+        }
+    } else if (action == CMD_BURST_FIRE) {
+        process_burst_fire();
+    } else if (action == CMD_BURST_OFF) {
+        gpio_set_irq_enabled(BURST_TRIGGER_GPIO, GPIO_IRQ_EDGE_RISE, false);
+        process_burst_stop();
+    } else if (action == CMD_BURST_DUMP) {
+        process_records();
+        process_burst_dump();
+    }
+    cmd_format_burst(line, sizeof(line), &config, process_burst_state(), process_burst_max());
+    printf("%s", line);
+}
+
+void apply_config(uint16_t res, const struct PetConfig* cfg) {
+    char line[2*PET_LINE_LEN];
+    process_output_flush();             // the replies follow the values printed so far
+    if (res & CMD_ERROR) {
+        printf("ERR %s\n", cmd_parser.error);
+        return;
+    }
+    if (cfg->div_freq != config.div_freq) {
+        div_freq = (cfg->div_freq > 0)? cfg->div_freq: xosc_div_setting();
+        divclk_init(div_freq);
+        print_div_setting(cfg->div_freq == 0);
+    }
+    if (res & CMD_RELOAD) {
+        struct PioPlan plan;
+        if (!plan_pios(cfg, &plan)) {
+            printf("ERR AVG=%u CH=%u CAPTURE=%u does not fit the PIO blocks\n", cfg->avg_periods, cfg->channels, cfg->capture);
+            return;
+        }
+        // new counting programs, stop core 0 draining while the state machines are reloaded
+        count_pause();
+        process_records();                  // values counted with the old configuration
+        #if defined CAPTURE_DMA
+            capture_stop();
+        #endif
+        unconfigure_pios();
+        config = *cfg;
+        configure_pios(&config, false);
+        count_init(config.channels, config.capture);
+        process_init(&config);              // the edges during reload were not counted, start a new timescale
+        count_resume();
+    } else if (res & CMD_CHANGED) {
+        // only the processing routine changes, the timescale is kept
+        process_records();
+        config = *cfg;
+        measure_set_config(&measure, &config);
+        measure_header(&measure);
+    }
+    process_output_flush();             // header of a new configuration
+    if ((res & CMD_SAVE) && cmd_parser.use_default) {
+        store.flags &= ~STORE_CONFIG;
+        save_store();
+    } else if (res & CMD_SAVE) {
+        store.cfg = config;
+        store.flags |= STORE_CONFIG;
+        save_store();
+    }
+    if (res & CMD_QUERY) {
+        cmd_format_config(line, sizeof(line), &config);
+        printf("%s", line);
+    }
+    if (res & CMD_QUERY_PIO) {
+        print_pio_layout();
+    }
+    if (res & CMD_QUERY_STAB) {
+        process_records();
+        measure_stability_report(&measure);
+    }
+    if (res & CMD_QUERY_STATUS) {
+        print_status();
+    }
+    if ((res & CMD_CALIBRATE) && cmd_parser.use_default) {
+        process_records();
+        process_output_flush();
+        store.flags &= ~STORE_CAL;
+        save_store();
+        process_set_cal(NULL);
+        cal_default(&cal_table);
+        for (uint8_t i = 0; i < config.channels; i++) {
+            cal_format(line, sizeof(line), &cal_table, i, inputs[i].name);
+            printf("%s", line);
+        }
+    } else if (res & CMD_CALIBRATE) {
+        run_calibration();
+    }
+    if (res & CMD_BENCH) {
+        run_benchmark();
+    }
+    if (res & CMD_BURST) {
+        // only the burst settings changed, used by the next BURST ARM
+        config = *cfg;
+        run_burst(cmd_parser.burst);
+    }
+}
+
+void check_commands() {
+    int c;
+    while ((c = getchar_timeout_us(0)) >= 0) {
+        struct PetConfig cfg = config;
+        uint16_t res = cmd_feed(&cmd_parser, (char)c, &cfg);
+        if (res != CMD_NONE) {
+            apply_config(res, &cfg);
+        }
+    }
+}
+
+void check_pio_stalls() {
+    // FDEBUG RXSTALL is set when "push noblock" found the RX FIFO full and dropped the value,
+    // the flags are sticky, count and clear them every tick
+    for (uint8_t i = 0; i < pio_channels; i++) {
+        uint32_t mask = 1u << (PIO_FDEBUG_RXSTALL_LSB + inputs[i].smc);
+        if (inputs[i].smp != PIO_NO_SM) {
+            mask |= 1u << (PIO_FDEBUG_RXSTALL_LSB + inputs[i].smp);
+        }
+        if (inputs[i].pio->fdebug & mask) {
+            inputs[i].pio->fdebug = mask;       // write 1 to clear
+            health1.stalls[i]++;
+        }
+    }
+}
+
+void report_status() {
+    if (config.format == PET_FORMAT_TEXT || (config.format == PET_FORMAT_BINARY && config.mode >= PET_MODE_STABILITY)) {
+        // not into the binary or raw stream
+        print_status();
+    }
+}
+
+void report_stability() {
+    if (config.mode == PET_MODE_STABILITY) {
+        measure_stability_report(&measure);
+    }
+}
+
+#if LIB_PICO_STDIO_USB
+void check_usb() {
+    // the output is dropped while no host is connected, repeat the header to a new terminal
+    bool connected = stdio_usb_connected();
+    if (connected && !usb_connected) {
+        char line[2*PET_LINE_LEN];
+        process_records();
+        process_output_flush();
+        if (config.format == PET_FORMAT_TEXT) {
+            print_div_setting(config.div_freq == 0);    // printed at power up before the terminal was there
+            cmd_format_config(line, sizeof(line), &config);
+            printf("%s", line);
+        }
+        measure_header(&measure);
+    }
+    usb_connected = connected;
+}
+#endif
+
+static struct MonitorTask monitor_tasks[] = {
+    // period in MONITOR_TICK_MS ticks, function
+    {1, 0, check_ext_clock},
+    {1, 0, check_gnss},
+    {1, 0, check_timebase},
+    {1, 0, check_commands},
+    {STAB_REPORT_MS/MONITOR_TICK_MS, 0, report_stability},
+    {1, 0, check_pio_stalls},
+    #if LIB_PICO_STDIO_USB
+    {10, 0, check_usb},
+    #endif
+    #if STATUS_REPORT_MS > 0
+    {STATUS_REPORT_MS/MONITOR_TICK_MS, 0, report_status},
+    #endif
+};
+
+void run_monitor_tasks() {
+    // run the tasks for every tick elapsed since the last call, the tick count is updated by the timer IRQ
+    while (monitor_ticks_done != monitor_ticks) {
+        monitor_ticks_done++;
+        for (uint8_t i = 0; i < sizeof(monitor_tasks)/sizeof(monitor_tasks[0]); i++) {
+            if (++monitor_tasks[i].elapsed >= monitor_tasks[i].period) {
+                monitor_tasks[i].elapsed = 0;
+                monitor_tasks[i].run();
+            }
+        }
+    }
 }
 
 void monitor() {
@@ -260,64 +910,54 @@ void monitor() {
     uart_set_hw_flow(uart0, false, false);
     uart_set_format(uart0, 8, 1, UART_PARITY_NONE);
     uart_set_fifo_enabled(uart0, false);
+    nmea_init(&nmea);
     irq_set_exclusive_handler(UART0_IRQ, on_uart_rx);
     irq_set_enabled(UART0_IRQ, true);    
     uart_set_irq_enables(uart0, true, false);
 
-    struct repeating_timer timer;
-    add_repeating_timer_ms(-100, update_status_leds_timer_callback, NULL, &timer);
-
-    int clk_ext_verify = 0;
+    // timers of an alarm pool created here fire on core 1, so they do not disturb the counting on core 0
+    alarm_pool_t *pool = alarm_pool_create(MONITOR_ALARM_NUM, 4);
+    struct repeating_timer leds_timer;
+    struct repeating_timer tick_timer;
+    alarm_pool_add_repeating_timer_ms(pool, -100, update_status_leds_timer_callback, NULL, &leds_timer);
+    alarm_pool_add_repeating_timer_ms(pool, -MONITOR_TICK_MS, monitor_tick_timer_callback, NULL, &tick_timer);
+
+    cmd_init(&cmd_parser);
+    process_output_init();
+    process_init(&config);
+    loop_stats_init(&health1.loop);
+    uint32_t loop_us = time_us_32();
     while (true) {
-        // check ext ref signal availability
-        if (ext_clock_available()) {
-            clk_ext_verify ++;
-            // do not change state immediately, only after some iterations confirm it
-            if (clk_ext_verify >= 10) {
-                ext_clk_state = (ext_clk_state == 1)? 1: 0;
-                clk_ext_verify = 0;
-            }
-        } else {
-            clk_ext_verify--;
-            if (clk_ext_verify <= -10) {
-                clk_ext_verify = 0;
-                ext_clk_state = -1;
-            }
-        }
-
-        // do we need to check timebase, because manual switch selection changed?
-        int tb = get_timebase();
-        if ((tb > 0) && (ext_clk_state >= 0)) {
-            // if internal clk used change to ext
-            printf("Switch timebase to ext, %u -> 1\n", ext_clk_state);
-            switch_time_base(true);
-            ext_clk_state = 1;
-        } else if (tb < 0) {
-            // if ext clk used change to internal
-            printf("Switch timebase to int, %u\n", ext_clk_state);
-            switch_time_base(false);
-            ext_clk_state = -1;
-        }
+        process_records();
+        process_output_poll();
+        run_monitor_tasks();
+        uint32_t now = time_us_32();
+        loop_stats_add(&health1.loop, now - loop_us);
+        loop_us = now;
     }
 }
 
-// CORE 0 - timemarking/counter
+// CORE 0 - draining of the counting state machines
 int main() {
+    // counting starts as soon as the clocks are final, the USB host enumerates the device
+    // in the background and gets the header by check_usb() once a terminal is connected
     vreg_set_voltage(CORE_VOLTAGE);
-    clocks_init();
-    stdio_init_all();
     pins_init();
-    sleep_ms(2000);
-    div_freq = xosc_div_setting();
-    printf("Div Freq %d\n", div_freq);
+    load_store();
+    if (config.div_freq > 0) {
+        div_freq = config.div_freq;
+    } else {
+        busy_wait_us(100);      // DIP switch pull-ups
+        div_freq = xosc_div_setting();
+    }
     configure_clocks(div_freq);
-    stdio_init_all();
+    stdio_init_all();           // once, on the final clk_sys and clk_peri
+    print_div_setting(config.div_freq == 0);
     inputs_init();
-    configure_pios();
-    sleep_ms(2000);             // wait 1s to allow connecting USB
-    printf("Div Freq %d\n", div_freq);
-
+    configure_pios(&config, false);
+    count_init(config.channels, config.capture);
 
+    multicore_lockout_victim_init();    // core 0 waits in RAM while core 1 writes the flash
     multicore_launch_core1(monitor);
     do_count();
 }
@@ -1,4 +1,5 @@
 #include "hardware/pio.h"
+#include "measure.h"
 
 // INPUT CLOCK SOURECE REFERENCE
 //#define CLK_SRC_XOSC                  // internal 12MHz TCXO
@@ -10,15 +11,76 @@
 #define SYS_PLL_FREQ 240*MHZ              // slightly overclocked from default 125 MHz; NOTE not arbitrary freq possible. See RP2040 datasheet
 #define CORE_VOLTAGE VREG_VOLTAGE_1_20    // consider higher core voltage for higher PLL, default is 1.1V
 
-// OUTPUT SETTINGS
+// OUTPUT SETTINGS, defaults after power up unless stored by SAVE, change at runtime by MODE, FORMAT, AVG and CH commands
 #define OUTPUT_TIMEMARK
 //#define OUTPUT_FREQUENCY
 //#define OUTPUT_CYCLE_COUNT
+//#define OUTPUT_STABILITY              // no output per sample, ADEV/MDEV/TDEV summary every STAB_REPORT_MS
+//#define OUTPUT_OMEGA                  // least-squares frequency per gate (GATE_MS, 1 s if 0)
+//#define OUTPUT_TIC                    // signed interval from the TIC_REF_CHANNEL edge to each other channel, needs CAPTURE_TIMESTAMP
+//#define OUTPUT_HISTOGRAM              // no output per sample, histogram and moments per channel per gate (GATE_MS, 1 s if 0)
+//#define OUTPUT_WIDTH                  // mean pulse width of AVG_PERIODS periods, needs CAPTURE_EDGES
+//#define OUTPUT_DUTY                   // duty cycle of AVG_PERIODS periods, needs CAPTURE_EDGES
+//#define OUTPUT_BINARY                 // framed binary stream of clk_cor values instead of text, decode with tools/petdecode
+
+#define TIC_REF_CHANNEL 0               // start channel of the TIC intervals, 0 is ChA; GNSS PPS channel of TIMEMARK_UTC
+//#define TIMEMARK_UTC                  // TIMEMARK in UTC seconds since 1970, anchored by the NMEA time of the PPS on TIC_REF_CHANNEL
+
+#define HIST_WIDTH 1                    // histogram bin width in clk_sys cycles
+//#define HIST_TIE                      // histogram of the time interval error instead of the sample intervals
+
+#define STAB_REPORT_MS 60000            // period of the stability summary, max. 65535 monitor ticks
+#define STORE_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)  // stored configuration and self-calibration, last flash sector
+#define CAL_TIMEOUT_MS 1000             // max. time to collect the values of one self-calibration point
+
+// OUTPUT WRITER, the values are sent in batches, see outWriter.h
+#define OUT_FLUSH_BYTES 512             // send once this many bytes are buffered, whole 64 byte packets; 1 sends every value on its own
+#define OUT_FLUSH_US 20000              // send once the oldest buffered byte waited this long, 0 only by size
+//#define OUTPUT_UART_DMA               // with stdio on the UART only (CMakeLists.txt), send the batches by DMA instead of the stdio driver
+#define BENCH_MS 1000                   // duration of one BENCH run
+
+#define STATUS_REPORT_MS 0              // period of the STATUS health report in text output, 0 only on the STATUS command
+
+#define GATE_MS 0                       // frequency gate time in ms, one frequency per channel per gate; 0 for one per sample
 
 #define AVG_PERIODS 1                   // number of periods to average; has to at least 1, for steady results use odd numbers 1, 3, 5...
 
+// CAPTURE SETTINGS
+#define CAPTURE_DMA                     // drain the PIO RX FIFOs by DMA into ring buffers, comment out to poll the FIFOs
+#define CAPTURE_RING_WORDS 256          // ring buffer size per counting SM in 32bit words, has to be power of 2
+//#define CAPTURE_TIMESTAMP             // power up with free-running timestamps (picopet_ts) instead of periods, CAPTURE command at runtime
+//#define CAPTURE_INTERLEAVED           // power up with two phase interleaved SMs per channel (picopet_hr), 1 cycle resolution
+//#define CAPTURE_EDGES                 // power up with the high and low times of every period (picopet_de), TIMEMARK of both edges
+#define TIMESTAMP_REFRESH_US 1000000    // without edges core 0 advances the timestamp reference by the elapsed time this often
+
+// BURST CAPTURE, see burst.h, defaults after power up unless stored by SAVE, change at runtime by BURST and TRIG commands
+#define BURST_ARENA_WORDS 16384         // RAM shared by the bursts of all counting SMs in 32bit words (64 kB)
+#define BURST_POST 1024                 // values per counting SM captured from the trigger on
+#define BURST_PRE 256                   // values per counting SM kept from before the trigger
+#define BURST_TRIGGER_GPIO 22           // its rising edge triggers a burst armed with TRIG GPIO
+
+#if defined OUTPUT_UART_DMA && LIB_PICO_STDIO_USB
+#error "OUTPUT_UART_DMA needs the stdio on the UART only, pico_enable_stdio_usb(picoPET 0)"
+#endif
+
+#if defined OUTPUT_TIC && !defined CAPTURE_TIMESTAMP
+#error "OUTPUT_TIC needs CAPTURE_TIMESTAMP, only one shared counter gives the phase between the channels"
+#endif
+
+#if defined OUTPUT_FREQUENCY && defined OUTPUT_BINARY && GATE_MS > 0
+#error "GATE_MS needs text output with OUTPUT_FREQUENCY, the binary event frames carry every sample"
+#endif
+
+#if (defined OUTPUT_WIDTH || defined OUTPUT_DUTY) && !defined CAPTURE_EDGES
+#error "OUTPUT_WIDTH and OUTPUT_DUTY need CAPTURE_EDGES, only picopet_de counts the high time"
+#endif
+
+// MONITORING (core 1)
+#define MONITOR_TICK_MS 10              // period of the monitor task scheduler
+#define MONITOR_ALARM_NUM 2             // hardware alarm used by the core 1 timers
+
 // INPUTS wiring
-#define SM_COUNT 2
+#define SM_COUNT 2                      // number of active input channels, up to PET_MAX_CHANNELS
 #define INPUT_SIGNALA_GPIO 5
 #define INPUT_SIGNALA_LEDGPIO 4
 #define INPUT_SIGNALB_GPIO 6
@@ -28,6 +90,14 @@
 #define INPUT_SIGNALD_GPIO 13
 #define INPUT_SIGNALD_LEDGPIO 12
 
+#if TIC_REF_CHANNEL >= SM_COUNT
+#error "TIC_REF_CHANNEL has to be one of the SM_COUNT active channels"
+#endif
+
+#if defined OUTPUT_TIC && SM_COUNT < 2
+#error "OUTPUT_TIC needs SM_COUNT 2 or more, the reference channel and a stop channel"
+#endif
+
 // CLOCK references wiring
 #define CLKREF_GNSS_GPIO 20
 #define CLKREF_EXT_GPIO 11
@@ -51,6 +121,7 @@
 
 
 // DIVIDER FREQUENCIES
+#define DIV_FREQ 0                      // divided reference output in Hz after power up, 0 set by the DIP switches below
 #define DIVF_XOSC 0
 #define DIVF_1 1
 #define DIVF_10 2
@@ -65,11 +136,11 @@ struct PetInput
     uint input_gpio;
     uint led_gpio;
     char* name;
-    PIO pio;
-    uint smc;
-    uint smi;
-    uint64_t tm;
-    double ts;
+    PIO pio;                // PIO block of the counting SM
+    uint smc;               // counting SM, all in one PIO block with timestamp capture
+    uint smp;               // phase1 counting SM of interleaved capture in the same PIO block, PIO_NO_SM otherwise
+    PIO led_pio;            // PIO block of the led indicator SM
+    uint smi;               // led indicator SM, PIO_NO_SM if none left
 };
 
 
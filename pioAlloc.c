@@ -0,0 +1,87 @@
+#include <string.h>
+#include "pioAlloc.h"
+
+// NOTE: no pico-sdk dependency here, the layouts are checked on the host as well
+
+
+static uint8_t free_sms(const struct PioPlan* plan, uint8_t b) {
+    uint8_t n = 0;
+    for (uint8_t sm = 0; sm < PIO_SMS; sm++) {
+        n += ((plan->used_sms[b] >> sm) & 1) == 0;
+    }
+    return n;
+}
+
+static bool fits(const struct PioPlan* plan, uint8_t b, uint8_t prog, uint8_t sms, const uint8_t* prog_len) {
+    uint8_t mem = ((plan->loaded[b] >> prog) & 1)? 0: prog_len[prog];
+    return free_sms(plan, b) >= sms && plan->used_mem[b] + mem <= PIO_MEM_WORDS;
+}
+
+static void load(struct PioPlan* plan, uint8_t b, uint8_t prog, const uint8_t* prog_len) {
+    if (((plan->loaded[b] >> prog) & 1) == 0) {
+        plan->loaded[b] |= 1u << prog;
+        plan->used_mem[b] += prog_len[prog];
+    }
+}
+
+static uint8_t claim_sm(struct PioPlan* plan, uint8_t b) {
+    for (uint8_t sm = 0; sm < PIO_SMS; sm++) {
+        if (((plan->used_sms[b] >> sm) & 1) == 0) {
+            plan->used_sms[b] |= 1u << sm;
+            return sm;
+        }
+    }
+    return PIO_NO_SM;
+}
+
+// plans channels each using count_sms state machines running count_prog and one running led_prog
+// with one_block all counting state machines are placed to pio0
+// returns false if the counting state machines do not fit, the plan is then not usable
+bool pio_plan_layout(struct PioPlan* plan, uint8_t channels, uint8_t count_prog, uint8_t count_sms, bool one_block, uint8_t led_prog, const uint8_t* prog_len) {
+    memset(plan, 0, sizeof(*plan));
+    if (channels > PIO_MAX_CHANNELS || count_sms > PIO_MAX_CHANNEL_SMS) {
+        return false;
+    }
+    plan->channels = channels;
+    // counting state machines first, channels alternate between the PIO blocks
+    for (uint8_t i = 0; i < channels; i++) {
+        uint8_t b = one_block? 0: i % PIO_BLOCKS;
+        if (!fits(plan, b, count_prog, count_sms, prog_len)) {
+            if (one_block) {
+                return false;
+            }
+            b = (b + 1) % PIO_BLOCKS;
+            if (!fits(plan, b, count_prog, count_sms, prog_len)) {
+                return false;
+            }
+        }
+        load(plan, b, count_prog, prog_len);
+        plan->ch[i].pio = b;
+        for (uint8_t k = 0; k < PIO_MAX_CHANNEL_SMS; k++) {
+            plan->ch[i].sm[k] = (k < count_sms)? claim_sm(plan, b): PIO_NO_SM;
+        }
+        plan->ch[i].led_sm = PIO_NO_SM;
+    }
+    // led indicators with the remaining resources, preferably in the same PIO block
+    for (uint8_t i = 0; i < channels; i++) {
+        for (uint8_t k = 0; k < PIO_BLOCKS; k++) {
+            uint8_t b = (plan->ch[i].pio + k) % PIO_BLOCKS;
+            if (fits(plan, b, led_prog, 1, prog_len)) {
+                load(plan, b, led_prog, prog_len);
+                plan->ch[i].led_pio = b;
+                plan->ch[i].led_sm = claim_sm(plan, b);
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// number of channels with led indicator
+uint8_t pio_plan_leds(const struct PioPlan* plan) {
+    uint8_t n = 0;
+    for (uint8_t i = 0; i < plan->channels; i++) {
+        n += plan->ch[i].led_sm != PIO_NO_SM;
+    }
+    return n;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// PIO resource allocator
+// Plans which PIO block and state machines each input channel uses. Every program is
+// loaded only once per PIO block and shared by all its state machines. The counting
+// state machines are placed first, the led indicator state machines get what is left.
+// Counting state machines which have to be started in sync are kept in one PIO block.
+// Only program lengths are needed, so the plan can be checked on the host as well.
+
+#define PIO_BLOCKS 2
+#define PIO_SMS 4
+#define PIO_MEM_WORDS 32
+#define PIO_MAX_PROGRAMS 8
+#define PIO_MAX_CHANNELS 4
+#define PIO_MAX_CHANNEL_SMS 2           // max. counting state machines per channel
+#define PIO_NO_SM 0xff
+
+struct PioChannelPlan
+{
+    uint8_t pio;                        // PIO block of the counting state machines
+    uint8_t sm[PIO_MAX_CHANNEL_SMS];    // counting state machines
+    uint8_t led_pio;
+    uint8_t led_sm;                     // PIO_NO_SM if no state machine left for the indicator
+};
+
+struct PioPlan
+{
+    uint8_t channels;
+    struct PioChannelPlan ch[PIO_MAX_CHANNELS];
+    uint16_t loaded[PIO_BLOCKS];        // bit mask of programs loaded to each PIO block
+    uint8_t used_mem[PIO_BLOCKS];       // instruction memory words used
+    uint8_t used_sms[PIO_BLOCKS];       // bit mask of state machines used
+};
+
+bool pio_plan_layout(struct PioPlan* plan, uint8_t channels, uint8_t count_prog, uint8_t count_sms, bool one_block, uint8_t led_prog, const uint8_t* prog_len);
+
+uint8_t pio_plan_leds(const struct PioPlan* plan);
@@ -0,0 +1,32 @@
+#include "ringBuf.h"
+
+// NOTE: no pico-sdk dependency here, so the consumer logic can be compiled and exercised on the host
+
+void ring_init(struct PetRing* r, volatile uint32_t* buf, uint32_t words) {
+    r->buf = buf;
+    r->mask = words - 1;
+    r->rd = 0;
+    r->overruns = 0;
+}
+
+uint32_t ring_level(struct PetRing* r, uint32_t wr) {
+    // wr is the total number of words written by the producer, differences are modulo 2^32
+    return wr - r->rd;
+}
+
+bool ring_get(struct PetRing* r, uint32_t wr, uint32_t* word) {
+    uint32_t level = wr - r->rd;
+    if (level == 0) {
+        return false;
+    }
+    if (level > r->mask) {
+        // the writer lapped us (or is about to overwrite the oldest word), drop the oldest words
+        // and keep some distance so the next reads are not overwritten while we read them
+        uint32_t keep = (r->mask + 1) - (r->mask + 1) / RING_GUARD_DIV;
+        r->overruns += level - keep;
+        r->rd = wr - keep;
+    }
+    *word = r->buf[r->rd & r->mask];
+    r->rd++;
+    return true;
+}
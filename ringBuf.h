@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Lossless capture ring buffer
+// The producer (DMA channel on the device, mock FIFO on the host) writes words into
+// a power-of-two sized buffer and only exposes the total number of words written.
+// The consumer keeps its own total of words read, so both totals may wrap at 2^32.
+// If the producer laps the consumer the unread words are lost and counted as overruns.
+
+#define RING_GUARD_DIV 4        // on overrun skip forward 1/RING_GUARD_DIV of the buffer to get away from the writer
+
+struct PetRing
+{
+    volatile uint32_t* buf;
+    uint32_t mask;              // number of words in buf - 1, buf size has to be power of 2
+    uint32_t rd;                // total number of words consumed
+    uint32_t overruns;          // total number of words lost
+};
+
+void ring_init(struct PetRing* r, volatile uint32_t* buf, uint32_t words);
+
+uint32_t ring_level(struct PetRing* r, uint32_t wr);
+
+bool ring_get(struct PetRing* r, uint32_t wr, uint32_t* word);
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <string.h>
+#include "selfCal.h"
+
+// NOTE: no pico-sdk dependency here
+
+const struct CalPoint cal_points[CAL_POINTS] = {
+    {PET_CAPTURE_PERIOD, 1},            // picopet_sp
+    {PET_CAPTURE_PERIOD, 2},            // picopet_mp
+    {PET_CAPTURE_PERIOD, 10},
+    {PET_CAPTURE_INTERLEAVED, 1},       // picopet_hr, each phase
+    {PET_CAPTURE_INTERLEAVED, 10},
+};
+
+void cal_default(struct PetCal* cal) {
+    // the corrections derived from the PIO programs, see pet_cor_offset()
+    for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+        cal->sp[i] = pet_cor_offset(1, PET_CAPTURE_PERIOD) * CAL_SCALE;
+        cal->mp_slope[i] = 3 * CAL_SCALE;
+        cal->mp_base[i] = 3 * CAL_SCALE;
+        cal->hr_slope[i] = 3 * CAL_SCALE;
+        cal->hr_base[i] = 3 * CAL_SCALE;
+    }
+}
+
+// offset of the channel in clk_sys cycles, clk_cor = 2*clk_cnt + offset
+uint32_t cal_cor_offset(const struct PetCal* cal, uint8_t i, uint16_t avg_periods, uint8_t capture) {
+    int32_t v;
+    if (capture == PET_CAPTURE_TIMESTAMP) {
+        return 0;                       // differences of one counter
+    } else if (capture == PET_CAPTURE_EDGES) {
+        // the high time of the odd loopback period is not known to the cycle, the constant of picopet_de
+        return pet_cor_offset(avg_periods, capture);
+    } else if (capture == PET_CAPTURE_INTERLEAVED) {
+        v = cal->hr_slope[i] * avg_periods + cal->hr_base[i];
+    } else if (avg_periods == 1) {
+        v = cal->sp[i];
+    } else {
+        v = cal->mp_slope[i] * avg_periods + cal->mp_base[i];
+    }
+    return (v <= 0)? 0: (v + CAL_SCALE/2) / CAL_SCALE;
+}
+
+void cal_run_init(struct CalRun* r) {
+    memset(r, 0, sizeof(*r));
+}
+
+// raw is the value pushed by the counting SM for avg_periods periods of the loopback signal
+void cal_run_add(struct CalRun* r, uint8_t point, uint8_t i, uint32_t raw) {
+    r->sum[point][i] += (int64_t)cal_points[point].avg_periods * CAL_DIV - 2*(int64_t)(~raw);
+    r->n[point][i]++;
+}
+
+// mean offset of a point in 1/CAL_SCALE cycles
+static int32_t mean_offset(const struct CalRun* r, uint8_t point, uint8_t i) {
+    int64_t v = r->sum[point][i] * CAL_SCALE;
+    int64_t n = r->n[point][i];
+    return (v >= 0)? (v + n/2) / n: (v - n/2) / n;
+}
+
+static void fit(const struct CalRun* r, uint8_t lo, uint8_t hi, uint8_t i, int32_t* slope, int32_t* base) {
+    int32_t a = cal_points[lo].avg_periods;
+    int32_t b = cal_points[hi].avg_periods;
+    int32_t off_a = mean_offset(r, lo, i);
+    int32_t off_b = mean_offset(r, hi, i);
+    *slope = (off_b - off_a) / (b - a);
+    *base = off_a - *slope * a;
+}
+
+// false if a point of an active channel has too few values, the table is left untouched then
+bool cal_run_solve(const struct CalRun* r, uint8_t channels, struct PetCal* cal) {
+    for (uint8_t p = 0; p < CAL_POINTS; p++) {
+        for (uint8_t i = 0; i < channels; i++) {
+            if (r->n[p][i] < CAL_SAMPLES/2) {
+                return false;
+            }
+        }
+    }
+    for (uint8_t i = 0; i < channels; i++) {
+        cal->sp[i] = mean_offset(r, 0, i);
+        fit(r, 1, 2, i, &cal->mp_slope[i], &cal->mp_base[i]);
+        fit(r, 3, 4, i, &cal->hr_slope[i], &cal->hr_base[i]);
+    }
+    return true;
+}
+
+static int fmt_cal(char* buf, int len, int32_t v) {
+    // fixed point with 2 decimals
+    const char* sign = (v < 0)? "-": "";
+    uint32_t a = (v < 0)? -v: v;
+    uint32_t frac = (a % CAL_SCALE) * 100 / CAL_SCALE;
+    return snprintf(buf, len, "%s%lu.%02lu", sign, (unsigned long)(a / CAL_SCALE), (unsigned long)frac);
+}
+
+// "CAL <name> SP=4.00 MP=3.00*AVG+3.00 HR=3.00*AVG+3.00"
+uint8_t cal_format(char* buf, uint8_t len, const struct PetCal* cal, uint8_t i, const char* name) {
+    int n = snprintf(buf, len, "CAL %s SP=", name);
+    n += fmt_cal(buf + n, (n < len)? len - n: 0, cal->sp[i]);
+    n += snprintf(buf + n, (n < len)? len - n: 0, " MP=");
+    n += fmt_cal(buf + n, (n < len)? len - n: 0, cal->mp_slope[i]);
+    n += snprintf(buf + n, (n < len)? len - n: 0, "*AVG+");
+    n += fmt_cal(buf + n, (n < len)? len - n: 0, cal->mp_base[i]);
+    n += snprintf(buf + n, (n < len)? len - n: 0, " HR=");
+    n += fmt_cal(buf + n, (n < len)? len - n: 0, cal->hr_slope[i]);
+    n += snprintf(buf + n, (n < len)? len - n: 0, "*AVG+");
+    n += fmt_cal(buf + n, (n < len)? len - n: 0, cal->hr_base[i]);
+    n += snprintf(buf + n, (n < len)? len - n: 0, "\n");
+    return (n < len)? n: len - 1;
+}
@@ -0,0 +1,53 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "measure.h"
+
+// Self-calibration of the PIO corrections
+// A clock output divided from clk_sys gives a square wave with a period of exactly
+// CAL_DIV cycles. It is looped back into the counting state machines of every channel
+// (their input pin is pointed to the clock output), and the offset between the true
+// interval avg*CAL_DIV and 2*clk_cnt is averaged per channel and program. picopet_sp
+// has a constant offset, picopet_mp and picopet_hr one linear in AVG_PERIODS, fitted
+// through two AVG_PERIODS. The table replaces the constants of pet_cor_offset().
+// No pico-sdk dependency, tools/petsim runs the same estimate in the PIO emulator.
+
+#define CAL_SCALE 16                    // table values in 1/16 clk_sys cycles
+#define CAL_DIV 9999                    // period of the loopback signal in clk_sys cycles, odd to average both count parities
+#define CAL_SAMPLES 64                  // values per channel and point, even
+#define CAL_POINTS 5
+
+struct CalPoint
+{
+    uint8_t capture;                    // PET_CAPTURE_PERIOD or PET_CAPTURE_INTERLEAVED
+    uint16_t avg_periods;
+};
+
+extern const struct CalPoint cal_points[CAL_POINTS];
+
+struct PetCal
+{
+    int32_t sp[PET_MAX_CHANNELS];       // picopet_sp offset
+    int32_t mp_slope[PET_MAX_CHANNELS]; // picopet_mp offset = mp_slope*AVG_PERIODS + mp_base
+    int32_t mp_base[PET_MAX_CHANNELS];
+    int32_t hr_slope[PET_MAX_CHANNELS]; // picopet_hr phase offset
+    int32_t hr_base[PET_MAX_CHANNELS];
+};
+
+struct CalRun
+{
+    int64_t sum[CAL_POINTS][PET_MAX_CHANNELS];      // sum of avg*CAL_DIV - 2*clk_cnt
+    uint32_t n[CAL_POINTS][PET_MAX_CHANNELS];
+};
+
+void cal_default(struct PetCal* cal);
+
+uint32_t cal_cor_offset(const struct PetCal* cal, uint8_t i, uint16_t avg_periods, uint8_t capture);
+
+void cal_run_init(struct CalRun* r);
+
+void cal_run_add(struct CalRun* r, uint8_t point, uint8_t i, uint32_t raw);
+
+bool cal_run_solve(const struct CalRun* r, uint8_t channels, struct PetCal* cal);
+
+uint8_t cal_format(char* buf, uint8_t len, const struct PetCal* cal, uint8_t i, const char* name);
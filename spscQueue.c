@@ -0,0 +1,43 @@
+#include "spscQueue.h"
+
+// NOTE: no pico-sdk dependency here, the queue is exercised by two threads on the host as well
+
+void spsc_init(struct SpscQueue* q) {
+    atomic_store_explicit(&q->head, 0, memory_order_relaxed);
+    atomic_store_explicit(&q->tail, 0, memory_order_relaxed);
+    q->high_water = 0;
+    q->dropped = 0;
+}
+
+bool spsc_push(struct SpscQueue* q, const struct PetRecord* r) {
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+    uint32_t level = head - tail;
+    if (level >= SPSC_RECORDS) {
+        q->dropped++;
+        return false;
+    }
+    q->rec[head & (SPSC_RECORDS - 1)] = *r;
+    // publish the record before the new head
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+    if (level + 1 > q->high_water) {
+        q->high_water = level + 1;
+    }
+    return true;
+}
+
+bool spsc_pop(struct SpscQueue* q, struct PetRecord* r) {
+    uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+    if (head == tail) {
+        return false;
+    }
+    *r = q->rec[tail & (SPSC_RECORDS - 1)];
+    // the slot may be reused by the producer only after we copied it
+    atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+uint32_t spsc_level(struct SpscQueue* q) {
+    return atomic_load_explicit(&q->head, memory_order_acquire) - atomic_load_explicit(&q->tail, memory_order_acquire);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+// Single producer single consumer lock-free queue
+// Core 0 (producer) pushes compact records of the drained PIO values, core 1 (consumer)
+// pops them for the arithmetic and output. Only the producer writes head and only the
+// consumer writes tail, so plain atomic loads/stores with acquire/release ordering are
+// enough (the M0+ has no exclusive load/store for read-modify-write atomics).
+
+#define SPSC_RECORDS 1024               // has to be power of 2
+
+#define REC_TIMESTAMP 0x01              // value_hi:value is an extended timestamp of picopet_ts
+#define REC_PHASE0 0x02                 // value of the phase0 state machine of interleaved capture
+#define REC_PHASE1 0x04                 // value of the phase1 state machine of interleaved capture
+#define REC_FALL 0x08                   // high time pushed on the falling edge by picopet_de
+#define REC_RISE 0x10                   // low time pushed on the rising edge by picopet_de
+
+struct PetRecord
+{
+    uint8_t channel;
+    uint8_t flags;
+    uint8_t epoch;                      // timebase epoch the value was counted in
+    uint8_t reserved;
+    uint32_t value;                     // raw value pushed by the counting SM
+    uint32_t value_hi;                  // upper word of an extended timestamp
+};
+
+struct SpscQueue
+{
+    struct PetRecord rec[SPSC_RECORDS];
+    _Atomic uint32_t head;              // total records pushed, written by producer only
+    _Atomic uint32_t tail;              // total records popped, written by consumer only
+    uint32_t high_water;                // max. number of records waiting, producer side
+    uint32_t dropped;                   // records not pushed because the queue was full, producer side
+};
+
+void spsc_init(struct SpscQueue* q);
+
+bool spsc_push(struct SpscQueue* q, const struct PetRecord* r);
+
+bool spsc_pop(struct SpscQueue* q, struct PetRecord* r);
+
+uint32_t spsc_level(struct SpscQueue* q);
@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+// Timebase epochs
+// Switching the reference clock changes clk_sys and with it the unit of every cycle count.
+// Core 0 tags each record with the epoch it was drained in (core 0 is paused while the
+// clock changes), core 1 converts the accumulated timescale to the new clock when the
+// first record of the next epoch arrives. No pico-sdk dependency, petdecode converts the
+// timemarks of a binary stream at a config frame with a new frequency the same way.
+
+#define TIMEBASE_EPOCHS 4               // clock frequencies remembered for the records in the queue, power of 2
+
+// cycles of a clock of freq from in cycles of freq to, rounded, no overflow for any 64bit count
+static inline uint64_t timebase_convert(uint64_t cycles, uint32_t from, uint32_t to) {
+    uint64_t q = cycles / from;
+    uint64_t r = cycles % from;
+    return q * to + (r * to + from/2) / from;
+}
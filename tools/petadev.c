@@ -0,0 +1,218 @@
+/*
+    petadev computes the Allan, Modified Allan and Time deviation of PicoPET timemarks
+    with the same streaming engine as the firmware (MODE STAB), so long runs recorded
+    as text can be analysed, and the engine can be checked against the offline formulas.
+
+    Usage: petadev [-r] [-s samples] [file]
+        -r  also compute the fully overlapping deviations directly from all timemarks
+            and print the relative difference to the streaming engine
+        -s  check the engine on synthetic timemarks instead (white PM and random walk FM
+            noise, 1 kHz, rounded to ns), implies -r; the fully overlapping taus have to
+            match the offline formulas (MDEV but for its first term), the decimated ones
+            within 4/sqrt(N) of their N terms. Exits with 1 if a tau is off.
+    Reads the TIMEMARK text output ("<seconds>\t <channel>" lines, e.g. from petdecode)
+    from stdin when no file given.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "allanDev.h"
+
+#define MAX_CHANNELS 16
+#define NS_FREQ 1000000000u             // timemarks are fed in nanoseconds
+
+struct Channel
+{
+    char name[16];
+    struct AllanDev adev;
+    uint64_t* tm;                       // all timemarks for -r
+    size_t count;
+    size_t size;
+};
+
+static struct Channel channels[MAX_CHANNELS];
+static uint8_t channel_count = 0;
+static int reference = 0;
+
+
+static double gauss() {
+    double u = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(u)) * cos(2 * M_PI * v);
+}
+
+static struct Channel* channel(const char* name) {
+    for (uint8_t i = 0; i < channel_count; i++) {
+        if (strcmp(channels[i].name, name) == 0) {
+            return &channels[i];
+        }
+    }
+    if (channel_count == MAX_CHANNELS) {
+        return NULL;
+    }
+    struct Channel* ch = &channels[channel_count++];
+    snprintf(ch->name, sizeof(ch->name), "%s", name);
+    adev_init(&ch->adev);
+    return ch;
+}
+
+// exact conversion of the printed seconds (up to 9 decimals) to nanoseconds
+static bool parse_ns(const char* s, uint64_t* ns) {
+    uint64_t ip = 0, frac = 0;
+    uint8_t digits = 0;
+    if (!isdigit((unsigned char)*s)) {
+        return false;
+    }
+    while (isdigit((unsigned char)*s)) {
+        ip = 10*ip + (*s++ - '0');
+    }
+    if (*s == '.') {
+        s++;
+        while (isdigit((unsigned char)*s) && digits < 9) {
+            frac = 10*frac + (*s++ - '0');
+            digits++;
+        }
+    }
+    while (digits++ < 9) {
+        frac *= 10;
+    }
+    *ns = ip * NS_FREQ + frac;
+    return true;
+}
+
+static void store(struct Channel* ch, uint64_t t) {
+    if (ch->count == ch->size) {
+        ch->size = (ch->size == 0)? 4096: 2*ch->size;
+        ch->tm = realloc(ch->tm, ch->size * sizeof(uint64_t));
+        if (ch->tm == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    ch->tm[ch->count++] = t;
+}
+
+// fully overlapping ADEV and MDEV straight from the definitions
+static void offline(const struct Channel* ch, uint32_t m, double* adev, double* mdev) {
+    const uint64_t* t = ch->tm;
+    size_t n = ch->count;
+    double tau0 = (double)(t[n-1] - t[0]) / (n - 1);
+    double sa = 0, sm = 0, w = 0;
+    size_t na = 0, nm = 0;
+    for (size_t i = 0; i + 2*m < n; i++) {
+        double d = (double)(int64_t)(t[i+2*m] - 2*t[i+m] + t[i]);
+        sa += d*d;
+        na++;
+        // running sum over m consecutive second differences
+        w += d;
+        if (i >= m) {
+            w -= (double)(int64_t)(t[i+m] - 2*t[i] + t[i-m]);
+        }
+        if (i + 1 >= m) {
+            sm += w*w;
+            nm++;
+        }
+    }
+    *adev = (na == 0)? 0: sqrt(sa / (2.0*na)) / (m * tau0);
+    *mdev = (nm == 0)? 0: sqrt(sm / (2.0*nm)) / ((double)m * m * tau0);
+}
+
+static bool report(const struct Channel* ch, bool check) {
+    bool ok = true;
+    struct AdevResult r;
+    printf("STAB %s N=%u TAU0=%.9e\n", ch->name, ch->adev.samples, adev_tau0(&ch->adev) / NS_FREQ);
+    printf(reference? "TAU\t ADEV\t MDEV\t TDEV\t N\t ADEV_REF\t MDEV_REF\t ADEV_DIFF\t MDEV_DIFF\n": "TAU\t ADEV\t MDEV\t TDEV\t N\n");
+    for (uint8_t k = 0; adev_result(&ch->adev, k, NS_FREQ, &r); k++) {
+        printf("%.4e\t %.4e\t %.4e\t %.4e\t %u", r.tau, r.adev, r.mdev, r.tdev, r.n);
+        if (reference) {
+            double adev, mdev;
+            offline(ch, ch->adev.tau[k].m, &adev, &mdev);
+            printf("\t %.4e\t %.4e\t %+.3f%%\t %+.3f%%", adev, mdev, 100*(r.adev/adev - 1), (mdev > 0)? 100*(r.mdev/mdev - 1): 0);
+            if (check) {
+                // level 0 sums the same terms as the formulas (MDEV without the first one, there is no
+                // prefix sum before the first sample), the levels above every 2^l-th of them
+                bool full = ch->adev.tau[k].level == 0;
+                double tol_adev = full? 1e-9: 4 / sqrt(r.n);
+                double tol_mdev = full? 1.0 / ch->adev.tau[k].n_mdev: 4 / sqrt(r.n);
+                bool tau_ok = fabs(r.adev/adev - 1) <= tol_adev && (mdev == 0 || fabs(r.mdev/mdev - 1) <= tol_mdev);
+                printf("\t %s", tau_ok? "OK": "FAIL");
+                ok = ok && tau_ok;
+            }
+        }
+        printf("\n");
+    }
+    return ok;
+}
+
+// timemarks of a 1 kHz signal in ns with white PM and random walk FM noise
+static void synthetic(struct Channel* ch, uint32_t samples) {
+    double y = 0, x = 0;
+    srand(1);
+    for (uint32_t k = 0; k < samples; k++) {
+        y += 1e-9 * gauss();
+        x += y * 1e6;
+        uint64_t t = 1000000000ull + (uint64_t)k * 1000000 + (int64_t)llround(x + 2.0 * gauss());
+        adev_add(&ch->adev, t);
+        store(ch, t);
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* fn = NULL;
+    uint32_t samples = 0;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-r") == 0) {
+            reference = 1;
+        } else if (strcmp(argv[a], "-s") == 0 && a+1 < argc) {
+            samples = strtoul(argv[++a], NULL, 0);
+            reference = 1;
+        } else if (argv[a][0] == '-' && argv[a][1] != '\0') {
+            fprintf(stderr, "Usage: %s [-r] [-s samples] [file]\n", argv[0]);
+            return 2;
+        } else {
+            fn = argv[a];
+        }
+    }
+    if (samples > 0) {
+        struct Channel* ch = channel("SIM");
+        synthetic(ch, samples);
+        bool ok = report(ch, true);
+        free(ch->tm);
+        return ok? 0: 1;
+    }
+    FILE* in = stdin;
+    if (fn != NULL && strcmp(fn, "-") != 0) {
+        in = fopen(fn, "r");
+        if (in == NULL) {
+            perror(fn);
+            return 1;
+        }
+    }
+
+    char line[256];
+    char name[64];
+    char ts[64];
+    while (fgets(line, sizeof(line), in) != NULL) {
+        uint64_t t;
+        // header and status lines do not start with a number
+        if (sscanf(line, "%63s %63s", ts, name) != 2 || !parse_ns(ts, &t)) {
+            continue;
+        }
+        struct Channel* ch = channel(name);
+        if (ch == NULL) {
+            continue;
+        }
+        adev_add(&ch->adev, t);
+        if (reference) {
+            store(ch, t);
+        }
+    }
+    for (uint8_t i = 0; i < channel_count; i++) {
+        report(&channels[i], false);
+        free(channels[i].tm);
+    }
+    return 0;
+}
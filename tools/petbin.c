@@ -0,0 +1,167 @@
+/*
+    petbin checks that the binary output (FORMAT BIN) decoded by petdecode prints the same
+    lines as the text output of the firmware for the same edges.
+
+    Usage: petbin [-d petdecode] [-k]
+        -d  path of petdecode, default ./petdecode
+        -k  keep the files of the cases (petbin<n>.txt, petbin<n>.bin)
+    Every case feeds the edges of two channels through measure.c twice, with FORMAT TEXT
+    and with FORMAT BIN, and compares the text with the output of petdecode:
+      - timestamp capture with ChB 150 ms after ChA, the shared timescale has to survive
+      - intervals of 2^32 cycles and more with period and timestamp capture
+      - TIMEMARK, FREQ and COUNT, AVG 1 and 10, a timebase switch in the middle (the
+        TIMEBASE line of the text output is a config frame in the binary one)
+    Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "measure.h"
+
+struct BinCase
+{
+    uint8_t mode;
+    uint8_t capture;
+    uint16_t avg;
+    double period[2];                   // of ChA and ChB in seconds
+    double offset;                      // first edge of ChB after the one of ChA in seconds
+    uint32_t edges;                     // per channel
+    uint32_t switch_freq;               // clk_sys after half of the edges, 0 for none
+};
+
+static FILE* out;
+
+static void write_file(const char* buf, uint16_t len, bool binary) {
+    fwrite(buf, 1, len, out);
+}
+
+// the edges of both channels in time order at 240 MHz, then at switch_freq
+static void feed(const struct BinCase* c, uint8_t format) {
+    static const char* const names[PET_MAX_CHANNELS] = {"ChA", "ChB", "ChC", "ChD"};
+    static struct PetMeasure m;
+    struct PetConfig cfg = {
+        .mode = c->mode,
+        .format = format,
+        .channels = 2,
+        .capture = c->capture,
+        .avg_periods = c->avg,
+        .hist_width = 1,
+    };
+    double freq = 240000000;
+    double switch_time = -1;            // seconds
+    uint64_t switch_cycles = 0;
+    measure_init(&m, &cfg, freq, names, write_file);
+    measure_header(&m);
+    uint32_t n[2] = {0, 0};
+    uint64_t last[2] = {0, 0};          // cycles of the last value of period capture
+    while (n[0] < c->edges || n[1] < c->edges) {
+        uint8_t i = (n[1] >= c->edges || (n[0] < c->edges && n[0] * c->period[0] <= c->offset + n[1] * c->period[1]))? 0: 1;
+        double t = 1e-3 + ((i == 0)? 0: c->offset) + n[i] * c->period[i];
+        if (c->switch_freq != 0 && switch_time < 0 && n[0] + n[1] >= c->edges) {
+            switch_time = t - 1e-6;
+            switch_cycles = (uint64_t)(switch_time * freq);
+            measure_set_clock(&m, c->switch_freq);
+        }
+        uint64_t cycles = (switch_time < 0)? (uint64_t)(t * freq): switch_cycles + (uint64_t)((t - switch_time) * c->switch_freq);
+        if (c->capture == PET_CAPTURE_TIMESTAMP) {
+            measure_timestamp(&m, i, cycles / 2);
+        } else if (n[i] > 0 && n[i] % c->avg == 0) {
+            // picopet_sp/mp count the avg periods since their last value
+            uint64_t counted = (cycles - last[i] - m.cor_offset[i]) / 2;
+            measure_count(&m, i, ~(uint32_t)counted);
+            last[i] = cycles;
+        } else if (n[i] == 0) {
+            last[i] = cycles;
+        }
+        n[i]++;
+    }
+}
+
+static bool compare(FILE* a, FILE* b, char* first_diff, size_t len) {
+    char la[256], lb[256];
+    for (uint32_t line = 1; ; line++) {
+        char* ra = fgets(la, sizeof(la), a);
+        while (ra != NULL && strncmp(la, "TIMEBASE ", 9) == 0) {
+            ra = fgets(la, sizeof(la), a);      // a config frame in the binary output, petdecode prints nothing
+        }
+        char* rb = fgets(lb, sizeof(lb), b);
+        if (ra == NULL || rb == NULL) {
+            if (ra != rb) {
+                snprintf(first_diff, len, "line %u: one output ends early", line);
+            }
+            return ra == rb;
+        }
+        if (strcmp(la, lb) != 0) {
+            la[strcspn(la, "\n")] = '\0';
+            lb[strcspn(lb, "\n")] = '\0';
+            snprintf(first_diff, len, "line %u: text \"%s\" decoded \"%s\"", line, la, lb);
+            return false;
+        }
+    }
+}
+
+static bool check(uint8_t k, const struct BinCase* c, const char* decoder, bool keep) {
+    static const char* capture_names[] = {"PERIOD", "TS", "HR", "EDGE"};
+    char txt[64], bin[64], cmd[1024], diff[600] = "";
+    snprintf(txt, sizeof(txt), "petbin%u.txt", k);
+    snprintf(bin, sizeof(bin), "petbin%u.bin", k);
+    out = fopen(txt, "w");
+    feed(c, PET_FORMAT_TEXT);
+    fclose(out);
+    out = fopen(bin, "wb");
+    feed(c, PET_FORMAT_BINARY);
+    fclose(out);
+    snprintf(cmd, sizeof(cmd), "%s %s 2>/dev/null", decoder, bin);
+    FILE* text = fopen(txt, "r");
+    FILE* decoded = popen(cmd, "r");
+    bool ok = text != NULL && decoded != NULL && compare(text, decoded, diff, sizeof(diff));
+    if (text != NULL) {
+        fclose(text);
+    }
+    ok = (decoded != NULL && pclose(decoded) == 0) && ok;
+    if (!keep) {
+        remove(txt);
+        remove(bin);
+    }
+    printf("%-8s CAPTURE %-6s AVG %-3u periods %g %g s offset %g s%s  %s%s%s\n", measure_mode_name(c->mode), capture_names[c->capture], c->avg,
+        c->period[0], c->period[1], c->offset, c->switch_freq? " switch": "", ok? "OK": "FAIL", ok? "": ", ", diff);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* decoder = "./petdecode";
+    bool keep = false;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-d") == 0 && a+1 < argc) {
+            decoder = argv[++a];
+        } else if (strcmp(argv[a], "-k") == 0) {
+            keep = true;
+        } else {
+            fprintf(stderr, "Usage: %s [-d petdecode] [-k]\n", argv[0]);
+            return 2;
+        }
+    }
+    static const struct BinCase cases[] = {
+        {PET_MODE_TIMEMARK, PET_CAPTURE_TIMESTAMP, 1, {1, 1}, 0.150, 20, 0},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_TIMESTAMP, 10, {1e-3, 1.3e-3}, 0.150, 2000, 0},
+        {PET_MODE_FREQUENCY, PET_CAPTURE_TIMESTAMP, 1, {1e-3, 1.3e-3}, 0.150, 1000, 0},
+        {PET_MODE_CYCLE_COUNT, PET_CAPTURE_TIMESTAMP, 1, {1e-3, 1.3e-3}, 0.150, 1000, 0},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_TIMESTAMP, 10, {2.5, 3}, 0.150, 40, 0},
+        {PET_MODE_FREQUENCY, PET_CAPTURE_TIMESTAMP, 10, {2.5, 3}, 0.150, 40, 0},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_TIMESTAMP, 1, {1e-3, 1.3e-3}, 0.150, 1000, 200000000},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_PERIOD, 1, {1e-3, 1.3e-3}, 0.150, 1000, 0},
+        {PET_MODE_FREQUENCY, PET_CAPTURE_PERIOD, 10, {1e-3, 1.3e-3}, 0.150, 1000, 0},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_PERIOD, 1, {20, 25}, 0.150, 10, 0},
+        {PET_MODE_FREQUENCY, PET_CAPTURE_PERIOD, 1, {20, 25}, 0.150, 10, 0},
+        {PET_MODE_CYCLE_COUNT, PET_CAPTURE_PERIOD, 1, {20, 25}, 0.150, 10, 0},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_PERIOD, 1, {1e-3, 1.3e-3}, 0.150, 1000, 200000000},
+    };
+    uint32_t failed = 0, cases_run = 0;
+    for (uint8_t k = 0; k < sizeof(cases)/sizeof(cases[0]); k++) {
+        failed += !check(k, &cases[k], decoder, keep);
+        cases_run++;
+    }
+    printf("%u of %u cases failed\n", failed, cases_run);
+    return (failed == 0)? 0: 1;
+}
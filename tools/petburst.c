@@ -0,0 +1,213 @@
+/*
+    petburst checks the triggered burst capture of the firmware (burst.c) as core 0 feeds it:
+    the raw values of every counting SM in turns, the trigger taken with the next value.
+
+    Usage: petburst
+    Every case arms a burst, feeds values of known index to each slot and reads the burst
+    back with burst_words()/burst_word(), the values have to be the ones fed from pre before
+    to post after the trigger of each slot, fewer if there was less history:
+      fire       BURST FIRE after a long history (the slots wrapped) and after a short one
+      above      period capture, the first interval above the threshold on one slot triggers,
+                 the crossing value is the first post-trigger one; one at the threshold does not
+      below      the same for an interval below the threshold
+      timestamp  timestamp capture, the interval is the difference of two timestamps, the
+                 first value of a slot never triggers
+      stop       stopped while triggered with only part of the post values, the history
+                 older than pre is not returned; stopped while armed it is off
+      sms        two SMs per channel (interleaved capture), slot = channel * sms + SM
+      arm        pre + post over the arena and post 0 are rejected
+    Values fed after the burst is done are ignored. Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "burst.h"
+
+#define ARENA_WORDS 4096
+#define MAX_VALUES 10000
+
+static uint32_t arena[ARENA_WORDS];
+static struct Burst b;
+static uint32_t fed[BURST_MAX_SLOTS][MAX_VALUES];       // every value fed to the slot
+static uint32_t fed_count[BURST_MAX_SLOTS];
+static uint32_t trig_index[BURST_MAX_SLOTS];            // index of the first post-trigger value
+static bool triggered;
+
+static void reset() {
+    burst_init(&b, arena, ARENA_WORDS);
+    memset(fed_count, 0, sizeof(fed_count));
+    triggered = false;
+}
+
+static bool arm(uint8_t channels, uint8_t sms, bool timestamps, uint16_t pre, uint16_t post, uint8_t trig, uint32_t threshold) {
+    reset();
+    return burst_arm(&b, channels, sms, timestamps, pre, post, trig, threshold);
+}
+
+// one raw value of the slot, the index of the trigger is noted when the state changes
+static void add(uint8_t slot, uint32_t word) {
+    uint8_t before = atomic_load(&b.state);
+    uint32_t counts[BURST_MAX_SLOTS];
+    memcpy(counts, fed_count, sizeof(counts));
+    burst_add(&b, slot, word);
+    fed[slot][fed_count[slot]++] = word;
+    if (before == BURST_ARMED && atomic_load(&b.state) != BURST_ARMED) {
+        memcpy(trig_index, counts, sizeof(trig_index));
+        triggered = true;
+    }
+}
+
+// period capture value of cycles, the SMs count down
+static uint32_t period(uint32_t cycles) {
+    return ~(cycles / 2);
+}
+
+// n values per slot in turns, interval cycles, tag makes every value unique
+static void feed(uint32_t n, uint32_t cycles) {
+    for (uint32_t k = 0; k < n; k++) {
+        for (uint8_t s = 0; s < b.slots; s++) {
+            add(s, period(cycles + 2 * ((fed_count[s] + 7 * s) % 100)));
+        }
+    }
+}
+
+// the burst of every slot against the values fed, expect_n values each, -1 for pre + post
+static bool verify(int32_t expect_n, int32_t expect_first, char* why, size_t len) {
+    if (!triggered) {
+        snprintf(why, len, "not triggered");
+        return false;
+    }
+    for (uint8_t s = 0; s < b.slots; s++) {
+        int32_t first;
+        uint32_t n = burst_words(&b, s, &first);
+        int32_t want_n = (expect_n < 0)? b.pre + b.post: expect_n;
+        if ((int32_t)n != want_n || first != expect_first) {
+            snprintf(why, len, "slot %u: %u values from %d, expected %d from %d", s, n, first, want_n, expect_first);
+            return false;
+        }
+        for (int32_t k = first; k < first + (int32_t)n; k++) {
+            if (burst_word(&b, s, k) != fed[s][trig_index[s] + k]) {
+                snprintf(why, len, "slot %u: value %d is not the one fed", s, k);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool report(const char* name, bool ok, const char* why) {
+    printf("%-10s %s%s%s\n", name, ok? "OK": "FAIL", ok? "": ", ", why);
+    return ok;
+}
+
+static bool check_fire(uint32_t history) {
+    char why[128] = "", name[32];
+    snprintf(name, sizeof(name), "fire %u", history);
+    bool ok = arm(3, 1, false, 100, 50, BURST_TRIG_CMD, 0);
+    feed(history, 1000);
+    burst_fire(&b);
+    ok = ok && atomic_load(&b.state) == BURST_ARMED;    // taken with the next value
+    feed(49, 1000);
+    add(0, period(1000));
+    ok = ok && atomic_load(&b.state) == BURST_TRIGGERED;
+    feed(10, 1000);
+    ok = ok && atomic_load(&b.state) == BURST_DONE;
+    uint32_t have = (history < 100)? history: 100;
+    // slot 0 took the trigger, the others had their history up to it
+    ok = ok && trig_index[0] == history && trig_index[1] == history && verify(have + 50, -(int32_t)have, why, sizeof(why));
+    return report(name, ok, why);
+}
+
+static bool check_threshold(uint8_t trig) {
+    char why[128] = "";
+    uint32_t normal = 1000, cross = (trig == BURST_TRIG_ABOVE)? 3000: 400, threshold = (trig == BURST_TRIG_ABOVE)? 2000: 500;
+    bool ok = arm(2, 1, false, 20, 30, trig, threshold);
+    for (uint32_t k = 0; k < 300; k++) {
+        add(0, period(normal + 2 * (k % 50)));
+        add(1, period((k == 100)? threshold: (k == 200)? cross: normal));
+    }
+    // at the threshold nothing happens, the crossing value of slot 1 triggers
+    ok = ok && b.trig_slot == 1 && trig_index[1] == 200 && trig_index[0] == 201 && atomic_load(&b.state) == BURST_DONE;
+    ok = ok && verify(-1, -20, why, sizeof(why)) && burst_word(&b, 1, 0) == period(cross);
+    return report((trig == BURST_TRIG_ABOVE)? "above": "below", ok, why);
+}
+
+static bool check_timestamp() {
+    char why[128] = "";
+    bool ok = arm(2, 1, true, 10, 10, BURST_TRIG_ABOVE, 5000);
+    // the first timestamps are far apart, they start the intervals only
+    uint32_t ticks[2] = {100000, 7000000};
+    for (uint32_t k = 0; k < 100; k++) {
+        for (uint8_t s = 0; s < 2; s++) {
+            ticks[s] += (s == 0 && k == 60)? 3000: 1000;    // 6000 cycles
+            add(s, ~ticks[s]);
+        }
+    }
+    ok = ok && b.trig_slot == 0 && trig_index[0] == 60 && trig_index[1] == 60 && atomic_load(&b.state) == BURST_DONE;
+    ok = ok && verify(-1, -10, why, sizeof(why));
+    return report("timestamp", ok, why);
+}
+
+static bool check_stop() {
+    char why[128] = "";
+    // 100 values of history in slots of 20, then 5 of the 10 post values
+    bool ok = arm(2, 1, false, 10, 10, BURST_TRIG_CMD, 0);
+    feed(100, 1000);
+    burst_fire(&b);
+    feed(5, 1000);
+    ok = ok && atomic_load(&b.state) == BURST_TRIGGERED;
+    burst_stop(&b);
+    ok = ok && atomic_load(&b.state) == BURST_DONE && verify(15, -10, why, sizeof(why));
+    feed(10, 1000);                     // ignored once done
+    ok = ok && verify(15, -10, why, sizeof(why));
+    // stopped while armed
+    ok = arm(2, 1, false, 10, 10, BURST_TRIG_CMD, 0) && ok;
+    feed(30, 1000);
+    burst_stop(&b);
+    ok = ok && atomic_load(&b.state) == BURST_OFF;
+    return report("stop", ok, why);
+}
+
+static bool check_sms() {
+    char why[128] = "";
+    bool ok = arm(4, 2, false, 64, 64, BURST_TRIG_BELOW, 500);
+    ok = ok && b.slots == 8;
+    for (uint32_t k = 0; k < 500; k++) {
+        for (uint8_t s = 0; s < 8; s++) {
+            add(s, period((s == 5 && k == 300)? 300: 1000 + s));
+        }
+    }
+    ok = ok && b.trig_slot == 5 && trig_index[5] == 300 && trig_index[4] == 301 && trig_index[6] == 300;
+    ok = ok && verify(-1, -64, why, sizeof(why));
+    return report("sms", ok, why);
+}
+
+static bool check_arm() {
+    reset();
+    bool ok = burst_max_words(&b, 4) == ARENA_WORDS / 4;
+    ok = ok && !burst_arm(&b, 4, 1, false, ARENA_WORDS / 4 - 9, 10, BURST_TRIG_CMD, 0);
+    ok = ok && burst_arm(&b, 4, 1, false, ARENA_WORDS / 4 - 10, 10, BURST_TRIG_CMD, 0);
+    ok = ok && !burst_arm(&b, 2, 1, false, 10, 0, BURST_TRIG_CMD, 0);
+    ok = ok && !burst_arm(&b, 5, 2, false, 10, 10, BURST_TRIG_CMD, 0);
+    return report("arm", ok, "");
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        fprintf(stderr, "Usage: %s\n", argv[0]);
+        return 2;
+    }
+    uint32_t failed = 0, cases = 0;
+    failed += !check_fire(1000);
+    failed += !check_fire(30);
+    failed += !check_threshold(BURST_TRIG_ABOVE);
+    failed += !check_threshold(BURST_TRIG_BELOW);
+    failed += !check_timestamp();
+    failed += !check_stop();
+    failed += !check_sms();
+    failed += !check_arm();
+    cases += 8;
+    printf("%u of %u cases failed\n", failed, cases);
+    return (failed == 0)? 0: 1;
+}
@@ -0,0 +1,395 @@
+/*
+    petcmd checks the command interface (petCmd.c) and the mode dispatch of the measurement
+    engine (measure.c) on the host.
+
+    Usage: petcmd [-v]
+        -v  print every case, not only the failed ones
+    The command cases feed lines character by character through cmd_feed() as they come
+    from the link and check the result flags and the configuration: every command with
+    valid arguments, out of range and malformed arguments, and the combinations of
+    commands cmd_config_valid() has to reject. A rejected line must leave the
+    configuration untouched. cmd_config_valid() is also checked with every field out of
+    range, as a configuration read back from flash may have it.
+    The dispatch cases set every mode, format, gate and UTC combination and check which
+    processing routine (and falling edge routine) measure_set_config() selects. measure.c
+    is included here, so its static routines can be compared with m->process.
+    Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "petCmd.h"
+#include "burst.h"
+#include "measure.c"
+
+static const struct PetConfig base = {
+    .mode = PET_MODE_TIMEMARK,
+    .format = PET_FORMAT_TEXT,
+    .channels = 4,
+    .capture = PET_CAPTURE_PERIOD,
+    .avg_periods = 1,
+    .gate_ms = 0,
+    .tic_ref = 0,
+    .utc = 0,
+    .div_freq = 0,
+    .hist_width = 1,
+    .hist_value = PET_HIST_PERIOD,
+    .burst_pre = 256,
+    .burst_post = 1024,
+    .burst_trig = BURST_TRIG_CMD,
+    .burst_cycles = 0,
+};
+
+static bool verbose = false;
+static uint32_t failed = 0, cases = 0;
+static struct CmdParser parser;
+static struct PetConfig cfg;
+
+static void report(bool ok, const char* what, const char* detail) {
+    cases++;
+    failed += !ok;
+    if (!ok || verbose) {
+        printf("%s %s%s%s\n", ok? "OK  ": "FAIL", what, (detail != NULL)? " -> ": "", (detail != NULL)? detail: "");
+    }
+}
+
+// feeds the line and its line end to a configuration start, returns the result of the line end
+static uint16_t feed(const char* line, const struct PetConfig* start) {
+    cfg = *start;
+    uint16_t res = CMD_NONE;
+    for (const char* c = line; *c; c++) {
+        res |= cmd_feed(&parser, *c, &cfg);
+    }
+    if (res != CMD_NONE) {
+        return 0xffff;                  // no result before the line end
+    }
+    return cmd_feed(&parser, '\n', &cfg);
+}
+
+static bool same(const struct PetConfig* a, const struct PetConfig* b) {
+    return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+// the command is accepted with res and cond holds for the new configuration
+#define ACCEPT_FROM(start, line, res, cond) do { \
+        uint16_t r = feed(line, start); \
+        report(r == (res) && (cond), line, (r & CMD_ERROR)? parser.error: NULL); \
+    } while (0)
+#define ACCEPT(line, res, cond) ACCEPT_FROM(&base, line, res, cond)
+
+// the command is rejected and the configuration unchanged
+#define REJECT_FROM(start, line) do { \
+        uint16_t r = feed(line, start); \
+        report(r == CMD_ERROR && parser.error != NULL && same(&cfg, start), line, (r & CMD_ERROR)? parser.error: "accepted"); \
+    } while (0)
+#define REJECT(line) REJECT_FROM(&base, line)
+
+static void check_commands() {
+    struct PetConfig from = base;
+    for (uint8_t mode = 0; mode < PET_MODES; mode++) {
+        char line[CMD_LINE_LEN];
+        snprintf(line, sizeof(line), "MODE %s", measure_mode_name(mode));
+        from.capture = (mode == PET_MODE_TIC)? PET_CAPTURE_TIMESTAMP: (mode == PET_MODE_WIDTH || mode == PET_MODE_DUTY)? PET_CAPTURE_EDGES:
+            PET_CAPTURE_PERIOD;
+        ACCEPT_FROM(&from, line, CMD_CHANGED, cfg.mode == mode);
+    }
+    ACCEPT("mode freq", CMD_CHANGED, cfg.mode == PET_MODE_FREQUENCY);
+    ACCEPT("  MODE\tCOUNT  ", CMD_CHANGED, cfg.mode == PET_MODE_CYCLE_COUNT);
+    REJECT("MODE");
+    REJECT("MODE PHASE");
+
+    ACCEPT("FORMAT TEXT", CMD_CHANGED, cfg.format == PET_FORMAT_TEXT);
+    ACCEPT("FORMAT BIN", CMD_CHANGED, cfg.format == PET_FORMAT_BINARY);
+    ACCEPT("FORMAT RAW", CMD_CHANGED, cfg.format == PET_FORMAT_RAW);
+    REJECT("FORMAT HEX");
+
+    ACCEPT("AVG 1", CMD_RELOAD, cfg.avg_periods == 1);
+    ACCEPT("AVG 10000", CMD_RELOAD, cfg.avg_periods == PET_MAX_AVG_PERIODS);
+    REJECT("AVG 0");
+    REJECT("AVG 10001");
+    REJECT("AVG 5X");
+    REJECT("AVG");
+
+    ACCEPT("CH 1", CMD_RELOAD, cfg.channels == 1);
+    ACCEPT("CH 4", CMD_RELOAD, cfg.channels == PET_MAX_CHANNELS);
+    REJECT("CH 0");
+    REJECT("CH 5");
+
+    ACCEPT("GATE 0", CMD_CHANGED, cfg.gate_ms == 0);
+    ACCEPT("GATE 60000", CMD_CHANGED, cfg.gate_ms == PET_MAX_GATE_MS);
+    REJECT("GATE 60001");
+    REJECT("GATE -1");
+
+    ACCEPT("CAPTURE PERIOD", CMD_RELOAD, cfg.capture == PET_CAPTURE_PERIOD);
+    ACCEPT("CAPTURE TS", CMD_RELOAD, cfg.capture == PET_CAPTURE_TIMESTAMP);
+    ACCEPT("CAPTURE HR", CMD_RELOAD, cfg.capture == PET_CAPTURE_INTERLEAVED);
+    ACCEPT("CAPTURE EDGE", CMD_RELOAD, cfg.capture == PET_CAPTURE_EDGES);
+    REJECT("CAPTURE DMA");
+
+    ACCEPT("REF A", CMD_CHANGED, cfg.tic_ref == 0);
+    ACCEPT("REF D", CMD_CHANGED, cfg.tic_ref == 3);
+    REJECT("REF E");
+
+    ACCEPT("UTC ON", CMD_CHANGED, cfg.utc == 1);
+    ACCEPT("UTC OFF", CMD_CHANGED, cfg.utc == 0);
+    REJECT("UTC 1");
+
+    ACCEPT("HIST PERIOD", CMD_CHANGED, cfg.hist_value == PET_HIST_PERIOD);
+    ACCEPT("HIST TIE", CMD_CHANGED, cfg.hist_value == PET_HIST_TIE);
+    REJECT("HIST MTIE");
+
+    ACCEPT("BINW 1", CMD_CHANGED, cfg.hist_width == 1);
+    ACCEPT("BINW 65535", CMD_CHANGED, cfg.hist_width == 65535);
+    REJECT("BINW 0");
+    REJECT("BINW 65536");
+
+    ACCEPT("DIV 1", CMD_CHANGED, cfg.div_freq == 1);
+    ACCEPT("DIV 12000000", CMD_CHANGED, cfg.div_freq == CMD_MAX_DIV_FREQ);
+    from = base;
+    from.div_freq = 1000;
+    ACCEPT_FROM(&from, "DIV SW", CMD_CHANGED, cfg.div_freq == 0);
+    REJECT("DIV 0");
+    REJECT("DIV 12000001");
+
+    ACCEPT("BURST", CMD_BURST, parser.burst == CMD_BURST_STATUS && same(&cfg, &base));
+    ACCEPT("BURST ARM", CMD_BURST, parser.burst == CMD_BURST_ARM);
+    ACCEPT("BURST FIRE", CMD_BURST, parser.burst == CMD_BURST_FIRE);
+    ACCEPT("BURST DUMP", CMD_BURST, parser.burst == CMD_BURST_DUMP);
+    ACCEPT("BURST OFF", CMD_BURST, parser.burst == CMD_BURST_OFF);
+    ACCEPT("BURST 100", CMD_BURST, parser.burst == CMD_BURST_STATUS && cfg.burst_post == 100 && cfg.burst_pre == base.burst_pre);
+    ACCEPT("BURST 100 0", CMD_BURST, cfg.burst_post == 100 && cfg.burst_pre == 0);
+    ACCEPT("BURST 65535 65535", CMD_BURST, cfg.burst_post == 65535 && cfg.burst_pre == 65535);
+    REJECT("BURST 0");
+    REJECT("BURST 100 X");
+    REJECT("BURST 100 65536");
+    REJECT("BURST KEEP");
+
+    ACCEPT("TRIG CMD", CMD_BURST, cfg.burst_trig == BURST_TRIG_CMD && cfg.burst_cycles == 0);
+    ACCEPT("TRIG GPIO", CMD_BURST, cfg.burst_trig == BURST_TRIG_GPIO && cfg.burst_cycles == 0);
+    ACCEPT("TRIG ABOVE 1000", CMD_BURST, cfg.burst_trig == BURST_TRIG_ABOVE && cfg.burst_cycles == 1000);
+    ACCEPT("TRIG BELOW 4294967295", CMD_BURST, cfg.burst_trig == BURST_TRIG_BELOW && cfg.burst_cycles == UINT32_MAX);
+    from = base;
+    from.burst_trig = BURST_TRIG_ABOVE;
+    from.burst_cycles = 1000;
+    ACCEPT_FROM(&from, "TRIG GPIO", CMD_BURST, cfg.burst_trig == BURST_TRIG_GPIO && cfg.burst_cycles == 0);
+    REJECT("TRIG ABOVE");
+    REJECT("TRIG BELOW 0");
+    REJECT("TRIG EDGE");
+
+    ACCEPT("CONFIG", CMD_QUERY, same(&cfg, &base));
+    ACCEPT("PIO", CMD_QUERY_PIO, same(&cfg, &base));
+    ACCEPT("STAB", CMD_QUERY_STAB, same(&cfg, &base));
+    ACCEPT("STATUS", CMD_QUERY_STATUS, same(&cfg, &base));
+    ACCEPT("CAL", CMD_CALIBRATE, !parser.use_default);
+    ACCEPT("CAL DEFAULT", CMD_CALIBRATE, parser.use_default);
+    REJECT("CAL NOW");
+    ACCEPT("BENCH", CMD_BENCH, same(&cfg, &base));
+    ACCEPT("SAVE", CMD_SAVE | CMD_QUERY, !parser.use_default && same(&cfg, &base));
+    ACCEPT("SAVE DEFAULT", CMD_SAVE | CMD_QUERY, parser.use_default);
+    REJECT("SAVE ALL");
+
+    ACCEPT("", CMD_NONE, same(&cfg, &base));
+    ACCEPT(" \t", CMD_NONE, same(&cfg, &base));
+    REJECT("FREQ");
+    char longline[CMD_LINE_LEN + 8];
+    memset(longline, 'A', sizeof(longline) - 1);
+    longline[sizeof(longline) - 1] = '\0';
+    memcpy(longline, "MODE FREQ ", 10);
+    REJECT(longline);
+    ACCEPT("MODE FREQ", CMD_CHANGED, cfg.mode == PET_MODE_FREQUENCY);       // the parser is usable again after it
+
+    // combinations, the command that breaks it is rejected whichever comes first
+    from = base;
+    REJECT("MODE TIC");
+    REJECT("MODE WIDTH");
+    REJECT("MODE DUTY");
+    from.capture = PET_CAPTURE_TIMESTAMP;
+    ACCEPT_FROM(&from, "MODE TIC", CMD_CHANGED, cfg.mode == PET_MODE_TIC);
+    REJECT_FROM(&from, "MODE WIDTH");
+    from.mode = PET_MODE_TIC;
+    REJECT_FROM(&from, "CAPTURE PERIOD");
+    REJECT_FROM(&from, "CAPTURE HR");
+    REJECT_FROM(&from, "CAPTURE EDGE");
+    from = base;
+    from.capture = PET_CAPTURE_EDGES;
+    ACCEPT_FROM(&from, "MODE WIDTH", CMD_CHANGED, cfg.mode == PET_MODE_WIDTH);
+    ACCEPT_FROM(&from, "MODE DUTY", CMD_CHANGED, cfg.mode == PET_MODE_DUTY);
+    REJECT_FROM(&from, "MODE TIC");
+    from.mode = PET_MODE_DUTY;
+    REJECT_FROM(&from, "CAPTURE TS");
+    REJECT_FROM(&from, "CAPTURE PERIOD");
+    // the reference channel has to be active, TIC needs a stop channel besides it
+    from = base;
+    from.channels = 2;
+    REJECT_FROM(&from, "REF C");
+    REJECT_FROM(&from, "REF D");
+    ACCEPT_FROM(&from, "REF B", CMD_CHANGED, cfg.tic_ref == 1);
+    from.tic_ref = 1;
+    REJECT_FROM(&from, "CH 1");
+    ACCEPT_FROM(&from, "CH 3", CMD_RELOAD, cfg.channels == 3);
+    from = base;
+    from.tic_ref = 3;
+    REJECT_FROM(&from, "CH 3");
+    from = base;
+    from.capture = PET_CAPTURE_TIMESTAMP;
+    from.channels = 1;
+    REJECT_FROM(&from, "MODE TIC");
+    from.channels = 2;
+    ACCEPT_FROM(&from, "MODE TIC", CMD_CHANGED, cfg.mode == PET_MODE_TIC);
+    from.mode = PET_MODE_TIC;
+    REJECT_FROM(&from, "CH 1");
+    REJECT_FROM(&from, "REF C");
+    ACCEPT_FROM(&from, "REF B", CMD_CHANGED, cfg.tic_ref == 1);
+    // binary FREQ output has no gate
+    from = base;
+    from.mode = PET_MODE_FREQUENCY;
+    from.format = PET_FORMAT_BINARY;
+    REJECT_FROM(&from, "GATE 1000");
+    ACCEPT_FROM(&from, "GATE 0", CMD_CHANGED, cfg.gate_ms == 0);
+    from.format = PET_FORMAT_TEXT;
+    from.gate_ms = 1000;
+    REJECT_FROM(&from, "FORMAT BIN");
+    ACCEPT_FROM(&from, "FORMAT RAW", CMD_CHANGED, cfg.format == PET_FORMAT_RAW);
+    from.mode = PET_MODE_TIMEMARK;
+    from.format = PET_FORMAT_BINARY;
+    REJECT_FROM(&from, "MODE FREQ");
+    ACCEPT_FROM(&from, "MODE OMEGA", CMD_CHANGED, cfg.mode == PET_MODE_OMEGA);
+}
+
+// every field of the configuration out of range, as read back from flash
+static void check_valid() {
+    report(cmd_config_valid(&base), "valid base configuration", NULL);
+    struct PetConfig c;
+#define INVALID(field, value) do { c = base; c.field = value; report(!cmd_config_valid(&c), "invalid " #field " = " #value, NULL); } while (0)
+    INVALID(mode, PET_MODES);
+    INVALID(format, 3);
+    INVALID(channels, 0);
+    INVALID(channels, PET_MAX_CHANNELS + 1);
+    INVALID(capture, PET_CAPTURES);
+    INVALID(avg_periods, 0);
+    INVALID(avg_periods, PET_MAX_AVG_PERIODS + 1);
+    INVALID(gate_ms, PET_MAX_GATE_MS + 1);
+    INVALID(tic_ref, PET_MAX_CHANNELS);
+    INVALID(utc, 2);
+    INVALID(div_freq, CMD_MAX_DIV_FREQ + 1);
+    INVALID(hist_width, 0);
+    INVALID(hist_value, 2);
+    INVALID(burst_post, 0);
+    INVALID(burst_trig, 4);
+    INVALID(mode, PET_MODE_TIC);
+    INVALID(mode, PET_MODE_WIDTH);
+    INVALID(mode, PET_MODE_DUTY);
+#undef INVALID
+    c = base;
+    c.channels = 2;
+    c.tic_ref = 2;
+    report(!cmd_config_valid(&c), "invalid tic_ref = channels", NULL);
+    c = base;
+    c.mode = PET_MODE_TIC;
+    c.capture = PET_CAPTURE_TIMESTAMP;
+    c.channels = 1;
+    report(!cmd_config_valid(&c), "invalid MODE TIC with channels = 1", NULL);
+    c = base;
+    c.mode = PET_MODE_FREQUENCY;
+    c.format = PET_FORMAT_BINARY;
+    c.gate_ms = 1000;
+    report(!cmd_config_valid(&c), "invalid MODE FREQ FORMAT BIN with gate_ms > 0", NULL);
+    char line[160];
+    cmd_format_config(line, sizeof(line), &base);
+    report(strcmp(line, "CONFIG MODE=TIMEMARK FORMAT=TEXT AVG=1 GATE=0 CH=4 CAPTURE=PERIOD REF=A UTC=OFF DIV=SW HIST=PERIOD BINW=1\n") == 0,
+        "CONFIG line", NULL);
+}
+
+static void write_none(const char* buf, uint16_t len, bool binary) {
+}
+
+static const char* routine_name(pet_process_fn fn) {
+    static const struct { pet_process_fn fn; const char* name; } routines[] = {
+        {process_timemark, "process_timemark"}, {process_utc_timemark, "process_utc_timemark"},
+        {process_fall_timemark, "process_fall_timemark"}, {process_utc_fall_timemark, "process_utc_fall_timemark"},
+        {process_frequency, "process_frequency"}, {process_gated_frequency, "process_gated_frequency"},
+        {process_cycle_count, "process_cycle_count"}, {process_binary, "process_binary"}, {process_omega, "process_omega"},
+        {process_tic, "process_tic"}, {process_width, "process_width"}, {process_duty, "process_duty"},
+        {process_none, "process_none"}, {process_stability, "process_stability"}, {process_hist, "process_hist"},
+    };
+    for (uint8_t k = 0; k < sizeof(routines)/sizeof(routines[0]); k++) {
+        if (routines[k].fn == fn) {
+            return routines[k].name;
+        }
+    }
+    return "unknown";
+}
+
+// the routine measure_set_config() has to select
+static pet_process_fn expected_process(const struct PetConfig* c, bool anchored) {
+    static const pet_process_fn text_only[] = {NULL, NULL, NULL, process_stability, process_omega, process_tic, process_hist,
+        process_width, process_duty};   // PET_MODE_STABILITY and up
+    if (c->format == PET_FORMAT_RAW) {
+        return process_none;
+    } else if (c->mode >= PET_MODE_STABILITY) {
+        return text_only[c->mode];
+    } else if (c->format == PET_FORMAT_BINARY) {
+        return process_binary;          // never gated, cmd_config_valid() rejects FREQ with a gate
+    } else if (c->mode == PET_MODE_FREQUENCY) {
+        return (c->gate_ms > 0)? process_gated_frequency: process_frequency;
+    } else if (c->mode == PET_MODE_CYCLE_COUNT) {
+        return process_cycle_count;
+    }
+    return (c->utc && anchored)? process_utc_timemark: process_timemark;
+}
+
+static void check_dispatch() {
+    static const char* const names[PET_MAX_CHANNELS] = {"ChA", "ChB", "ChC", "ChD"};
+    static struct PetMeasure m;
+    for (uint8_t mode = 0; mode < PET_MODES; mode++) {
+        for (uint8_t format = 0; format < 3; format++) {
+            for (uint8_t gate = 0; gate < 2; gate++) {
+                for (uint8_t utc = 0; utc < 4; utc++) {
+                    struct PetConfig c = base;
+                    c.mode = mode;
+                    c.format = format;
+                    c.gate_ms = gate? 1000: 0;
+                    c.utc = utc & 1;
+                    c.capture = (mode == PET_MODE_TIC)? PET_CAPTURE_TIMESTAMP: (mode == PET_MODE_WIDTH || mode == PET_MODE_DUTY)?
+                        PET_CAPTURE_EDGES: PET_CAPTURE_PERIOD;
+                    bool anchored = utc & 2;
+                    if (!cmd_config_valid(&c)) {
+                        continue;               // FREQ with a gate and binary output can not be set
+                    }
+                    measure_init(&m, &c, 240000000, names, write_none);
+                    if (anchored) {
+                        // the anchor needs an edge of the reference channel
+                        measure_count(&m, c.tic_ref, 1000);
+                        measure_set_utc(&m, 1700000000);
+                    }
+                    pet_process_fn process = expected_process(&c, anchored);
+                    pet_process_fn fall = (process == process_timemark)? process_fall_timemark:
+                        (process == process_utc_timemark)? process_utc_fall_timemark: process_none;
+                    char what[96], detail[96];
+                    snprintf(what, sizeof(what), "MODE %s FORMAT %u GATE %u UTC %s%s", measure_mode_name(mode), format, c.gate_ms,
+                        c.utc? "ON": "OFF", anchored? " anchored": "");
+                    snprintf(detail, sizeof(detail), "%s, %s", routine_name(m.process), routine_name(m.fall));
+                    report(m.process == process && m.fall == fall, what, (m.process != process || m.fall != fall || verbose)? detail: NULL);
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-v") == 0) {
+            verbose = true;
+        } else {
+            fprintf(stderr, "Usage: %s [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+    cmd_init(&parser);
+    check_commands();
+    check_valid();
+    check_dispatch();
+    printf("%u of %u cases failed\n", failed, cases);
+    return (failed == 0)? 0: 1;
+}
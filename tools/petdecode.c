@@ -0,0 +1,170 @@
+/*
+    petdecode decodes the framed binary output of PicoPET (OUTPUT_BINARY) back to the
+    text formats printed by the firmware.
+
+    Usage: petdecode [-m timemark|freq|count] [-t prefix] [file]
+        -m  output type, default is the mode announced by the device config frame
+        -t  additionally write TimeLab compatible timemark files <prefix>ChA.txt, ...
+    Reads stdin when no file given, e.g. "cat /dev/ttyACM0 | petdecode".
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "binOut.h"
+#include "fixFmt.h"
+#include "timebase.h"
+
+static const char* channel_names[] = {"ChA", "ChB", "ChC", "ChD"};
+static uint64_t tm[BIN_MAX_CHANNELS];
+static uint32_t clk_src_freq;           // frequency of the timemarks in tm
+static uint8_t first_sensed_input = 255;
+static FILE* timelab[BIN_MAX_CHANNELS];
+static const char* timelab_prefix = NULL;
+
+
+static const char* channel_name(uint8_t i) {
+    static char name[8];
+    if (i < sizeof(channel_names)/sizeof(channel_names[0])) {
+        return channel_names[i];
+    }
+    snprintf(name, sizeof(name), "Ch%u", i);
+    return name;
+}
+
+static void print_header(int mode) {
+    switch (mode) {
+        case BIN_MODE_CYCLE_COUNT:
+            printf("COUNT\t CHANNEL\n");
+            break;
+        case BIN_MODE_FREQUENCY:
+            printf("FREQ\t CHANNEL\n");
+            break;
+        default:
+            printf("TIMEMARK\t CHANNEL\n");
+    }
+}
+
+static void timelab_write(uint8_t i, const char* ts) {
+    if (timelab_prefix == NULL) {
+        return;
+    }
+    if (timelab[i] == NULL) {
+        char fn[1024];
+        snprintf(fn, sizeof(fn), "%s%s.txt", timelab_prefix, channel_name(i));
+        timelab[i] = fopen(fn, "w");
+        if (timelab[i] == NULL) {
+            perror(fn);
+            exit(1);
+        }
+    }
+    fprintf(timelab[i], "%s\n", ts);
+}
+
+// timestamp frames carry the timemark, event frames only the interval
+static void process_event(int mode, const struct BinConfig* cfg, uint8_t i, uint64_t clk_cor, bool timestamp, uint64_t timemark) {
+    char s[FMT_MAX_LEN];
+    // same timescale as process_count() in the firmware
+    if (first_sensed_input == 255) {
+        first_sensed_input = i;
+    }
+    if (tm[i] == 0 && first_sensed_input != i) {
+        tm[i] = tm[first_sensed_input];
+    }
+    tm[i] = timestamp? timemark: tm[i] + clk_cor;
+    switch (mode) {
+        case BIN_MODE_CYCLE_COUNT:
+            printf("%llu\t %s\n", (unsigned long long)clk_cor, channel_name(i));
+            break;
+        case BIN_MODE_FREQUENCY: {
+            uint64_t num = (uint64_t)cfg->clk_src_freq * cfg->avg_periods;
+            while (clk_cor >> 32) {
+                // as write_quotient() of the firmware
+                clk_cor >>= 1;
+                num >>= 1;
+            }
+            fmt_quotient(s, num, clk_cor);
+            printf("%s\t %s\n", s, channel_name(i));
+            break;
+        }
+        default:
+            fmt_seconds(s, tm[i], cfg->clk_src_freq);
+            printf("%s\t %s\n", s, channel_name(i));
+    }
+    if (timelab_prefix != NULL) {
+        fmt_seconds(s, tm[i], cfg->clk_src_freq);
+        timelab_write(i, s);
+    }
+}
+
+static int parse_mode(const char* s) {
+    if (strcmp(s, "timemark") == 0) {
+        return BIN_MODE_TIMEMARK;
+    } else if (strcmp(s, "freq") == 0) {
+        return BIN_MODE_FREQUENCY;
+    } else if (strcmp(s, "count") == 0) {
+        return BIN_MODE_CYCLE_COUNT;
+    }
+    fprintf(stderr, "unknown mode %s\n", s);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int mode = -1;
+    const char* fn = NULL;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-m") == 0 && a+1 < argc) {
+            mode = parse_mode(argv[++a]);
+        } else if (strcmp(argv[a], "-t") == 0 && a+1 < argc) {
+            timelab_prefix = argv[++a];
+        } else if (argv[a][0] == '-' && argv[a][1] != '\0') {
+            fprintf(stderr, "Usage: %s [-m timemark|freq|count] [-t prefix] [file]\n", argv[0]);
+            return 2;
+        } else {
+            fn = argv[a];
+        }
+    }
+    FILE* in = stdin;
+    if (fn != NULL && strcmp(fn, "-") != 0) {
+        in = fopen(fn, "rb");
+        if (in == NULL) {
+            perror(fn);
+            return 1;
+        }
+    }
+
+    struct BinDecoder dec;
+    struct BinFrame f;
+    bin_decoder_init(&dec);
+    bool header = false;
+    int c;
+    while ((c = getc(in)) != EOF) {
+        if (!bin_decode(&dec, (uint8_t)c, &f)) {
+            continue;
+        }
+        if (f.type == BIN_FRAME_CONFIG) {
+            if (clk_src_freq != 0 && f.cfg.clk_src_freq != clk_src_freq) {
+                // timebase switch, the timescale continues in cycles of the new clock
+                for (uint8_t i = 0; i < BIN_MAX_CHANNELS; i++) {
+                    tm[i] = timebase_convert(tm[i], clk_src_freq, f.cfg.clk_src_freq);
+                }
+            }
+            clk_src_freq = f.cfg.clk_src_freq;
+            if (!header) {
+                mode = (mode < 0)? f.cfg.mode: mode;
+                print_header(mode);
+                header = true;
+            }
+        } else if (dec.has_config) {
+            // events before the first config frame can not be scaled
+            process_event(mode, &dec.cfg, f.channel, f.clk_cor, f.type == BIN_FRAME_TS_ABS || f.type == BIN_FRAME_TS_DELTA, f.tm);
+        }
+    }
+    for (uint8_t i = 0; i < BIN_MAX_CHANNELS; i++) {
+        if (timelab[i] != NULL) {
+            fclose(timelab[i]);
+        }
+    }
+    fprintf(stderr, "frames %u, crc errors %u, unsynced events %u\n", dec.frames, dec.crc_errors, dec.unsynced);
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+    petfmt compares the fixed point formatter of the firmware (fixFmt.c) with the double
+    based output it replaced and measures the rate of both.
+
+    Usage: petfmt [-n samples] [-c clk_sys] [-b]
+        -n  random samples per row, default 100000
+        -c  clk_sys in Hz, default both 200000000 and 240000000
+        -b  also measure formatted samples per second of both paths
+    Timemarks are random cycle counts below the span of the row, frequencies random
+    clk_sys*AVG/clk_cor quotients within the decade of the row, AVG random over 1..10000
+    as far as clk_cor stays below 2^32.
+    Every fixed point output has to be the exactly rounded quotient, half way rounded up
+    (checked with 128 bit integers). The double path rounds the double nearest to the
+    quotient instead, the number of samples printed differently is listed per row, and how
+    many of them are half way ties. The timemarks of the first 10 days have to be identical
+    except for the ties.
+    Exits with 1 if any check fails.
+    The benchmark runs on the host FPU, on the RP2040 without FPU the double path is
+    much slower still, the BENCH command measures the device.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include "fixFmt.h"
+
+#define IDENTICAL_DAYS 10               // timemarks identical to the double path up to this span
+
+static uint64_t rnd_state = 88172645463325252ull;
+static volatile char sink;              // keeps the formatting of the benchmark from being optimized out
+
+static uint64_t rnd64() {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state;
+}
+
+static double rnd_unit() {
+    return (rnd64() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// the output of the firmware before fixFmt.c
+static void double_quotient(char* buf, uint64_t num, uint32_t den) {
+    snprintf(buf, FMT_MAX_LEN, "%.9f", (double)num / (double)den);
+}
+
+static void double_seconds(char* buf, uint64_t cycles, uint32_t freq) {
+    uint64_t ip = cycles / freq;
+    uint64_t rem = cycles - ip * freq;
+    snprintf(buf, FMT_MAX_LEN, "%.9f", (double)ip + (double)rem / (double)freq);
+}
+
+// num/den exactly rounded half up to FMT_DECIMALS decimals, true on a tie
+static bool exact_quotient(char* buf, uint64_t num, uint32_t den) {
+    unsigned __int128 scaled = (unsigned __int128)num * FMT_SCALE;
+    unsigned __int128 q = scaled / den;
+    unsigned __int128 r = scaled - q * den;
+    q += (2*r >= den);
+    snprintf(buf, FMT_MAX_LEN, "%llu.%09llu", (unsigned long long)(q / FMT_SCALE), (unsigned long long)(q % FMT_SCALE));
+    return 2*r == den;
+}
+
+// differ counts the samples the double path prints differently, ties counts those of them half way
+static bool check_quotient(uint64_t num, uint32_t den, bool seconds, uint32_t* differ, uint32_t* ties) {
+    char fixed[FMT_MAX_LEN], dbl[FMT_MAX_LEN], exact[FMT_MAX_LEN];
+    if (seconds) {
+        fmt_seconds(fixed, num, den);
+        double_seconds(dbl, num, den);
+    } else {
+        fmt_quotient(fixed, num, den);
+        double_quotient(dbl, num, den);
+    }
+    bool tie = exact_quotient(exact, num, den);
+    *differ += (strcmp(fixed, dbl) != 0);
+    *ties += tie && strcmp(fixed, dbl) != 0;
+    return strcmp(fixed, exact) == 0;
+}
+
+static bool check_timemarks(uint32_t clk, uint32_t days, uint32_t samples) {
+    uint64_t span = (uint64_t)days * 86400 * clk;
+    uint32_t wrong = 0, differ = 0, ties = 0;
+    for (uint32_t j = 0; j < samples; j++) {
+        wrong += !check_quotient(rnd64() % span, clk, true, &differ, &ties);
+    }
+    bool ok = (wrong == 0) && (differ == ties || days > IDENTICAL_DAYS);
+    printf("%s TIMEMARK clk %u below %5u days: %u of %u differ from the double path, %u ties%s\n", ok? "OK  ": "FAIL", clk, days, differ,
+        samples, ties, (wrong != 0)? ", NOT EXACT": "");
+    return ok;
+}
+
+static bool check_frequencies(uint32_t clk, double f_min, uint32_t samples) {
+    uint32_t wrong = 0, differ = 0, ties = 0, n = 0;
+    while (n < samples) {
+        double f = f_min * (1 + 9 * rnd_unit());
+        double avg_max = f * 4294967295.0 / clk;    // clk_cor below 2^32
+        if (avg_max < 1) {
+            continue;
+        }
+        uint16_t avg = 1 + rnd64() % ((avg_max < 10000)? (uint64_t)avg_max: 10000);
+        uint64_t num = (uint64_t)clk * avg;
+        double den = num / f;
+        if (den < 4 || den >= 4294967296.0) {
+            continue;
+        }
+        wrong += !check_quotient(num, (uint32_t)den, false, &differ, &ties);
+        n++;
+    }
+    bool ok = (wrong == 0);
+    printf("%s FREQ     clk %u %8.0e..%.0e Hz: %u of %u differ from the double path, %u ties%s\n", ok? "OK  ": "FAIL", clk, f_min, 10*f_min,
+        differ, samples, ties, (wrong != 0)? ", NOT EXACT": "");
+    return ok;
+}
+
+static double seconds_since(struct timespec* t0) {
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (t1.tv_sec - t0->tv_sec) + 1e-9 * (t1.tv_nsec - t0->tv_nsec);
+}
+
+static void bench(uint32_t clk, uint32_t samples) {
+    static uint64_t values[1024];
+    static uint32_t dens[1024];
+    for (uint16_t j = 0; j < 1024; j++) {
+        values[j] = rnd64() % ((uint64_t)86400 * clk);
+        dens[j] = clk / (1 + rnd64() % 1000000);
+    }
+    char buf[FMT_MAX_LEN];
+    double rate[4];
+    for (uint8_t path = 0; path < 4; path++) {
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (uint32_t j = 0; j < samples; j++) {
+            switch (path) {
+                case 0: double_seconds(buf, values[j & 1023], clk); break;
+                case 1: fmt_seconds(buf, values[j & 1023], clk); break;
+                case 2: double_quotient(buf, clk, dens[j & 1023]); break;
+                case 3: fmt_quotient(buf, clk, dens[j & 1023]); break;
+            }
+            sink = buf[1];
+        }
+        rate[path] = samples / seconds_since(&t0);
+    }
+    printf("BENCH TIMEMARK clk %u DOUBLE=%.0f FIXED=%.0f /s\n", clk, rate[0], rate[1]);
+    printf("BENCH FREQ     clk %u DOUBLE=%.0f FIXED=%.0f /s\n", clk, rate[2], rate[3]);
+}
+
+int main(int argc, char** argv) {
+    uint32_t samples = 100000;
+    uint32_t clks[2] = {200000000, 240000000};
+    uint8_t n_clks = 2;
+    bool run_bench = false;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-n") == 0 && a+1 < argc) {
+            samples = strtoul(argv[++a], NULL, 0);
+        } else if (strcmp(argv[a], "-c") == 0 && a+1 < argc) {
+            clks[0] = strtoul(argv[++a], NULL, 0);
+            n_clks = 1;
+        } else if (strcmp(argv[a], "-b") == 0) {
+            run_bench = true;
+        } else {
+            fprintf(stderr, "Usage: %s [-n samples] [-c clk_sys] [-b]\n", argv[0]);
+            return 2;
+        }
+    }
+    static const uint32_t days[] = {1, IDENTICAL_DAYS, 100, 1000};
+    uint32_t failed = 0, cases = 0;
+    for (uint8_t c = 0; c < n_clks; c++) {
+        for (uint8_t d = 0; d < sizeof(days)/sizeof(days[0]); d++) {
+            failed += !check_timemarks(clks[c], days[d], samples);
+            cases++;
+        }
+        for (double f = 1e-1; f < 1e8; f *= 10) {
+            failed += !check_frequencies(clks[c], f, samples);
+            cases++;
+        }
+    }
+    if (run_bench) {
+        for (uint8_t c = 0; c < n_clks; c++) {
+            bench(clks[c], 10 * samples);
+        }
+    }
+    printf("%u of %u cases failed\n", failed, cases);
+    return (failed == 0)? 0: 1;
+}
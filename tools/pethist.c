@@ -0,0 +1,361 @@
+/*
+    pethist checks the histogram of MODE HIST: the bins and moments of histogram.c and the
+    gates, nominal interval and time interval error of process_hist() in measure.c.
+
+    Usage: pethist
+      bins      hist_add() with bin widths 1 and 3, the values at both edges of the bins,
+                the first bin and the last one go to the bin, one further to BELOW/ABOVE,
+                negative values round down; BELOW/ABOVE still enter min, max and the sum
+      clamp     values beyond 32 bits are clamped to INT32_MIN/INT32_MAX
+      moments   mean and std of random values against a direct two-pass computation, std 0 of
+                a constant, nan of one value and of a saturated sum of squares, mean 0 of none
+      start     hist_start() clears the gate and keeps the nominal interval, hist_init() not
+    The gate cases feed the edges of ChA and ChB (ChB half a period later, its jitter
+    inverted) with CAPTURE TS at 240 MHz through measure_timestamp() and compare every
+    printed histogram with the values expected from the jitter put on the edges:
+      period    HIST PERIOD, interval minus REF; the first gate takes the first interval
+      tie       HIST TIE, edge against the ideal edge n REF after the gate start
+      drift     the period steps up after the first gate: the second gate keeps the REF of
+                the first one (PERIOD offset by the step, TIE ramping), the third takes the
+                mean interval of the second
+    with bin widths 1 and 3 and GATE 100 ms and 0 (1 s). Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "measure.h"
+
+#define CLK_FREQ 240000000
+#define PERIOD 240000                   // 1 ms in clk_sys cycles
+#define GATES 3
+#define MAX_GATE 1000                   // values per gate
+#define MAX_OUTPUT (1 << 20)
+
+struct HistCase
+{
+    uint8_t value;                      // PET_HIST_...
+    uint16_t width;
+    uint16_t gate_ms;
+    uint32_t step;                      // cycles added to the period after the first gate
+};
+
+// a printed or expected histogram
+struct HistGate
+{
+    uint32_t n;
+    double ref, mean, std, min, max;    // seconds
+    uint32_t below, above;
+    uint32_t bins[HIST_BINS];
+};
+
+static uint64_t rnd_state = 88172645463325252ull;
+
+static uint32_t rnd() {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state >> 32;
+}
+
+static char* output;
+static size_t output_len;
+
+static void capture(const char* buf, uint16_t len, bool binary) {
+    if (output_len + len < MAX_OUTPUT) {
+        memcpy(output + output_len, buf, len);
+        output_len += len;
+    }
+}
+
+static bool report(const char* name, bool ok, const char* why) {
+    printf("%-40s %s%s%s\n", name, ok? "OK": "FAIL", ok? "": ", ", why);
+    return ok;
+}
+
+static bool check_bins(uint16_t width) {
+    char name[32], why[128] = "";
+    snprintf(name, sizeof(name), "bins width %u", width);
+    struct Histogram h;
+    hist_init(&h);
+    hist_start(&h, 0);
+    int32_t w = width, edge = HIST_BINS/2 * w;
+    // value and its bin, -1 below, HIST_BINS above
+    const int32_t values[][2] = {{-edge - 1, -1}, {-edge, 0}, {-w - 1, HIST_BINS/2 - 2}, {-w, HIST_BINS/2 - 1}, {-1, HIST_BINS/2 - 1},
+        {0, HIST_BINS/2}, {w - 1, HIST_BINS/2}, {w, HIST_BINS/2 + 1}, {edge - 1, HIST_BINS - 1}, {edge, HIST_BINS}, {-5 * edge, -1}};
+    uint32_t expect[HIST_BINS + 2] = {0};
+    int64_t sum = 0;
+    for (uint8_t k = 0; k < sizeof(values)/sizeof(values[0]); k++) {
+        hist_add(&h, values[k][0], width);
+        expect[values[k][1] + 1]++;
+        sum += values[k][0];
+    }
+    bool ok = h.below == expect[0] && h.above == expect[HIST_BINS + 1];
+    for (uint8_t k = 0; k < HIST_BINS; k++) {
+        if (h.bins[k] != expect[k + 1]) {
+            snprintf(why, sizeof(why), "bin %u has %u values, expected %u", k, h.bins[k], expect[k + 1]);
+            ok = false;
+        }
+    }
+    ok = ok && h.n == sizeof(values)/sizeof(values[0]) && h.min == -5 * edge && h.max == edge && h.sum == sum;
+    return report(name, ok, why);
+}
+
+static bool check_clamp() {
+    struct Histogram h;
+    hist_init(&h);
+    hist_start(&h, 0);
+    hist_add(&h, 1ll << 40, 1);
+    hist_add(&h, -(1ll << 40), 1);
+    bool ok = h.max == INT32_MAX && h.min == INT32_MIN && h.above == 1 && h.below == 1 && h.sum == -1;
+    return report("clamp", ok, "");
+}
+
+static bool check_moments() {
+    char why[128] = "";
+    static int32_t x[10000];
+    struct Histogram h;
+    struct HistMoments r;
+    hist_init(&h);
+    hist_start(&h, 0);
+    double sum = 0;
+    for (uint32_t k = 0; k < 10000; k++) {
+        x[k] = (int32_t)(rnd() % 20001) - 10000 + 3000;
+        hist_add(&h, x[k], 7);
+        sum += x[k];
+    }
+    double mean = sum / 10000, var = 0;
+    for (uint32_t k = 0; k < 10000; k++) {
+        var += (x[k] - mean) * (x[k] - mean);
+    }
+    double std = sqrt(var / 9999);
+    hist_moments(&h, &r);
+    bool ok = fabs(r.mean - mean) < 1e-9 * fabs(mean) && fabs(r.std - std) < 1e-9 * std;
+    if (!ok) {
+        snprintf(why, sizeof(why), "mean %.9g std %.9g, expected %.9g %.9g", r.mean, r.std, mean, std);
+    }
+    // a constant, one value, none
+    hist_start(&h, 0);
+    for (uint32_t k = 0; k < 100; k++) {
+        hist_add(&h, -17, 1);
+    }
+    hist_moments(&h, &r);
+    ok = ok && r.mean == -17 && r.std == 0;
+    hist_start(&h, 0);
+    hist_add(&h, 5, 1);
+    hist_moments(&h, &r);
+    ok = ok && r.mean == 5 && isnan(r.std);
+    hist_start(&h, 0);
+    hist_moments(&h, &r);
+    ok = ok && r.mean == 0 && isnan(r.std);
+    // (2^31 - 1)^2 is almost 2^62, the fifth square saturates
+    hist_start(&h, 0);
+    for (uint32_t k = 0; k < 5; k++) {
+        hist_add(&h, INT32_MAX, 1);
+    }
+    hist_moments(&h, &r);
+    ok = ok && h.sum_sq == UINT64_MAX && r.mean == INT32_MAX && isnan(r.std);
+    return report("moments", ok, why);
+}
+
+static bool check_start() {
+    struct Histogram h;
+    hist_init(&h);
+    h.ref = 1234;
+    hist_add(&h, 3, 1);
+    hist_start(&h, 99);
+    bool ok = h.ref == 1234 && h.t0 == 99 && h.n == 0 && h.bins[HIST_BINS/2 + 3] == 0 && h.sum == 0 && h.min == INT32_MAX && h.max == INT32_MIN;
+    hist_init(&h);
+    ok = ok && h.ref == 0;
+    return report("start", ok, "");
+}
+
+// the histogram of the values x in cycles as write_hist() prints it
+static void expect_gate(struct HistGate* g, const int32_t* x, uint32_t n, uint16_t width, uint64_t ref) {
+    memset(g, 0, sizeof(*g));
+    double sum = 0, var = 0;
+    g->n = n;
+    g->ref = (double)ref / CLK_FREQ;
+    g->min = INFINITY;
+    g->max = -INFINITY;
+    for (uint32_t k = 0; k < n; k++) {
+        int32_t bin = (int32_t)floor((double)x[k] / width) + HIST_BINS/2;
+        if (bin < 0) {
+            g->below++;
+        } else if (bin >= HIST_BINS) {
+            g->above++;
+        } else {
+            g->bins[bin]++;
+        }
+        sum += x[k];
+        g->min = fmin(g->min, x[k]);
+        g->max = fmax(g->max, x[k]);
+    }
+    double mean = sum / n;
+    for (uint32_t k = 0; k < n; k++) {
+        var += (x[k] - mean) * (x[k] - mean);
+    }
+    g->mean = mean / CLK_FREQ;
+    g->std = sqrt(var / (n - 1)) / CLK_FREQ;
+    g->min /= CLK_FREQ;
+    g->max /= CLK_FREQ;
+}
+
+// the next printed histogram of the channel, false if there is none
+static bool parse_gate(const char** pos, const char* channel, uint16_t width, struct HistGate* g) {
+    char name[16], value[16];
+    unsigned long n, below, above, count;
+    const char* line = *pos;
+    while ((line = strstr(line, "HIST ")) != NULL) {
+        if (sscanf(line, "HIST %15s %15s N=%lu REF=%lf MEAN=%lf STD=%lf MIN=%lf MAX=%lf BELOW=%lu ABOVE=%lu", name, value, &n, &g->ref, &g->mean,
+                &g->std, &g->min, &g->max, &below, &above) == 10 && strcmp(name, channel) == 0) {
+            break;
+        }
+        line += 5;
+    }
+    if (line == NULL) {
+        return false;
+    }
+    g->n = n;
+    g->below = below;
+    g->above = above;
+    memset(g->bins, 0, sizeof(g->bins));
+    line = strchr(line, '\n') + 1;
+    double lower;
+    int len;
+    while (sscanf(line, "%lf\t %lu\n%n", &lower, &count, &len) == 2 && strncmp(line, "HIST ", 5) != 0) {
+        int32_t bin = (int32_t)lround(lower * CLK_FREQ / width) + HIST_BINS/2;
+        if (bin >= 0 && bin < HIST_BINS) {
+            g->bins[bin] += count;
+        }
+        line += len;
+    }
+    *pos = line;
+    return true;
+}
+
+// printed within the 5 digits of %.4e
+static bool near(double a, double b) {
+    return fabs(a - b) <= 1e-4 * fabs(b) + 1e-15;
+}
+
+static bool same_gate(const struct HistGate* a, const struct HistGate* b, char* why, size_t len) {
+    if (a->n != b->n || a->below != b->below || a->above != b->above || memcmp(a->bins, b->bins, sizeof(a->bins)) != 0) {
+        snprintf(why, len, "N=%u BELOW=%u ABOVE=%u or the bins differ, expected N=%u BELOW=%u ABOVE=%u", a->n, a->below, a->above, b->n, b->below,
+            b->above);
+        return false;
+    }
+    if (fabs(a->ref - b->ref) > 1e-9 * b->ref || !near(a->mean, b->mean) || !near(a->std, b->std) || !near(a->min, b->min) || !near(a->max, b->max)) {
+        snprintf(why, len, "REF=%.9e MEAN=%.4e STD=%.4e MIN=%.4e MAX=%.4e, expected %.9e %.4e %.4e %.4e %.4e", a->ref, a->mean, a->std, a->min,
+            a->max, b->ref, b->mean, b->std, b->min, b->max);
+        return false;
+    }
+    return true;
+}
+
+static bool check_gates(const struct HistCase* c) {
+    static const char* const names[PET_MAX_CHANNELS] = {"ChA", "ChB", "ChC", "ChD"};
+    static struct PetMeasure m;
+    static int32_t jitter[GATES][MAX_GATE + 1];
+    static int32_t x[2][GATES][MAX_GATE];
+    char name[64], why[256] = "";
+    struct PetConfig cfg = {
+        .mode = PET_MODE_HIST,
+        .format = PET_FORMAT_TEXT,
+        .channels = 2,
+        .capture = PET_CAPTURE_TIMESTAMP,
+        .avg_periods = 1,
+        .gate_ms = c->gate_ms,
+        .hist_width = c->width,
+        .hist_value = c->value,
+    };
+    snprintf(name, sizeof(name), "%s width %u gate %u ms%s", (c->value == PET_HIST_TIE)? "tie": "period", c->width, c->gate_ms,
+        c->step? " drift": "");
+    uint32_t per_gate = ((c->gate_ms > 0)? c->gate_ms: PET_HIST_GATE_MS) * (CLK_FREQ / 1000) / PERIOD;
+    // even jitter of the edges, the cycles are twice the ticks; none on the first two edges of a
+    // gate (the first interval is the REF of the first gate) and on the last one (the mean
+    // interval of a gate is its period)
+    for (uint8_t g = 0; g < GATES; g++) {
+        for (uint32_t k = 0; k <= per_gate; k++) {
+            jitter[g][k] = (k < 2 || k == per_gate)? 0: 2 * ((int32_t)(rnd() % 81) - 40);
+        }
+    }
+    output_len = 0;
+    measure_init(&m, &cfg, CLK_FREQ, names, capture);
+    measure_header(&m);
+    uint64_t start = 2000000, period = PERIOD;
+    for (uint8_t g = 0; g < GATES; g++) {
+        if (g == 1) {
+            period += c->step;
+        }
+        // the REF of the gate, the previous gate had the period of the gate before it
+        uint64_t ref = (g < 2)? PERIOD: PERIOD + c->step;
+        for (uint32_t k = (g == 0)? 0: 1; k <= per_gate; k++) {
+            for (uint8_t i = 0; i < 2; i++) {
+                int32_t j = (i == 0)? jitter[g][k]: -jitter[g][k];
+                measure_timestamp(&m, i, (start + k * period + i * PERIOD / 2 + j) / 2);
+                if (k > 0) {
+                    int32_t before = (i == 0)? jitter[g][k - 1]: -jitter[g][k - 1];
+                    x[i][g][k - 1] = (c->value == PET_HIST_TIE)? (int32_t)(k * (period - ref)) + j: (int32_t)(period - ref) + j - before;
+                }
+            }
+        }
+        start += per_gate * period;
+    }
+    output[output_len] = '\0';
+    bool ok = true;
+    for (uint8_t i = 0; i < 2 && ok; i++) {
+        const char* pos = output;
+        for (uint8_t g = 0; g < GATES && ok; g++) {
+            struct HistGate printed, expect;
+            expect_gate(&expect, x[i][g], per_gate, c->width, (g < 2)? PERIOD: PERIOD + c->step);
+            if (!parse_gate(&pos, names[i], c->width, &printed)) {
+                snprintf(why, sizeof(why), "%s gate %u not printed", names[i], g + 1);
+                ok = false;
+            } else if (!same_gate(&printed, &expect, why, sizeof(why))) {
+                char detail[256];
+                snprintf(detail, sizeof(detail), "%s gate %u: %s", names[i], g + 1, why);
+                strcpy(why, detail);
+                ok = false;
+            }
+        }
+        struct HistGate extra;
+        if (ok && parse_gate(&pos, names[i], c->width, &extra)) {
+            snprintf(why, sizeof(why), "%s: more than %u gates printed", names[i], GATES);
+            ok = false;
+        }
+    }
+    return report(name, ok, why);
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        fprintf(stderr, "Usage: %s\n", argv[0]);
+        return 2;
+    }
+    output = malloc(MAX_OUTPUT);
+    uint32_t failed = 0, cases = 0;
+    failed += !check_bins(1);
+    failed += !check_bins(3);
+    failed += !check_clamp();
+    failed += !check_moments();
+    failed += !check_start();
+    cases += 5;
+    static const struct HistCase gate_cases[] = {
+        {PET_HIST_PERIOD, 1, 100, 0},
+        {PET_HIST_PERIOD, 3, 100, 0},
+        {PET_HIST_PERIOD, 3, 100, 24},
+        {PET_HIST_PERIOD, 1, 0, 0},
+        {PET_HIST_TIE, 1, 100, 0},
+        {PET_HIST_TIE, 3, 100, 0},
+        {PET_HIST_TIE, 1, 100, 24},
+        {PET_HIST_TIE, 3, 0, 2},
+    };
+    for (uint8_t k = 0; k < sizeof(gate_cases)/sizeof(gate_cases[0]); k++) {
+        failed += !check_gates(&gate_cases[k]);
+        cases++;
+    }
+    printf("%u of %u cases failed\n", failed, cases);
+    return (failed == 0)? 0: 1;
+}
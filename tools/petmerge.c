@@ -0,0 +1,433 @@
+/*
+    petmerge merges the TIMEMARK text output of several PicoPET units running off the
+    same reference into one time ordered feed, the channels tagged by the unit, e.g.
+    "P2.ChA", so more than four channels can be recorded and analysed together.
+
+    Usage: petmerge [-n name,...] [-o offset,...] [-l latency] [-b events] input...
+           petmerge -B units
+        -n  names of the units, default P1, P2, ...
+        -o  offset in seconds added to the timemarks of each unit, e.g. -o 0,-12.5e-9
+        -l  max. time in ms the output waits for a unit without data, default 1000
+        -b  timemarks buffered per unit, default 4096
+        -B  benchmark, merges 1000000 synthetic timemarks per unit and prints events/s
+    Inputs are files, FIFOs or serial devices ("-" for stdin), read without blocking.
+    The head timemarks of the units are kept in a binary heap, the smallest one is
+    written once every other unit has a timemark queued or has ended, so the output is
+    in order. A unit without data for longer than the latency is not waited for; its
+    timemarks arriving later than that are still written, out of order, and counted as
+    late. A unit that runs ahead fills its buffer and is not read until the others catch
+    up, so the memory is bounded by -b per unit.
+    Lines other than timemarks (header, TIMEBASE, CONFIG, STATUS) are skipped.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include "fixFmt.h"
+
+#define MAX_UNITS 16
+#define MAX_UNIT_CHANNELS 8             // channel names per unit
+#define NAME_LEN 8
+#define READ_SIZE 65536
+#define NS_FREQ 1000000000u             // timemarks are merged in nanoseconds
+#define BENCH_EVENTS 1000000
+
+struct Event
+{
+    int64_t ns;                         // timemark with the unit offset applied
+    uint8_t channel;                    // index into the channel names of the unit
+};
+
+struct Unit
+{
+    const char* path;
+    char name[NAME_LEN];
+    int fd;
+    int64_t offset_ns;
+    bool eof;
+    int64_t last_rx_ms;                 // when the last bytes arrived
+    char buf[READ_SIZE];                // bytes read and not parsed yet
+    uint32_t pos;
+    uint32_t len;
+    char line[128];                     // incomplete line at the end of buf
+    uint8_t line_len;
+    char channels[MAX_UNIT_CHANNELS][NAME_LEN];
+    uint8_t channel_count;
+    struct Event* ring;                 // queued timemarks
+    uint32_t head;
+    uint32_t count;
+    uint64_t events;
+    uint64_t skipped;                   // lines which are not timemarks
+};
+
+static struct Unit units[MAX_UNITS];
+static uint8_t unit_count = 0;
+static uint32_t ring_size = 4096;
+static int64_t latency_ms = 1000;
+static uint8_t heap[MAX_UNITS];         // units with queued timemarks, smallest head first
+static uint8_t heap_len = 0;
+static int64_t last_out = INT64_MIN;
+static uint64_t merged = 0;
+static uint64_t late = 0;
+static FILE* out;
+
+
+static int64_t now_ms() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (int64_t)t.tv_sec * 1000 + t.tv_nsec / 1000000;
+}
+
+static bool before(uint8_t a, uint8_t b) {
+    // ties in the order of the units, so the output does not depend on the arrival
+    int64_t ta = units[a].ring[units[a].head].ns;
+    int64_t tb = units[b].ring[units[b].head].ns;
+    return ta < tb || (ta == tb && a < b);
+}
+
+static void heap_push(uint8_t u) {
+    uint8_t k = heap_len++;
+    while (k > 0 && before(u, heap[(k - 1) / 2])) {
+        heap[k] = heap[(k - 1) / 2];
+        k = (k - 1) / 2;
+    }
+    heap[k] = u;
+}
+
+// the head of the top unit changed or the unit is removed (remove)
+static void heap_fix_top(bool remove) {
+    uint8_t u = remove? heap[--heap_len]: heap[0];
+    uint8_t k = 0;
+    while (2*k + 1 < heap_len) {
+        uint8_t c = 2*k + 1;
+        if (c + 1 < heap_len && before(heap[c + 1], heap[c])) {
+            c++;
+        }
+        if (!before(heap[c], u)) {
+            break;
+        }
+        heap[k] = heap[c];
+        k = c;
+    }
+    if (heap_len > 0) {
+        heap[k] = u;
+    }
+}
+
+// exact conversion of the printed seconds (up to 9 decimals) to nanoseconds
+static bool parse_ns(const char** p, int64_t* ns) {
+    const char* s = *p;
+    int64_t ip = 0, frac = 0;
+    uint8_t digits = 0;
+    if (!isdigit((unsigned char)*s)) {
+        return false;
+    }
+    while (isdigit((unsigned char)*s)) {
+        ip = 10*ip + (*s++ - '0');
+    }
+    if (*s != '.') {
+        return false;
+    }
+    s++;
+    while (isdigit((unsigned char)*s)) {
+        if (digits < 9) {
+            frac = 10*frac + (*s - '0');
+            digits++;
+        }
+        s++;
+    }
+    while (digits++ < 9) {
+        frac *= 10;
+    }
+    *ns = ip * NS_FREQ + frac;
+    *p = s;
+    return true;
+}
+
+static int8_t channel_index(struct Unit* u, const char* name, uint8_t len) {
+    for (uint8_t i = 0; i < u->channel_count; i++) {
+        if (strlen(u->channels[i]) == len && memcmp(u->channels[i], name, len) == 0) {
+            return i;
+        }
+    }
+    if (u->channel_count == MAX_UNIT_CHANNELS || len >= NAME_LEN) {
+        return -1;
+    }
+    memcpy(u->channels[u->channel_count], name, len);
+    u->channels[u->channel_count][len] = '\0';
+    return u->channel_count++;
+}
+
+// "<seconds>\t <channel>" lines are queued, anything else is skipped
+static void parse_line(struct Unit* u, const char* s) {
+    int64_t ns;
+    if (!parse_ns(&s, &ns) || (*s != '\t' && *s != ' ')) {
+        u->skipped++;
+        return;
+    }
+    while (*s == '\t' || *s == ' ') {
+        s++;
+    }
+    uint8_t len = 0;
+    while (s[len] != '\0' && !isspace((unsigned char)s[len])) {
+        len++;
+    }
+    int8_t channel = channel_index(u, s, len);
+    if (len == 0 || channel < 0) {
+        u->skipped++;
+        return;
+    }
+    struct Event* e = &u->ring[(u->head + u->count) % ring_size];
+    e->ns = ns + u->offset_ns;
+    e->channel = channel;
+    if (u->count++ == 0) {
+        heap_push(u - units);
+    }
+    u->events++;
+}
+
+// parses the buffered bytes while the ring has room
+static void parse_unit(struct Unit* u) {
+    while (u->pos < u->len && u->count < ring_size) {
+        char c = u->buf[u->pos++];
+        if (c == '\n' || c == '\r') {
+            if (u->line_len > 0) {
+                u->line[u->line_len] = '\0';
+                parse_line(u, u->line);
+                u->line_len = 0;
+            }
+        } else if (u->line_len < sizeof(u->line) - 1) {
+            u->line[u->line_len++] = c;
+        }
+    }
+    if (u->eof && u->pos == u->len && u->line_len > 0 && u->count < ring_size) {
+        // last line without line end
+        u->line[u->line_len] = '\0';
+        parse_line(u, u->line);
+        u->line_len = 0;
+    }
+}
+
+static void read_unit(struct Unit* u) {
+    ssize_t n = read(u->fd, u->buf, sizeof(u->buf));
+    if (n > 0) {
+        u->pos = 0;
+        u->len = n;
+        u->last_rx_ms = now_ms();
+    } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        u->eof = true;
+    }
+}
+
+// an empty unit holds the output back until it has data, ends or exceeds the latency
+static bool waits_for(const struct Unit* u, int64_t now) {
+    return u->count == 0 && !(u->eof && u->pos == u->len) && now - u->last_rx_ms < latency_ms;
+}
+
+static void write_event(const struct Unit* u, const struct Event* e) {
+    char line[FMT_MAX_LEN + 2*NAME_LEN + 4];
+    uint8_t n = 0;
+    if (e->ns < 0) {
+        line[n++] = '-';
+    }
+    n += fmt_seconds(line + n, (e->ns < 0)? -(uint64_t)e->ns: (uint64_t)e->ns, NS_FREQ);
+    n += snprintf(line + n, sizeof(line) - n, "\t %s.%s\n", u->name, u->channels[e->channel]);
+    fwrite(line, 1, n, out);
+}
+
+// writes the timemarks which can not be preceded by another one any more
+// returns the time in ms until a waited for unit exceeds the latency, -1 if none is waited for
+static int emit() {
+    int64_t now = now_ms();
+    for (uint8_t i = 0; i < unit_count; i++) {
+        if (waits_for(&units[i], now)) {
+            return (int)(units[i].last_rx_ms + latency_ms - now);
+        }
+    }
+    while (heap_len > 0) {
+        struct Unit* u = &units[heap[0]];
+        struct Event* e = &u->ring[u->head];
+        if (e->ns < last_out) {
+            late++;
+        } else {
+            last_out = e->ns;
+        }
+        write_event(u, e);
+        merged++;
+        u->head = (u->head + 1) % ring_size;
+        u->count--;
+        heap_fix_top(u->count == 0);
+        if (u->count == 0) {
+            parse_unit(u);
+            if (waits_for(u, now)) {
+                return (int)(u->last_rx_ms + latency_ms - now);
+            }
+        }
+    }
+    return -1;
+}
+
+static bool finished() {
+    for (uint8_t i = 0; i < unit_count; i++) {
+        if (!units[i].eof || units[i].pos < units[i].len || units[i].count > 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void merge() {
+    struct pollfd fds[MAX_UNITS];
+    uint8_t polled[MAX_UNITS];
+    while (!finished()) {
+        for (uint8_t i = 0; i < unit_count; i++) {
+            parse_unit(&units[i]);
+        }
+        int timeout = emit();
+        // read the units with nothing left to parse and room in the ring
+        int n = 0;
+        for (uint8_t i = 0; i < unit_count; i++) {
+            struct Unit* u = &units[i];
+            if (!u->eof && u->pos == u->len && u->count < ring_size) {
+                fds[n].fd = u->fd;
+                fds[n].events = POLLIN;
+                polled[n++] = i;
+            }
+        }
+        if (n == 0) {
+            continue;
+        }
+        fflush(out);                    // the output does not wait for the next input
+        if (poll(fds, n, (timeout < 0)? -1: timeout) <= 0) {
+            continue;
+        }
+        for (int k = 0; k < n; k++) {
+            if (fds[k].revents & (POLLIN | POLLHUP | POLLERR)) {
+                read_unit(&units[polled[k]]);
+            }
+        }
+    }
+    fflush(out);
+}
+
+static void add_unit(const char* path, int fd) {
+    struct Unit* u = &units[unit_count];
+    u->path = path;
+    u->fd = fd;
+    u->ring = malloc(ring_size * sizeof(struct Event));
+    if (u->ring == NULL) {
+        perror("malloc");
+        exit(1);
+    }
+    if (u->name[0] == '\0') {
+        snprintf(u->name, sizeof(u->name), "P%u", unit_count + 1);
+    }
+    u->last_rx_ms = now_ms();
+    unit_count++;
+}
+
+// synthetic units of 4 channels at 1 kHz, offset by a few us from each other
+static void benchmark(uint8_t count) {
+    FILE* files[MAX_UNITS];
+    for (uint8_t k = 0; k < count; k++) {
+        files[k] = tmpfile();
+        if (files[k] == NULL) {
+            perror("tmpfile");
+            exit(1);
+        }
+        fprintf(files[k], "TIMEMARK\t CHANNEL\n");
+        for (uint32_t j = 0; j < BENCH_EVENTS; j++) {
+            uint64_t ns = (uint64_t)(j / 4) * 1000000 + (j % 4) * 250000 + k * 3000 + rand() % 50;
+            char s[FMT_MAX_LEN];
+            fmt_seconds(s, ns, NS_FREQ);
+            fprintf(files[k], "%s\t Ch%c\n", s, 'A' + j % 4);
+        }
+        fflush(files[k]);
+        rewind(files[k]);
+        add_unit("bench", fileno(files[k]));
+    }
+    out = fopen("/dev/null", "w");
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    merge();
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    printf("BENCH UNITS=%u EVENTS=%llu LATE=%llu TIME=%.3f s RATE=%.0f events/s\n", count, (unsigned long long)merged,
+        (unsigned long long)late, sec, merged / sec);
+}
+
+static int usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-n name,...] [-o offset,...] [-l latency] [-b events] input...\n"
+        "       %s -B units\n", name, name);
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    const char* inputs[MAX_UNITS];
+    uint8_t input_count = 0;
+    int bench = 0;
+    for (int a = 1; a < argc; a++) {
+        char* arg = (a + 1 < argc)? argv[a + 1]: NULL;
+        if (strcmp(argv[a], "-n") == 0 && arg != NULL) {
+            for (uint8_t i = 0; i < MAX_UNITS && *arg != '\0'; i++) {
+                uint8_t len = strcspn(arg, ",");
+                snprintf(units[i].name, sizeof(units[i].name), "%.*s", len, arg);
+                arg += len + (arg[len] == ',');
+            }
+            a++;
+        } else if (strcmp(argv[a], "-o") == 0 && arg != NULL) {
+            for (uint8_t i = 0; i < MAX_UNITS && *arg != '\0'; i++) {
+                units[i].offset_ns = llround(strtod(arg, &arg) * NS_FREQ);
+                arg += (*arg == ',');
+            }
+            a++;
+        } else if (strcmp(argv[a], "-l") == 0 && arg != NULL) {
+            latency_ms = atoi(arg);
+            a++;
+        } else if (strcmp(argv[a], "-b") == 0 && arg != NULL) {
+            ring_size = (atoi(arg) > 0)? atoi(arg): 1;
+            a++;
+        } else if (strcmp(argv[a], "-B") == 0 && arg != NULL) {
+            bench = atoi(arg);
+            a++;
+        } else if ((argv[a][0] != '-' || strcmp(argv[a], "-") == 0) && input_count < MAX_UNITS) {
+            inputs[input_count++] = argv[a];
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (bench > 0) {
+        benchmark((bench < MAX_UNITS)? bench: MAX_UNITS);
+        return 0;
+    }
+    if (input_count == 0) {
+        return usage(argv[0]);
+    }
+    for (uint8_t i = 0; i < input_count; i++) {
+        int fd = (strcmp(inputs[i], "-") == 0)? 0: open(inputs[i], O_RDONLY);
+        if (fd < 0) {
+            perror(inputs[i]);
+            return 1;
+        }
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        add_unit(inputs[i], fd);
+    }
+    out = stdout;
+    static char out_buf[1 << 20];
+    setvbuf(out, out_buf, _IOFBF, sizeof(out_buf));
+    merge();
+    for (uint8_t i = 0; i < unit_count; i++) {
+        fprintf(stderr, "%s %s: %llu timemarks, %llu other lines\n", units[i].name, units[i].path,
+            (unsigned long long)units[i].events, (unsigned long long)units[i].skipped);
+    }
+    fprintf(stderr, "%llu merged, %llu late\n", (unsigned long long)merged, (unsigned long long)late);
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+    petnmea runs the firmware NMEA parser over a recorded GNSS receiver log (e.g. u-blox
+    output captured from the UART) and prints every fix update, so the parser can be
+    checked against real receivers. Any byte stream is accepted, the tool can be used
+    as a fuzzing target as it is.
+
+    Usage: petnmea [-q] [-x expected] [file]
+        -q  print only the summary
+        -x  compare the output with the file, exit with 1 at the first difference
+    Reads stdin when no file given. ctest runs it over nmea_sample.log, a short u-blox log
+    from power up to the first fixes over a new year with a bad checksum, a sentence cut off
+    by the next one, garbage bytes, a sentence without checksum and a cut-off end, against
+    the expected updates in nmea_sample.txt.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "nmea.h"
+
+static FILE* expected;
+static uint32_t lines;
+
+// prints the line unless quiet, false if it differs from the expected one
+static bool output(const char* line, bool quiet) {
+    char want[128];
+    lines++;
+    if (!quiet) {
+        fputs(line, stdout);
+    }
+    if (expected != NULL && (fgets(want, sizeof(want), expected) == NULL || strcmp(line, want) != 0)) {
+        fprintf(stderr, "line %lu differs, expected: %s", (unsigned long)lines, feof(expected)? "end of file\n": want);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    bool quiet = false;
+    FILE* in = stdin;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-q") == 0) {
+            quiet = true;
+        } else if (strcmp(argv[a], "-x") == 0 && a+1 < argc && expected == NULL) {
+            expected = fopen(argv[++a], "r");
+            if (expected == NULL) {
+                perror(argv[a]);
+                return 1;
+            }
+        } else if (in == stdin && argv[a][0] != '-') {
+            in = fopen(argv[a], "rb");
+            if (in == NULL) {
+                perror(argv[a]);
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [-q] [-x expected] [file]\n", argv[0]);
+            return 2;
+        }
+    }
+    struct NmeaParser p;
+    nmea_init(&p);
+    uint32_t updates = 0;
+    char line[128];
+    int c;
+    while ((c = fgetc(in)) != EOF) {
+        nmea_feed(&p, (char)c);
+        if (p.updates != updates) {
+            struct NmeaFix f;
+            uint32_t unix_sec = 0;
+            nmea_read(&p, &f);
+            bool dated = nmea_unix_time(&f, &unix_sec);
+            snprintf(line, sizeof(line), "%04u-%02u-%02uT%02u:%02u:%02u.%03u%s Q=%d STATUS=%d SATS=%u UNIX=%lu\n", f.year, f.month, f.day,
+                f.hour, f.min, f.sec, f.ms, f.time_valid? "": "?", f.quality, f.status, f.sats, dated? (unsigned long)unix_sec: 0ul);
+            if (!output(line, quiet)) {
+                return 1;
+            }
+        }
+        updates = p.updates;
+    }
+    snprintf(line, sizeof(line), "%lu sentences, %lu errors\n", (unsigned long)p.sentences, (unsigned long)p.errors);
+    if (!output(line, false)) {
+        return 1;
+    }
+    if (expected != NULL && fgets(line, sizeof(line), expected) != NULL) {
+        fprintf(stderr, "more lines expected: %s", line);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+    petomega validates the least-squares (Omega) period estimate of the firmware
+    (omegaFit.c) against synthetic edge timestamps with known period.
+
+    Usage: petomega [-j jitter] [-g gates]
+        -j  rms jitter of the edges in clk_sys cycles, default 0.3
+        -g  gates per resolution case, default 200
+    The timestamps are quantized to 2 clk_sys cycles as picopet_ts counts them, the
+    first interval of a gate is the nominal period p0 as in process_omega().
+      resolution  many short gates, the rms error of the fit has to be sqrt(N/6) times
+                  lower than the one of reciprocal counting over the same edges (at
+                  least 0.7 of it) and within 1.5 times of the expected one
+      long        one gate of 5M to 60M edges (GATE 5 s to 60 s of a 1 MHz input with
+                  AVG 1), the error has to stay within 6 sigma
+      offset      the same with p0 a few cycles off the period
+      wide        periods over 2^32 cycles (timestamp capture with a long AVG)
+      measure     MODE OMEGA through measure.c with exact edges, the printed frequency has
+                  to be exact, also with AVG 10000 at 500 Hz (20 s, 4.8e9 cycles per sample)
+    Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "omegaFit.h"
+#include "measure.h"
+
+#define CLK_SYS 240000000.0
+
+static double jitter = 0.3;
+static uint64_t rnd_state = 88172645463325252ull;
+
+static double rnd_unit() {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return ((rnd_state >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+static double gauss() {
+    return sqrt(-2.0 * log(rnd_unit())) * cos(2 * M_PI * rnd_unit());
+}
+
+// timestamp of edge k, counted in 2 cycle steps from a random phase
+static uint64_t edge(double period, double phase, uint64_t k) {
+    double t = phase + k * period + jitter * gauss();
+    return 2 * (uint64_t)floor(t / 2);
+}
+
+// expected rms error of the fitted period for white timestamp noise
+static double fit_sigma(double n) {
+    double sigma_t = sqrt(4.0 / 12 + jitter * jitter);
+    return sigma_t * sqrt(12 / (n * (n * n - 1)));
+}
+
+// one gate of n timestamps, p0_offset added to the first interval
+static bool fit_gate(double period, uint32_t n, int64_t p0_offset, double* fit, double* reciprocal) {
+    struct OmegaFit f;
+    double phase = 1e6 + 1000 * rnd_unit();
+    uint64_t t0 = edge(period, phase, 0);
+    uint64_t t = edge(period, phase, 1);
+    omega_start(&f, t0, t - t0 + p0_offset);
+    omega_add(&f, t);
+    for (uint32_t k = 2; k < n; k++) {
+        t = edge(period, phase, k);
+        omega_add(&f, t);
+    }
+    *reciprocal = (double)(t - t0) / (n - 1);
+    return omega_period(&f, fit);
+}
+
+static bool check_resolution(double period, uint32_t n, uint32_t gates) {
+    double sum_fit = 0, sum_rec = 0;
+    for (uint32_t g = 0; g < gates; g++) {
+        double fit, rec;
+        if (!fit_gate(period, n, 0, &fit, &rec)) {
+            return false;
+        }
+        sum_fit += (fit - period) * (fit - period);
+        sum_rec += (rec - period) * (rec - period);
+    }
+    double rms_fit = sqrt(sum_fit / gates), rms_rec = sqrt(sum_rec / gates);
+    double gain = rms_rec / rms_fit, expected_gain = sqrt(n / 6.0);
+    bool ok = gain >= 0.7 * expected_gain && rms_fit <= 1.5 * fit_sigma(n);
+    printf("resolution period %12.2f N %8u  rms fit %.3e reciprocal %.3e  gain %6.1f (sqrt(N/6) %6.1f)  %s\n", period, n, rms_fit, rms_rec,
+        gain, expected_gain, ok? "OK": "FAIL");
+    return ok;
+}
+
+static bool check_gate(const char* name, double period, uint32_t n, int64_t p0_offset) {
+    double fit, rec;
+    bool ok = fit_gate(period, n, p0_offset, &fit, &rec);
+    double sigma = fit_sigma(n);
+    ok = ok && fabs(fit - period) <= 6 * sigma + 1e-15 * period;
+    printf("%-10s period %12.2f N %8u  p0 offset %+3d  error %+.3e (sigma %.1e)  freq %.9f Hz  %s\n", name, period, n, (int)p0_offset,
+        fit - period, sigma, CLK_SYS / fit, ok? "OK": "FAIL");
+    return ok;
+}
+
+static char last_line[PET_LINE_LEN];
+static uint32_t lines;
+
+static void capture_line(const char* buf, uint16_t len, bool binary) {
+    snprintf(last_line, sizeof(last_line), "%.*s", (int)len, buf);
+    lines++;
+}
+
+// MODE OMEGA with CAPTURE TS, edges every period_ticks of picopet_ts
+static bool check_measure(uint64_t period_ticks, uint16_t avg, uint32_t gate_ms, const char* expect) {
+    static const char* const names[PET_MAX_CHANNELS] = {"ChA", "ChB", "ChC", "ChD"};
+    static struct PetMeasure m;
+    struct PetConfig cfg = {
+        .mode = PET_MODE_OMEGA,
+        .format = PET_FORMAT_TEXT,
+        .channels = 1,
+        .capture = PET_CAPTURE_TIMESTAMP,
+        .avg_periods = avg,
+        .gate_ms = gate_ms,
+        .hist_width = 1,
+    };
+    measure_init(&m, &cfg, CLK_SYS, names, capture_line);
+    lines = 0;
+    last_line[0] = '\0';
+    uint64_t ticks = 1000;
+    while (lines == 0) {
+        measure_timestamp(&m, 0, ticks);
+        ticks += period_ticks;
+    }
+    size_t len = strlen(expect);
+    bool ok = strncmp(last_line, expect, len) == 0 && last_line[len] == '\t';
+    printf("measure    period %12.0f AVG %5u GATE %6u ms  %s  %s\n", 2.0 * period_ticks, avg, gate_ms, strtok(last_line, "\t"),
+        ok? "OK": "FAIL");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    uint32_t gates = 200;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-j") == 0 && a+1 < argc) {
+            jitter = atof(argv[++a]);
+        } else if (strcmp(argv[a], "-g") == 0 && a+1 < argc) {
+            gates = atoi(argv[++a]);
+        } else {
+            fprintf(stderr, "Usage: %s [-j jitter] [-g gates]\n", argv[0]);
+            return 2;
+        }
+    }
+    uint32_t failed = 0, cases = 0;
+    static const uint32_t short_gates[] = {10, 100, 1000, 10000};
+    static const double periods[] = {20.3, 240.7, 12345.67};
+    for (uint8_t p = 0; p < sizeof(periods)/sizeof(periods[0]); p++) {
+        for (uint8_t k = 0; k < sizeof(short_gates)/sizeof(short_gates[0]); k++) {
+            failed += !check_resolution(periods[p], short_gates[k], gates);
+            cases++;
+        }
+    }
+    failed += !check_gate("long", 240.7, 5000000, 0);
+    failed += !check_gate("long", 240.7, 10000000, 0);
+    failed += !check_gate("long", 240.7, 60000000, 0);
+    failed += !check_gate("long", 20.3, 60000000, 0);
+    failed += !check_gate("offset", 240.7, 10000000, 5);
+    failed += !check_gate("offset", 240.7, 10000000, -7);
+    failed += !check_gate("offset", 240.7, 100, -7);
+    failed += !check_gate("wide", 4800000000.3, 100, 0);
+    failed += !check_gate("wide", 4800000000.3, 1000, 3);
+    failed += !check_measure(120, 1, 1000, "1000000.000000000");
+    failed += !check_measure(120, 1, 10000, "1000000.000000000");
+    failed += !check_measure(240000, 10000, 60000, "500.000000000");
+    failed += !check_measure(1200000000, 1, 60000, "0.100000000");
+    cases += 13;
+    printf("%u of %u cases failed\n", failed, cases);
+    return (failed == 0)? 0: 1;
+}
@@ -0,0 +1,240 @@
+/*
+    petout checks the batched output writer of the firmware (outWriter.c) with a simulated
+    link and clock.
+
+    Usage: petout [-n writes]
+        -n  writes per stream case, default 20000
+    The link records every send, the clock advances only when the check says so (and by
+    1 us per poll of a busy link).
+      stream    random writes of 1 to 300 bytes with and without crlf under several
+                policies, the bytes sent have to be the written ones (a CR before every
+                LF with crlf) in order, no batch larger than OUT_HALF_SIZE
+      packets   with flush_bytes of a packet or more, a batch sent by size is a multiple
+                of OUT_PACKET and at least flush_bytes rounded down to whole packets (or
+                the whole packets of a full half), the rest stays buffered
+      deadline  a batch goes once its oldest byte waited flush_us, not earlier, and not
+                later when more bytes follow; flush_us 0 sends only by size
+      busy      a batch ready while the previous one is in flight waits for it and
+                counts the wait
+    Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "outWriter.h"
+
+#define STREAM_MAX (16 << 20)
+
+static uint8_t* sent;                   // all bytes sent
+static uint32_t sent_len;
+static uint32_t sends;
+static uint16_t last_send;              // length of the last send
+static bool size_batches_whole;         // all sends inside out_write were whole packets
+static bool in_write;
+static bool batch_too_large;
+static uint32_t now_us;
+static uint32_t busy_polls;             // the link stays busy for this many polls
+
+static uint64_t rnd_state = 88172645463325252ull;
+
+static uint32_t rnd() {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state >> 32;
+}
+
+static void link_send(const uint8_t* buf, uint16_t len) {
+    if (sent_len + len <= STREAM_MAX) {
+        memcpy(sent + sent_len, buf, len);
+    }
+    sent_len += len;
+    sends++;
+    last_send = len;
+    if (in_write && len % OUT_PACKET != 0) {
+        size_batches_whole = false;
+    }
+    if (len > OUT_HALF_SIZE) {
+        batch_too_large = true;
+    }
+}
+
+static bool link_busy() {
+    if (busy_polls > 0) {
+        busy_polls--;
+        now_us++;
+        return true;
+    }
+    return false;
+}
+
+static uint32_t clock_us() {
+    return now_us;
+}
+
+static void reset() {
+    sent_len = 0;
+    sends = 0;
+    last_send = 0;
+    size_batches_whole = true;
+    in_write = false;
+    batch_too_large = false;
+    now_us = 0;
+    busy_polls = 0;
+}
+
+static void write_out(struct OutWriter* w, const char* data, uint16_t len, bool crlf) {
+    in_write = true;
+    out_write(w, data, len, crlf);
+    in_write = false;
+}
+
+static bool check_stream(uint16_t flush_bytes, uint32_t flush_us, bool crlf, uint32_t writes) {
+    static struct OutWriter w;
+    static uint8_t expect[STREAM_MAX];
+    uint32_t expect_len = 0;
+    reset();
+    out_init(&w, link_send, link_busy, clock_us);
+    out_set_policy(&w, flush_bytes, flush_us);
+    char data[300];
+    for (uint32_t k = 0; k < writes; k++) {
+        uint16_t len = 1 + rnd() % sizeof(data);
+        for (uint16_t i = 0; i < len; i++) {
+            data[i] = (rnd() % 8 == 0)? '\n': 'a' + rnd() % 26;
+            if (crlf && data[i] == '\n') {
+                expect[expect_len++] = '\r';
+            }
+            expect[expect_len++] = data[i];
+        }
+        write_out(&w, data, len, crlf);
+        now_us += rnd() % 200;
+        busy_polls = rnd() % 4;
+        out_poll(&w);
+    }
+    out_flush(&w);
+    bool ok = sent_len == expect_len && memcmp(sent, expect, expect_len) == 0 && !batch_too_large && w.stats.bytes == sent_len
+        && w.stats.batches == sends;
+    if (flush_bytes >= OUT_PACKET) {
+        ok = ok && size_batches_whole;
+    }
+    printf("stream    flush_bytes %4u flush_us %5u crlf %u  %8u bytes in %6u batches, %6u by deadline  %s\n", flush_bytes, flush_us, crlf,
+        sent_len, sends, w.stats.deadline_batches, ok? "OK": "FAIL");
+    return ok;
+}
+
+// writes of len bytes until the first send, the batch and the rest buffered
+static bool check_packets(uint16_t flush_bytes, uint16_t len) {
+    static struct OutWriter w;
+    reset();
+    out_init(&w, link_send, link_busy, clock_us);
+    out_set_policy(&w, flush_bytes, 0);
+    char data[300];
+    memset(data, 'x', sizeof(data));
+    uint32_t written = 0;
+    while (sends == 0) {
+        write_out(&w, data, len, false);
+        written += len;
+    }
+    uint16_t whole = flush_bytes - flush_bytes % OUT_PACKET;
+    if (whole > OUT_HALF_SIZE - OUT_PACKET) {
+        whole = OUT_HALF_SIZE - OUT_PACKET;         // a full half goes before flush_bytes
+    }
+    bool ok = last_send % OUT_PACKET == 0 && last_send >= whole && last_send + w.len == written && w.len < last_send + OUT_PACKET
+        && written - len < flush_bytes && written >= flush_bytes;
+    printf("packets   flush_bytes %4u writes of %3u  batch %4u, %3u buffered  %s\n", flush_bytes, len, last_send, w.len, ok? "OK": "FAIL");
+    return ok;
+}
+
+static bool check_deadline() {
+    static struct OutWriter w;
+    bool ok = true;
+    reset();
+    out_init(&w, link_send, link_busy, clock_us);
+    out_set_policy(&w, 1024, 1000);
+    now_us = 5000;
+    write_out(&w, "12345\n", 6, false);
+    now_us = 5500;
+    write_out(&w, "67890\n", 6, false);
+    now_us = 5999;
+    out_poll(&w);
+    ok = ok && sends == 0;
+    now_us = 6000;
+    out_poll(&w);
+    ok = ok && sends == 1 && last_send == 12 && w.stats.deadline_batches == 1;
+    // the next batch counts from its own first byte
+    now_us = 6500;
+    write_out(&w, "abc\n", 4, false);
+    now_us = 7499;
+    out_poll(&w);
+    ok = ok && sends == 1;
+    now_us = 7500;
+    out_poll(&w);
+    ok = ok && sends == 2 && last_send == 4;
+    // nothing buffered, nothing sent
+    now_us = 20000;
+    out_poll(&w);
+    ok = ok && sends == 2;
+    // flush_us 0 waits for the size
+    out_set_policy(&w, 1024, 0);
+    write_out(&w, "abc\n", 4, false);
+    now_us = 1000000;
+    out_poll(&w);
+    ok = ok && sends == 2;
+    out_flush(&w);
+    ok = ok && sends == 3 && last_send == 4 && w.stats.deadline_batches == 2;
+    printf("deadline  %u batches, %u by deadline  %s\n", sends, w.stats.deadline_batches, ok? "OK": "FAIL");
+    return ok;
+}
+
+static bool check_busy() {
+    static struct OutWriter w;
+    reset();
+    out_init(&w, link_send, link_busy, clock_us);
+    out_set_policy(&w, 64, 0);
+    char data[64];
+    memset(data, 'x', sizeof(data));
+    write_out(&w, data, 64, false);
+    busy_polls = 25;                    // the first batch is in flight for 25 us
+    write_out(&w, data, 64, false);
+    // the poll that finds the link busy is before the wait starts
+    bool ok = sends == 2 && busy_polls == 0 && w.stats.waits == 1 && w.stats.blocked_us >= 24 && w.stats.blocked_us <= 25;
+    write_out(&w, data, 64, false);     // idle link, no wait
+    ok = ok && sends == 3 && w.stats.waits == 1;
+    busy_polls = 10;
+    out_flush(&w);                      // waits until the last batch left
+    ok = ok && busy_polls == 0 && w.stats.waits == 2;
+    printf("busy      %u batches, %u waits, %u us blocked  %s\n", sends, w.stats.waits, w.stats.blocked_us, ok? "OK": "FAIL");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    uint32_t writes = 20000;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-n") == 0 && a+1 < argc) {
+            writes = atoi(argv[++a]);
+        } else {
+            fprintf(stderr, "Usage: %s [-n writes]\n", argv[0]);
+            return 2;
+        }
+    }
+    sent = malloc(STREAM_MAX);
+    uint32_t failed = 0, cases = 0;
+    static const uint16_t policies[][2] = {{1, 0}, {40, 0}, {64, 0}, {100, 0}, {512, 2000}, {2048, 0}, {2048, 500}, {4096, 100}};
+    for (uint8_t p = 0; p < sizeof(policies)/sizeof(policies[0]); p++) {
+        for (uint8_t crlf = 0; crlf < 2; crlf++) {
+            failed += !check_stream(policies[p][0], policies[p][1], crlf, writes);
+            cases++;
+        }
+    }
+    static const uint16_t packet_cases[][2] = {{64, 10}, {64, 64}, {100, 7}, {100, 300}, {512, 33}, {1000, 250}, {2048, 300}};
+    for (uint8_t p = 0; p < sizeof(packet_cases)/sizeof(packet_cases[0]); p++) {
+        failed += !check_packets(packet_cases[p][0], packet_cases[p][1]);
+        cases++;
+    }
+    failed += !check_deadline();
+    failed += !check_busy();
+    cases += 2;
+    printf("%u of %u cases failed\n", failed, cases);
+    return (failed == 0)? 0: 1;
+}
@@ -0,0 +1,128 @@
+/*
+    petpio checks the PIO resource allocator (pioAlloc.c) for every supported configuration.
+    The program lengths are taken from the .pio sources as the firmware gets them from
+    pioasm, the programs and their selection follow plan_pios() of picoPET.c.
+
+    Usage: petpio [-d dir]
+        -d  directory with the .pio sources, default is the source tree
+    For every CAPTURE, AVG and CH the layout has to fit, and:
+      - no block uses more than the 32 words of instruction memory, each program is
+        loaded once per block and counted once
+      - no state machine is used twice, each channel has its counting state machines
+        (two with CAPTURE HR, in one block so they start in sync) and all counting state
+        machines of CAPTURE TS are in pio0, they share one counter started in sync
+      - a led indicator is left out only when no block has a free state machine or the
+        memory for indicator_led
+    Prints the memory and state machines used per block and the led indicators.
+    Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "pioEmu.h"
+#include "pioAlloc.h"
+#include "measure.h"
+
+#ifndef PIO_DIR
+#define PIO_DIR "."
+#endif
+
+enum { PROG_SP, PROG_MP, PROG_TS, PROG_HR, PROG_DE, PROG_LED, PROG_COUNT };     // picoPET.c order
+static const char* program_names[] = {"picopet_sp", "picopet_mp", "picopet_ts", "picopet_hr", "picopet_de", "indicator_led"};
+static const char* program_files[] = {"picoPET_sp.pio", "picoPET_mp.pio", "picoPET_ts.pio", "picoPET_hr.pio", "picoPET_de.pio",
+    "indicator_led.pio"};
+static const char* capture_names[] = {"PERIOD", "TS", "HR", "EDGE"};     // in PET_CAPTURE_... order
+
+static struct EmuProgram programs[PROG_COUNT];
+
+// counting_program() of picoPET.c
+static uint8_t counting_program(uint8_t capture, uint16_t avg) {
+    if (capture == PET_CAPTURE_TIMESTAMP) {
+        return PROG_TS;
+    } else if (capture == PET_CAPTURE_INTERLEAVED) {
+        return PROG_HR;
+    } else if (capture == PET_CAPTURE_EDGES) {
+        return PROG_DE;
+    }
+    return (avg == 1)? PROG_SP: PROG_MP;
+}
+
+static bool check(uint8_t capture, uint16_t avg, uint8_t channels, const uint8_t* prog_len) {
+    struct PioPlan plan;
+    uint8_t prog = counting_program(capture, avg);
+    uint8_t sms = (capture == PET_CAPTURE_INTERLEAVED)? 2: 1;
+    bool one_block = capture == PET_CAPTURE_TIMESTAMP;
+    bool ok = pio_plan_layout(&plan, channels, prog, sms, one_block, PROG_LED, prog_len);
+    uint8_t used_sms[PIO_BLOCKS] = {0, 0};
+    uint8_t led_blocks = 0;             // blocks with indicator_led loaded
+    for (uint8_t i = 0; i < channels && ok; i++) {
+        const struct PioChannelPlan* ch = &plan.ch[i];
+        ok = ch->pio < PIO_BLOCKS && ((plan.loaded[ch->pio] >> prog) & 1) && (!one_block || ch->pio == 0);
+        for (uint8_t k = 0; k < PIO_MAX_CHANNEL_SMS && ok; k++) {
+            if (k >= sms) {
+                ok = ch->sm[k] == PIO_NO_SM;
+            } else {
+                ok = ch->sm[k] < PIO_SMS && ((used_sms[ch->pio] >> ch->sm[k]) & 1) == 0;
+                used_sms[ch->pio] |= 1u << ch->sm[k];
+            }
+        }
+        if (ok && ch->led_sm != PIO_NO_SM) {
+            ok = ch->led_pio < PIO_BLOCKS && ch->led_sm < PIO_SMS && ((used_sms[ch->led_pio] >> ch->led_sm) & 1) == 0
+                && ((plan.loaded[ch->led_pio] >> PROG_LED) & 1);
+            used_sms[ch->led_pio] |= 1u << ch->led_sm;
+        }
+    }
+    for (uint8_t b = 0; b < PIO_BLOCKS && ok; b++) {
+        uint8_t mem = 0;
+        for (uint8_t p = 0; p < PROG_COUNT; p++) {
+            mem += ((plan.loaded[b] >> p) & 1)? prog_len[p]: 0;
+        }
+        ok = mem == plan.used_mem[b] && mem <= PIO_MEM_WORDS && used_sms[b] == plan.used_sms[b];
+        led_blocks += (plan.loaded[b] >> PROG_LED) & 1;
+    }
+    uint8_t leds = pio_plan_leds(&plan);
+    if (ok && leds < channels) {
+        // a block with a free state machine and room for indicator_led would take the indicator
+        for (uint8_t b = 0; b < PIO_BLOCKS; b++) {
+            bool mem = ((plan.loaded[b] >> PROG_LED) & 1) || plan.used_mem[b] + prog_len[PROG_LED] <= PIO_MEM_WORDS;
+            ok = ok && !(mem && plan.used_sms[b] != (1u << PIO_SMS) - 1);
+        }
+    }
+    printf("CAPTURE %-6s AVG %-5u CH %u  %-13s pio0 %2u words sms %x  pio1 %2u words sms %x  leds %u  %s\n", capture_names[capture], avg, channels,
+        program_names[prog], plan.used_mem[0], plan.used_sms[0], plan.used_mem[1], plan.used_sms[1], leds, ok? "OK": "FAIL");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* dir = PIO_DIR;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-d") == 0 && a+1 < argc) {
+            dir = argv[++a];
+        } else {
+            fprintf(stderr, "Usage: %s [-d dir]\n", argv[0]);
+            return 2;
+        }
+    }
+    uint8_t prog_len[PROG_COUNT];
+    for (uint8_t p = 0; p < PROG_COUNT; p++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, program_files[p]);
+        if (!emu_load(&programs[p], path, program_names[p])) {
+            fprintf(stderr, "%s: %s\n", path, emu_error());
+            return 1;
+        }
+        prog_len[p] = programs[p].length;
+    }
+    static const uint16_t avgs[] = {1, 2, PET_MAX_AVG_PERIODS};
+    uint32_t failed = 0, cases = 0;
+    for (uint8_t capture = 0; capture < PET_CAPTURES; capture++) {
+        for (uint8_t a = 0; a < sizeof(avgs)/sizeof(avgs[0]); a++) {
+            for (uint8_t channels = 1; channels <= PET_MAX_CHANNELS; channels++) {
+                failed += !check(capture, avgs[a], channels, prog_len);
+                cases++;
+            }
+        }
+    }
+    printf("%u of %u cases failed\n", failed, cases);
+    return (failed == 0)? 0: 1;
+}
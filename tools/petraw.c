@@ -0,0 +1,286 @@
+/*
+    petraw checks that a raw capture (FORMAT RAW) replayed by petreplay prints the same lines
+    as the text output of the firmware for the same values.
+
+    Usage: petraw [-r petreplay] [-k]
+        -r  path of petreplay, default ./petreplay
+        -k  keep the files of the cases (petraw<n>.raw, petraw<n>.txt)
+    Every case feeds the values of three channels through measure.c twice, with FORMAT RAW
+    (as process_records() does, measure_raw() ahead of every value) and with FORMAT TEXT,
+    and compares the text with the output of petreplay -j <threads>. The text output is
+    split the way petreplay splits the channels, so the expected output of several threads
+    is the lines of each thread's channels in turn, the TIMEBASE lines in every one of them.
+      - period, timestamp, phase interleaved and dual-edge capture, AVG 1 and 10
+      - TIMEMARK, FREQ with and without a gate, COUNT, STAB, OMEGA, HIST, TIC, WIDTH, DUTY
+      - a timebase switch in the middle, which petreplay replays from the raw config frame
+      - 1, 2 and 3 threads, the shared timescale has to survive the split
+    Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "measure.h"
+
+#define CHANNELS 3
+
+struct RawCase
+{
+    uint8_t mode;
+    uint8_t capture;
+    uint16_t avg;
+    uint16_t gate_ms;
+    uint8_t hist_value;
+    uint32_t edges;                     // per channel
+    uint32_t switch_freq;               // clk_sys after half of the edges, 0 for none
+    uint8_t threads;
+};
+
+static FILE* raw_out;
+static FILE* thread_out[CHANNELS];
+static int8_t target;                   // thread of the text output, -1 all of them
+static uint8_t threads;
+static uint64_t rnd_state = 88172645463325252ull;
+
+static uint32_t rnd() {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return rnd_state >> 32;
+}
+
+static void write_raw(const char* buf, uint16_t len, bool binary) {
+    fwrite(buf, 1, len, raw_out);
+}
+
+static void write_split(const char* buf, uint16_t len, bool binary) {
+    for (uint8_t t = 0; t < threads; t++) {
+        if (target < 0 || target == t) {
+            fwrite(buf, 1, len, thread_out[t]);
+        }
+    }
+}
+
+// one value of channel i as core 1 gets it from the queue
+static void value(struct PetMeasure* m, uint8_t i, uint8_t phase, uint64_t v) {
+    target = i % threads;
+    if (m->cfg.format == PET_FORMAT_RAW) {
+        measure_raw(m, i, phase, v);
+    }
+    switch (m->cfg.capture) {
+        case PET_CAPTURE_TIMESTAMP:
+            measure_timestamp(m, i, v);
+            break;
+        case PET_CAPTURE_INTERLEAVED:
+            measure_count_phase(m, i, phase, (uint32_t)v);
+            break;
+        case PET_CAPTURE_EDGES:
+            measure_edge(m, i, phase, (uint32_t)v);
+            break;
+        default:
+            measure_count(m, i, (uint32_t)v);
+    }
+}
+
+// the edges of the channels in time order at 240 MHz, then at switch_freq, with a few cycles of jitter
+static void feed(const struct RawCase* c, uint8_t format) {
+    static const char* const names[PET_MAX_CHANNELS] = {"ChA", "ChB", "ChC", "ChD"};
+    static const double period[CHANNELS] = {1.0e-4, 1.37e-4, 0.91e-4};
+    static struct PetMeasure m;
+    struct PetConfig cfg = {
+        .mode = c->mode,
+        .format = format,
+        .channels = CHANNELS,
+        .capture = c->capture,
+        .avg_periods = c->avg,
+        .gate_ms = c->gate_ms,
+        .hist_width = 1,
+        .hist_value = c->hist_value,
+    };
+    uint64_t freq = 240000000;
+    uint64_t switch_cycles = 0;
+    rnd_state = 88172645463325252ull;
+    measure_init(&m, &cfg, freq, names, (format == PET_FORMAT_RAW)? write_raw: write_split);
+    target = 0;
+    measure_header(&m);
+    uint32_t n[CHANNELS] = {0, 0, 0};
+    uint64_t last[CHANNELS] = {0, 0, 0};    // cycles of the last value of period capture
+    for (;;) {
+        uint8_t i = CHANNELS;
+        for (uint8_t k = 0; k < CHANNELS; k++) {
+            if (n[k] < c->edges && (i == CHANNELS || (n[k] + 1) * period[k] < (n[i] + 1) * period[i])) {
+                i = k;
+            }
+        }
+        if (i == CHANNELS) {
+            break;
+        }
+        uint64_t cycles = (uint64_t)((n[i] + 1) * period[i] * 240000000) + rnd() % 5;
+        if (c->switch_freq != 0 && switch_cycles == 0 && n[0] + n[1] + n[2] >= CHANNELS * c->edges / 2) {
+            switch_cycles = cycles - 100;
+            target = -1;
+            measure_set_clock(&m, c->switch_freq);
+            freq = c->switch_freq;
+        }
+        if (switch_cycles != 0) {
+            cycles = switch_cycles + (cycles - switch_cycles) * freq / 240000000;
+        }
+        uint64_t interval = cycles - last[i];
+        if (c->capture == PET_CAPTURE_TIMESTAMP) {
+            value(&m, i, 0, cycles / 2);
+        } else if (c->capture == PET_CAPTURE_EDGES) {
+            // every period: the high time on the falling edge, the low time on the rising one
+            if (n[i] > 0) {
+                uint64_t high = interval * 3 / 10;
+                value(&m, i, 0, ~(uint32_t)((high - m.cor_offset[i]) / 2));
+                value(&m, i, 1, ~(uint32_t)((interval - high - m.cor_offset[i]) / 2));
+            }
+            last[i] = cycles;
+        } else if (n[i] > 0 && n[i] % c->avg == 0) {
+            // picopet_sp/mp/hr count the avg periods since their last value
+            uint32_t counted = ~(uint32_t)((interval - m.cor_offset[i]) / 2);
+            value(&m, i, 0, counted);
+            if (c->capture == PET_CAPTURE_INTERLEAVED) {
+                value(&m, i, 1, counted);
+            }
+            last[i] = cycles;
+        } else if (n[i] == 0) {
+            last[i] = cycles;
+        }
+        n[i]++;
+    }
+    if (format == PET_FORMAT_TEXT && c->mode == PET_MODE_STABILITY) {
+        for (uint8_t t = 0; t < threads; t++) {
+            target = t;
+            for (uint8_t i = t; i < CHANNELS; i += threads) {
+                measure_stability_channel(&m, i);
+            }
+        }
+    }
+}
+
+static char* read_all(FILE* f, size_t* len) {
+    size_t size = 1 << 16;
+    char* buf = malloc(size);
+    *len = 0;
+    size_t k;
+    while ((k = fread(buf + *len, 1, size - *len, f)) > 0) {
+        *len += k;
+        if (*len == size) {
+            size *= 2;
+            buf = realloc(buf, size);
+        }
+    }
+    return buf;
+}
+
+static bool compare(const char* a, size_t la, const char* b, size_t lb, char* first_diff, size_t len) {
+    uint32_t line = 1;
+    size_t k = 0;
+    while (k < la && k < lb && a[k] == b[k]) {
+        line += (a[k++] == '\n');
+    }
+    if (k == la && k == lb) {
+        return true;
+    }
+    size_t start = k;
+    while (start > 0 && a[start - 1] != '\n') {
+        start--;
+    }
+    int na = (int)(strcspn(a + start, "\n"));
+    int nb = (int)(strcspn(b + start, "\n"));
+    na = (start + na > la)? (int)(la - start): na;
+    nb = (start + nb > lb)? (int)(lb - start): nb;
+    snprintf(first_diff, len, "line %u: text \"%.*s\" replayed \"%.*s\"", line, na, a + start, nb, b + start);
+    return false;
+}
+
+static bool check(uint8_t k, const struct RawCase* c, const char* replay, bool keep) {
+    static const char* capture_names[] = {"PERIOD", "TS", "HR", "EDGE"};
+    char raw[64], txt[64], cmd[1024], diff[600] = "";
+    snprintf(raw, sizeof(raw), "petraw%u.raw", k);
+    snprintf(txt, sizeof(txt), "petraw%u.txt", k);
+    threads = c->threads;
+    raw_out = fopen(raw, "wb");
+    feed(c, PET_FORMAT_RAW);
+    fclose(raw_out);
+    for (uint8_t t = 0; t < threads; t++) {
+        thread_out[t] = tmpfile();
+    }
+    feed(c, PET_FORMAT_TEXT);
+    // the blocks of the threads one after the other, as petreplay prints them
+    FILE* expect = fopen(txt, "w+");
+    for (uint8_t t = 0; t < threads; t++) {
+        size_t len;
+        rewind(thread_out[t]);
+        char* buf = read_all(thread_out[t], &len);
+        fwrite(buf, 1, len, expect);
+        free(buf);
+        fclose(thread_out[t]);
+    }
+    rewind(expect);
+    snprintf(cmd, sizeof(cmd), "%s -m %s -g %u%s -j %u %s 2>/dev/null", replay, measure_mode_name(c->mode), c->gate_ms,
+        (c->hist_value == PET_HIST_TIE)? " -t": "", c->threads, raw);
+    FILE* replayed = popen(cmd, "r");
+    size_t la, lb = 0;
+    char* a = read_all(expect, &la);
+    char* b = (replayed != NULL)? read_all(replayed, &lb): NULL;
+    bool ok = b != NULL && compare(a, la, b, lb, diff, sizeof(diff));
+    ok = (replayed != NULL && pclose(replayed) == 0) && ok;
+    free(a);
+    free(b);
+    fclose(expect);
+    if (!keep) {
+        remove(raw);
+        remove(txt);
+    }
+    printf("%-8s CAPTURE %-6s AVG %-3u GATE %4u ms%s -j %u%s  %s%s%s\n", measure_mode_name(c->mode), capture_names[c->capture], c->avg,
+        c->gate_ms, (c->hist_value == PET_HIST_TIE)? " TIE": "", c->threads, c->switch_freq? " switch": "", ok? "OK": "FAIL", ok? "": ", ",
+        diff);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    const char* replay = "./petreplay";
+    bool keep = false;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-r") == 0 && a+1 < argc) {
+            replay = argv[++a];
+        } else if (strcmp(argv[a], "-k") == 0) {
+            keep = true;
+        } else {
+            fprintf(stderr, "Usage: %s [-r petreplay] [-k]\n", argv[0]);
+            return 2;
+        }
+    }
+    static const struct RawCase cases[] = {
+        {PET_MODE_TIMEMARK, PET_CAPTURE_PERIOD, 1, 0, 0, 3000, 0, 1},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_PERIOD, 1, 0, 0, 3000, 0, 2},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_PERIOD, 10, 0, 0, 3000, 0, 3},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_PERIOD, 1, 0, 0, 3000, 200000000, 2},
+        {PET_MODE_FREQUENCY, PET_CAPTURE_PERIOD, 10, 0, 0, 3000, 0, 2},
+        {PET_MODE_FREQUENCY, PET_CAPTURE_PERIOD, 1, 50, 0, 3000, 200000000, 3},
+        {PET_MODE_CYCLE_COUNT, PET_CAPTURE_PERIOD, 1, 0, 0, 3000, 200000000, 1},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_TIMESTAMP, 1, 0, 0, 3000, 0, 1},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_TIMESTAMP, 10, 0, 0, 3000, 0, 3},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_TIMESTAMP, 1, 0, 0, 3000, 200000000, 2},
+        {PET_MODE_OMEGA, PET_CAPTURE_TIMESTAMP, 1, 50, 0, 3000, 0, 2},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_INTERLEAVED, 1, 0, 0, 3000, 0, 2},
+        {PET_MODE_FREQUENCY, PET_CAPTURE_INTERLEAVED, 10, 0, 0, 3000, 200000000, 3},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_EDGES, 1, 0, 0, 3000, 0, 1},
+        {PET_MODE_TIMEMARK, PET_CAPTURE_EDGES, 1, 0, 0, 3000, 0, 3},
+        {PET_MODE_WIDTH, PET_CAPTURE_EDGES, 10, 0, 0, 3000, 0, 2},
+        {PET_MODE_DUTY, PET_CAPTURE_EDGES, 10, 0, 0, 3000, 200000000, 2},
+        {PET_MODE_STABILITY, PET_CAPTURE_PERIOD, 1, 0, 0, 3000, 0, 2},
+        {PET_MODE_HIST, PET_CAPTURE_PERIOD, 1, 50, PET_HIST_PERIOD, 3000, 0, 2},
+        {PET_MODE_HIST, PET_CAPTURE_TIMESTAMP, 1, 50, PET_HIST_TIE, 3000, 0, 3},
+        {PET_MODE_TIC, PET_CAPTURE_PERIOD, 1, 0, 0, 3000, 0, 1},
+    };
+    uint32_t failed = 0, cases_run = 0;
+    for (uint8_t k = 0; k < sizeof(cases)/sizeof(cases[0]); k++) {
+        failed += !check(k, &cases[k], replay, keep);
+        cases_run++;
+    }
+    printf("%u of %u cases failed\n", failed, cases_run);
+    return (failed == 0)? 0: 1;
+}
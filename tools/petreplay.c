@@ -0,0 +1,455 @@
+/*
+    petreplay runs a raw capture of PicoPET (FORMAT RAW) through the measurement engine of
+    the firmware (measure.c) again, so timemarks, frequencies or stability of one run can
+    be derived offline, with other corrections, averaging or gate time.
+
+    Usage: petreplay [-m mode] [-a avg] [-g gate] [-w width] [-t] [-o off,...] [-j threads] [-p prefix] file
+        -m  output mode TIMEMARK|FREQ|COUNT|STAB|OMEGA|TIC|HIST|WIDTH|DUTY, default TIMEMARK,
+            WIDTH and DUTY of a dual-edge capture (CAPTURE EDGE)
+        -a  process every avg-th edge, timestamp and dual-edge capture only, default as captured
+        -g  gate time in ms of FREQ, OMEGA and HIST
+        -w  bin width of HIST in cycles, -t histogram of the TIE instead of the intervals
+        -o  cor_offset per channel instead of the ones in the capture, e.g. -o 3,3,4,3
+        -j  number of threads, default one per channel
+        -p  write the output of each channel to <prefix>ChA.txt, ... instead of stdout,
+            of TIC to <prefix>.txt
+    The capture is memory-mapped and decoded once: the decoding thread keeps the shared
+    timescale of all channels (first sensed input, timestamp base, clock switches) and hands
+    the corrected intervals with their timemarks in chunks to the threads, each thread runs
+    the output routine for its own channels only. Without -p the output of the threads
+    follows on stdout one after the other, with -j 1 the lines are in the order the device
+    would have printed them.
+    The raw config frames in the capture carry the timebase and the corrections in use,
+    a new frequency is replayed as the clock switch of the device, a new capture or
+    channel count starts a new timescale. TIC pairs the channels and runs in one thread.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "binOut.h"
+#include "measure.h"
+
+static const char* channel_names[PET_MAX_CHANNELS] = {"ChA", "ChB", "ChC", "ChD"};
+
+#define CHUNK_VALUES 16384              // values per thread and chunk
+#define CHUNK_CONFIGS 16
+#define CHUNKS 4                        // chunks in flight between the decoding thread and the others
+
+enum { VALUE_RISE, VALUE_FALL, VALUE_CONFIG };
+
+struct ReplayValue
+{
+    uint8_t type;
+    uint8_t channel;
+    uint64_t clk_cor;                   // interval of VALUE_RISE, config of the chunk with VALUE_CONFIG
+    uint64_t tm;                        // timemark of the channel, of the falling edge with VALUE_FALL
+    uint64_t edge_high;                 // high time of the periods, dual-edge capture
+};
+
+struct Chunk
+{
+    struct ReplayValue* values[PET_MAX_CHANNELS];   // per thread
+    uint32_t len[PET_MAX_CHANNELS];
+    struct BinRawConfig configs[CHUNK_CONFIGS];
+    uint8_t config_count;
+    uint64_t seq;                       // number of the chunk + 1 once it is handed over
+    uint8_t readers;                    // threads still processing it
+    bool last;
+};
+
+struct Replay
+{
+    uint8_t mask;                       // bit mask of the channels output by the thread
+    uint8_t index;
+    bool header;                        // write the header of the output
+    FILE* out;
+    bool started;                       // a raw config was seen
+    struct BinRawConfig raw;            // config of the values being replayed
+    struct PetMeasure m;
+    uint64_t values;
+    pthread_t thread;
+};
+
+static const uint8_t* data;
+static size_t data_len;
+static struct PetConfig options;        // mode, gate and histogram of the replay
+static uint16_t avg_override;
+static bool offset_override;
+static uint32_t offsets[PET_MAX_CHANNELS];
+static __thread FILE* thread_out;
+
+static uint8_t threads;
+static uint8_t channel_thread[PET_MAX_CHANNELS];
+static struct Chunk chunks[CHUNKS];
+static struct Chunk* filling;           // chunk of the decoding thread
+static uint64_t chunks_sent;
+static pthread_mutex_t chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t chunk_ready = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t chunk_done = PTHREAD_COND_INITIALIZER;
+
+
+static void replay_write(const char* buf, uint16_t len, bool binary) {
+    fwrite(buf, 1, len, thread_out);
+}
+
+static void discard(const char* buf, uint16_t len, bool binary) {
+    // the decoding thread keeps the timescale only
+}
+
+static void configure(struct Replay* r, const struct BinRawConfig* raw, pet_write_fn write) {
+    bool core1_avg = raw->capture == PET_CAPTURE_TIMESTAMP || raw->capture == PET_CAPTURE_EDGES;
+    uint16_t avg = (avg_override > 0 && core1_avg)? avg_override: raw->avg_periods;
+    if (!r->started || raw->capture != r->raw.capture || raw->channels != r->raw.channels) {
+        // new timescale, as the device does after a new CONFIG
+        struct PetConfig cfg = options;
+        cfg.capture = raw->capture;
+        cfg.channels = (raw->channels <= PET_MAX_CHANNELS)? raw->channels: PET_MAX_CHANNELS;
+        cfg.avg_periods = avg;
+        measure_init(&r->m, &cfg, raw->clk_src_freq, channel_names, write);
+        if (r->header) {
+            measure_header(&r->m);
+        }
+        r->started = true;
+    } else {
+        if (avg != r->m.cfg.avg_periods) {
+            struct PetConfig cfg = r->m.cfg;
+            cfg.avg_periods = avg;
+            measure_set_config(&r->m, &cfg);
+        }
+        if (raw->clk_src_freq != r->m.clk_src_freq) {
+            measure_set_clock(&r->m, raw->clk_src_freq);
+        }
+    }
+    r->raw = *raw;
+    for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+        r->m.cor_offset[i] = offset_override? offsets[i]: raw->cor_offset[i];
+    }
+}
+
+// hands the filled chunk to the threads and waits until the next one is free
+static void send_chunk(bool last) {
+    pthread_mutex_lock(&chunk_lock);
+    filling->last = last;
+    filling->readers = threads;
+    filling->seq = ++chunks_sent;
+    pthread_cond_broadcast(&chunk_ready);
+    filling = &chunks[chunks_sent % CHUNKS];
+    while (filling->readers > 0) {
+        pthread_cond_wait(&chunk_done, &chunk_lock);
+    }
+    pthread_mutex_unlock(&chunk_lock);
+    memset(filling->len, 0, sizeof(filling->len));
+    filling->config_count = 0;
+}
+
+static void add_value(uint8_t t, uint8_t type, uint8_t i, uint64_t clk_cor, uint64_t tm, uint64_t edge_high) {
+    if (filling->len[t] == CHUNK_VALUES) {
+        send_chunk(false);
+    }
+    struct ReplayValue* v = &filling->values[t][filling->len[t]++];
+    v->type = type;
+    v->channel = i;
+    v->clk_cor = clk_cor;
+    v->tm = tm;
+    v->edge_high = edge_high;
+}
+
+static void capture_rise(struct PetMeasure* m, uint8_t i, uint64_t clk_cor) {
+    add_value(channel_thread[i], VALUE_RISE, i, clk_cor, m->tm[i], m->edge_high[i]);
+}
+
+static void capture_fall(struct PetMeasure* m, uint8_t i, uint64_t tm) {
+    add_value(channel_thread[i], VALUE_FALL, i, 0, tm, 0);
+}
+
+static void decode_config(struct Replay* r, const struct BinRawConfig* raw) {
+    configure(r, raw, discard);
+    r->m.process = capture_rise;
+    r->m.fall = capture_fall;
+    if (filling->config_count == CHUNK_CONFIGS) {
+        send_chunk(false);
+    }
+    filling->configs[filling->config_count] = *raw;
+    for (uint8_t t = 0; t < threads; t++) {
+        add_value(t, VALUE_CONFIG, 0, filling->config_count, 0, 0);
+    }
+    filling->config_count++;
+}
+
+static void decode_value(struct Replay* r, const struct BinFrame* f) {
+    uint8_t i = f->channel % BIN_RAW_CHANNELS;
+    uint8_t phase = f->channel / BIN_RAW_CHANNELS;
+    if (i >= r->m.cfg.channels) {
+        return;
+    }
+    switch (r->m.cfg.capture) {
+        case PET_CAPTURE_TIMESTAMP:
+            measure_timestamp(&r->m, i, f->raw);
+            break;
+        case PET_CAPTURE_INTERLEAVED:
+            measure_count_phase(&r->m, i, phase, (uint32_t)f->raw);
+            break;
+        case PET_CAPTURE_EDGES:
+            measure_edge(&r->m, i, phase, (uint32_t)f->raw);
+            break;
+        default:
+            measure_count(&r->m, i, (uint32_t)f->raw);
+    }
+}
+
+// the only pass over the capture, the timescale of all channels is kept here
+static void decode(struct BinDecoder* d) {
+    static struct Replay r;
+    struct BinFrame f;
+    bin_decoder_init(d);
+    filling = &chunks[0];
+    for (size_t k = 0; k < data_len; k++) {
+        if (!bin_decode(d, data[k], &f)) {
+            continue;
+        }
+        if (f.type == BIN_FRAME_RAW_CONFIG) {
+            decode_config(&r, &f.raw_cfg);
+        } else if ((f.type == BIN_FRAME_RAW_ABS || f.type == BIN_FRAME_RAW_DELTA) && r.started) {
+            decode_value(&r, &f);
+        }
+    }
+    send_chunk(true);
+}
+
+// the output of the channels of the thread, the values come with their timemarks
+static void* replay_run(void* arg) {
+    struct Replay* r = arg;
+    thread_out = r->out;
+    for (uint64_t seq = 1; ; seq++) {
+        struct Chunk* c = &chunks[(seq - 1) % CHUNKS];
+        pthread_mutex_lock(&chunk_lock);
+        while (c->seq != seq) {
+            pthread_cond_wait(&chunk_ready, &chunk_lock);
+        }
+        pthread_mutex_unlock(&chunk_lock);
+        const struct ReplayValue* v = c->values[r->index];
+        for (uint32_t k = 0; k < c->len[r->index]; k++, v++) {
+            if (v->type == VALUE_CONFIG) {
+                configure(r, &c->configs[v->clk_cor], replay_write);
+            } else if (v->type == VALUE_FALL) {
+                r->m.fall(&r->m, v->channel, v->tm);
+            } else {
+                r->m.tm[v->channel] = v->tm;
+                r->m.edge_high[v->channel] = v->edge_high;
+                r->m.process(&r->m, v->channel, v->clk_cor);
+                r->values++;
+            }
+        }
+        bool last = c->last;
+        pthread_mutex_lock(&chunk_lock);
+        if (--c->readers == 0) {
+            pthread_cond_broadcast(&chunk_done);
+        }
+        pthread_mutex_unlock(&chunk_lock);
+        if (last) {
+            break;
+        }
+    }
+    if (r->started && r->m.cfg.mode == PET_MODE_STABILITY) {
+        for (uint8_t i = 0; i < r->m.cfg.channels; i++) {
+            if (r->mask & (1u << i)) {
+                measure_stability_channel(&r->m, i);
+            }
+        }
+    }
+    fflush(r->out);
+    return NULL;
+}
+
+// config of the first raw config frame, false if the file has none
+static bool first_config(struct BinRawConfig* raw) {
+    struct BinDecoder d;
+    struct BinFrame f;
+    bin_decoder_init(&d);
+    for (size_t k = 0; k < data_len; k++) {
+        if (bin_decode(&d, data[k], &f) && f.type == BIN_FRAME_RAW_CONFIG) {
+            *raw = f.raw_cfg;
+            return true;
+        }
+    }
+    return false;
+}
+
+static int usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-m mode] [-a avg] [-g gate] [-w width] [-t] [-o off,...] [-j threads] [-p prefix] file\n", name);
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    const char* fn = NULL;
+    const char* prefix = NULL;
+    int jobs = 0;
+    options.mode = PET_MODE_TIMEMARK;
+    options.format = PET_FORMAT_TEXT;
+    options.hist_width = 1;
+    options.hist_value = PET_HIST_PERIOD;
+    for (int a = 1; a < argc; a++) {
+        const char* arg = (a + 1 < argc)? argv[a + 1]: NULL;
+        if (strcmp(argv[a], "-m") == 0 && arg != NULL) {
+            uint8_t mode = 0;
+            while (mode < PET_MODES && strcasecmp(arg, measure_mode_name(mode)) != 0) {
+                mode++;
+            }
+            if (mode == PET_MODES) {
+                return usage(argv[0]);
+            }
+            options.mode = mode;
+            a++;
+        } else if (strcmp(argv[a], "-a") == 0 && arg != NULL) {
+            avg_override = atoi(arg);
+            if (avg_override < 1 || avg_override > PET_MAX_AVG_PERIODS) {
+                return usage(argv[0]);
+            }
+            a++;
+        } else if (strcmp(argv[a], "-g") == 0 && arg != NULL) {
+            int gate = atoi(arg);
+            if (gate < 0 || gate > PET_MAX_GATE_MS) {
+                return usage(argv[0]);
+            }
+            options.gate_ms = gate;
+            a++;
+        } else if (strcmp(argv[a], "-w") == 0 && arg != NULL) {
+            options.hist_width = (atoi(arg) > 0)? atoi(arg): 1;
+            a++;
+        } else if (strcmp(argv[a], "-t") == 0) {
+            options.hist_value = PET_HIST_TIE;
+        } else if (strcmp(argv[a], "-o") == 0 && arg != NULL) {
+            char* s = (char*)arg;
+            for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+                offsets[i] = strtoul(s, &s, 10);
+                s += (*s == ',');
+            }
+            offset_override = true;
+            a++;
+        } else if (strcmp(argv[a], "-j") == 0 && arg != NULL) {
+            jobs = atoi(arg);
+            a++;
+        } else if (strcmp(argv[a], "-p") == 0 && arg != NULL) {
+            prefix = arg;
+            a++;
+        } else if (fn == NULL && argv[a][0] != '-') {
+            fn = argv[a];
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (fn == NULL) {
+        return usage(argv[0]);
+    }
+
+    int fd = open(fn, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        perror(fn);
+        return 1;
+    }
+    data_len = st.st_size;
+    data = (data_len > 0)? mmap(NULL, data_len, PROT_READ, MAP_PRIVATE, fd, 0): NULL;
+    if (data == MAP_FAILED) {
+        perror(fn);
+        return 1;
+    }
+    madvise((void*)data, data_len, MADV_SEQUENTIAL | MADV_WILLNEED);
+    struct BinRawConfig raw;
+    if (data == NULL || !first_config(&raw)) {
+        fprintf(stderr, "%s: no raw capture (FORMAT RAW) found\n", fn);
+        return 1;
+    }
+    if (avg_override > 0 && raw.capture != PET_CAPTURE_TIMESTAMP && raw.capture != PET_CAPTURE_EDGES) {
+        fprintf(stderr, "-a ignored, the counting SMs averaged the captured periods already\n");
+    }
+
+    // the channels of the first config are split, channels added later go to the first thread
+    uint8_t channels = (raw.channels > 0 && raw.channels <= PET_MAX_CHANNELS)? raw.channels: PET_MAX_CHANNELS;
+    threads = (jobs <= 0 || jobs > channels || prefix != NULL)? channels: jobs;
+    if (options.mode == PET_MODE_TIC) {
+        threads = 1;                    // stop edges need the start edges of the reference channel
+    }
+    for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+        channel_thread[i] = (i < channels)? i % threads: 0;
+    }
+    for (uint8_t k = 0; k < CHUNKS; k++) {
+        for (uint8_t t = 0; t < threads; t++) {
+            chunks[k].values[t] = malloc(CHUNK_VALUES * sizeof(struct ReplayValue));
+        }
+    }
+    struct Replay* replays = calloc(threads, sizeof(struct Replay));
+    for (uint8_t t = 0; t < threads; t++) {
+        struct Replay* r = &replays[t];
+        r->index = t;
+        for (uint8_t i = 0; i < PET_MAX_CHANNELS; i++) {
+            if (channel_thread[i] == t) {
+                r->mask |= 1u << i;
+            }
+        }
+        if (prefix != NULL && threads == channels) {
+            char name[1024];
+            snprintf(name, sizeof(name), "%s%s.txt", prefix, channel_names[t]);
+            r->out = fopen(name, "w");
+            r->header = true;
+        } else if (prefix != NULL) {
+            char name[1024];
+            snprintf(name, sizeof(name), "%s.txt", prefix);
+            r->out = fopen(name, "w");
+            r->header = true;
+        } else {
+            r->out = (threads == 1)? stdout: tmpfile();
+            r->header = (t == 0);
+        }
+        if (r->out == NULL) {
+            perror(prefix != NULL? prefix: "tmpfile");
+            return 1;
+        }
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (uint8_t t = 0; t < threads; t++) {
+        pthread_create(&replays[t].thread, NULL, replay_run, &replays[t]);
+    }
+    struct BinDecoder d;
+    decode(&d);
+    uint64_t values = 0;
+    for (uint8_t t = 0; t < threads; t++) {
+        pthread_join(replays[t].thread, NULL);
+        values += replays[t].values;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    if (prefix == NULL && threads > 1) {
+        // channel blocks in the order of the threads
+        char buf[65536];
+        for (uint8_t t = 0; t < threads; t++) {
+            size_t n;
+            rewind(replays[t].out);
+            while ((n = fread(buf, 1, sizeof(buf), replays[t].out)) > 0) {
+                fwrite(buf, 1, n, stdout);
+            }
+            fclose(replays[t].out);
+        }
+    } else if (prefix != NULL) {
+        for (uint8_t t = 0; t < threads; t++) {
+            fclose(replays[t].out);
+        }
+    }
+    double sec = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    fprintf(stderr, "%zu bytes, %lu frames, %lu crc errors, %lu unsynced, %lu values, %u threads, %.2f s, %.0f MB/s\n",
+        data_len, (unsigned long)d.frames, (unsigned long)d.crc_errors, (unsigned long)d.unsynced,
+        (unsigned long)values, threads, sec, (sec > 0)? data_len / sec / 1e6: 0.0);
+    munmap((void*)data, data_len);
+    close(fd);
+    return 0;
+}
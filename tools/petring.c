@@ -0,0 +1,123 @@
+/*
+    petring runs the capture ring buffer consumer (ringBuf.c) against a mock FIFO that
+    writes into the ring the way the DMA channel of capture.c does: word by word at
+    the total number of words written modulo the ring size, the consumer only sees that
+    total. Every mock word is its own write position, so each word read tells where it
+    came from.
+
+    Usage: petring [-n words]
+        -n  words written per case, default 10000000
+    Every case checks that the words are read in order and unchanged, that the words
+    skipped on an overrun are exactly the ones counted in overruns and that after an
+    overrun the reader keeps the guard distance to the writer:
+      wrap      the writer stays less than a ring ahead, nothing may be lost
+                (the last word of a full ring is never read, it may be overwritten already)
+      overrun   bursts larger than the ring, the writer laps the reader
+      counter   both totals start just below 2^32 and wrap during the case
+    Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ringBuf.h"
+
+#define RING_WORDS 256                  // CAPTURE_RING_WORDS
+
+struct MockFifo
+{
+    uint32_t buf[RING_WORDS];
+    uint32_t wr;                        // total number of words written
+};
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(uint32_t n) {
+    rnd_state = rnd_state * 1103515245u + 12345u;
+    return (rnd_state >> 8) % n;
+}
+
+static void mock_write(struct MockFifo* f, uint32_t words) {
+    for (uint32_t j = 0; j < words; j++) {
+        f->buf[f->wr % RING_WORDS] = f->wr;
+        f->wr++;
+    }
+}
+
+// the writer adds up to max_burst words between two reads of up to max_read words, 0 reads
+// until the ring is empty and nothing may be lost then; start is the initial total of both
+static bool check(const char* name, uint32_t start, uint32_t max_burst, uint32_t max_read, uint32_t words) {
+    static struct MockFifo f;
+    struct PetRing r;
+    ring_init(&r, f.buf, RING_WORDS);
+    f.wr = start;
+    r.rd = start;
+    uint32_t keep = RING_WORDS - RING_WORDS / RING_GUARD_DIV;
+    uint32_t written = 0, read = 0, lost = 0, errors = 0;
+    uint32_t expect = start;            // position of the next word if nothing is lost
+    while (written < words) {
+        uint32_t burst = 1 + rnd(max_burst);
+        mock_write(&f, burst);
+        written += burst;
+        uint32_t reads = (max_read == 0)? max_burst: 1 + rnd(max_read);
+        for (uint32_t j = 0; j < reads; j++) {
+            uint32_t level = ring_level(&r, f.wr);
+            uint32_t overruns = r.overruns;
+            uint32_t word;
+            if (!ring_get(&r, f.wr, &word)) {
+                if (level != 0) {
+                    errors++;
+                }
+                break;
+            }
+            uint32_t skipped = word - expect;
+            if (skipped != r.overruns - overruns || skipped > level) {
+                errors++;                       // lost words not counted or a word read twice
+            }
+            if (skipped != 0 && f.wr - word != keep) {
+                errors++;                       // no guard distance after the overrun
+            }
+            if (skipped == 0 && level > RING_WORDS - 1) {
+                errors++;                       // the oldest word may be overwritten already
+            }
+            lost += skipped;
+            expect = word + 1;
+            read++;
+        }
+    }
+    uint32_t word;
+    while (ring_get(&r, f.wr, &word)) {
+        lost += word - expect;
+        expect = word + 1;
+        read++;
+    }
+    if (read + lost != written || lost != r.overruns || r.rd != f.wr || (max_read == 0 && lost != 0)) {
+        errors++;
+    }
+    bool ok = (errors == 0);
+    printf("%-8s %s written %u read %u overruns %u%s\n", name, ok? "OK  ": "FAIL", written, read, r.overruns, (start + written < start)? ", counter wrapped": "");
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    uint32_t words = 10000000;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-n") == 0 && a+1 < argc) {
+            words = strtoul(argv[++a], NULL, 0);
+        } else {
+            fprintf(stderr, "Usage: %s [-n words]\n", argv[0]);
+            return 2;
+        }
+    }
+    uint32_t failed = 0, cases = 0;
+    failed += !check("wrap", 0, RING_WORDS / 2, 0, words);
+    failed += !check("wrap", 0, RING_WORDS - 1, 0, words);
+    failed += !check("overrun", 0, 4 * RING_WORDS, RING_WORDS / 2, words);
+    failed += !check("overrun", 0, RING_WORDS + 1, 1, words);
+    failed += !check("counter", 0xffffffffu - words / 2, RING_WORDS - 1, 0, words);
+    failed += !check("counter", 0xffffffffu - words / 2, 4 * RING_WORDS, RING_WORDS / 2, words);
+    failed += !check("counter", 0xffffffffu - RING_WORDS / 3, 3 * RING_WORDS, 1, words);
+    cases += 7;
+    printf("%u of %u cases failed\n", failed, cases);
+    return (failed == 0)? 0: 1;
+}
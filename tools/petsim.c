@@ -0,0 +1,590 @@
+/*
+    petsim runs the PicoPET counting programs in a cycle accurate PIO emulator against
+    synthetic input signals and checks the calibration of the firmware.
+    picopet_hr runs as two state machines on the same pin, their counts are combined by
+    measure_count_phase() as on core 1. picopet_de pushes the high and the low time of
+    every period in turns.
+
+    Usage: petsim [-d dir] [-j jitter] [-a avg] [-l]
+        -d  directory with the .pio sources, default is the source tree
+        -j  rms jitter of the rising edges in clk_sys cycles, default 0.3
+        -a  check only this AVG_PERIODS for picopet_mp, default is a set over 2..10000
+        -l  also search the throughput limits (shortest pulses, highest rate)
+    Every case checks that each corrected count (2*clk_cnt + pet_cor_offset() for
+    picopet_sp/mp/de, 2*delta(~X) for picopet_ts, mean of both phases for picopet_hr) equals
+    the true time between the edges it spans within the resolution of the program
+    (2 cycles, 1 cycle for picopet_hr), and that no edge is missed or counted twice; for
+    picopet_de the high time from the rising to the falling edge and the low time from the
+    falling to the next rising edge, so the calibration of both edges is checked.
+    The first push after the start of a program spans the start, not the input periods, and is skipped.
+    Exits with 1 if any case fails.
+    The input synchronizer of the GPIOs adds a constant delay and is not emulated.
+
+    The timebase switch cases change clk_sys in the middle of the run as the reference
+    switchover does, the values read after it are the next epoch and measure_set_clock()
+    converts the timescale before the first of them. The timemarks of all edges have to
+    follow the true time on both sides of the switch, the interval spanning it is bridged
+    by the previous interval of the channel. The delayed cases check the clock every tenth
+    of the run (measure_clock_checked()) and find the switch only at the first check a third
+    of a check period after it, as the firmware does; the values between the last good check
+    and that one keep the old epoch and are not checked, the timemarks after it have to follow
+    the true time again.
+
+    The dual-edge cases run picopet_de through measure_edge() in the TIMEMARK, WIDTH and
+    DUTY modes, the timemarks of both edges have to follow the true time, the pulse width
+    and duty cycle have to match the signal within the resolution.
+
+    The wrap cases set X of picopet_de close to 0 in a high and in a low time, as after 2^32
+    decrements, each phase has to be pushed once and the values have to keep alternating.
+
+    The self-calibration check runs the points of the firmware self-calibration (selfCal.h)
+    on the loopback square wave of exactly CAL_DIV cycles and checks that the fitted table
+    equals the corrections derived from the programs (pet_cor_offset()).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "pioEmu.h"
+#include "measure.h"
+#include "selfCal.h"
+
+#ifndef PIO_DIR
+#define PIO_DIR "."
+#endif
+
+#define MAX_CYCLES 4000000              // emulated cycles per case
+#define MIN_SAMPLES 20
+#define EDGE_RING 16384                 // rising edges remembered, power of 2 over PET_MAX_AVG_PERIODS
+#define DE_MIN_PULSE 7                  // shortest high and low time of the picopet_de cases with the default jitter, see -l
+
+enum { SIM_SP, SIM_MP, SIM_TS, SIM_HR, SIM_DE, SIM_PROGRAMS };
+
+struct Signal
+{
+    double period;
+    double duty;
+    double jitter;
+    double rise;                        // time of the next rising edge
+    double fall;                        // falling edge after the last rising one, duty*period after it
+    double edges[EDGE_RING];            // times of the past rising edges
+    uint32_t count;                     // rising edges so far
+};
+
+struct Result
+{
+    uint32_t samples;
+    uint32_t missed;                    // samples not spanning exactly avg edges
+    double min_err;
+    double max_err;
+};
+
+static struct EmuProgram programs[SIM_PROGRAMS];
+static const char* program_names[] = {"picopet_sp", "picopet_mp", "picopet_ts", "picopet_hr", "picopet_de"};
+static const char* program_files[] = {"picoPET_sp.pio", "picoPET_mp.pio", "picoPET_ts.pio", "picoPET_hr.pio", "picoPET_de.pio"};
+static const double resolution[] = {2, 2, 2, 1, 2};     // max. |corrected count - true interval| in cycles
+static double jitter = 0.3;
+static struct PetMeasure measure;       // pairs the picopet_hr phases
+static uint64_t measure_cor;            // last clk_cor output by measure, cycle count output
+static bool measure_out;
+static char measure_line[2*PET_LINE_LEN];  // last line output by measure
+
+
+static void measure_write(const char* buf, uint16_t len, bool binary) {
+    // cycle count text output "<clk_cor>\t <name>"
+    measure_cor = strtoull(buf, NULL, 10);
+    snprintf(measure_line, sizeof(measure_line), "%.*s", (int)len, buf);
+    measure_out = true;
+}
+
+static void measure_start(uint8_t mode, uint8_t capture, uint16_t avg, uint32_t freq) {
+    static const char* names[PET_MAX_CHANNELS] = {"sim", "sim", "sim", "sim"};
+    struct PetConfig cfg = {mode, PET_FORMAT_TEXT, 1, capture, avg, 0};
+    measure_init(&measure, &cfg, freq, names, measure_write);
+}
+
+static double gauss() {
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0);
+    double v = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2*log(u)) * cos(2*M_PI*v);
+}
+
+static void signal_init(struct Signal* s, double period, double duty) {
+    memset(s, 0, sizeof(*s));
+    s->period = period;
+    s->duty = duty;
+    s->jitter = jitter;
+    s->rise = 10.37;                    // let the program reach its wait first
+    s->fall = s->rise + duty*period;
+}
+
+// input level sampled at the time c in cycles
+static uint32_t signal_level(struct Signal* s, double c) {
+    while (c >= s->rise) {
+        s->edges[s->count++ & (EDGE_RING - 1)] = s->rise;
+        s->fall = s->rise + s->duty*s->period;
+        s->rise = 10.37 + (s->count * s->period) + s->jitter * gauss();
+        if (s->rise <= s->fall) {
+            s->rise = s->fall + 0.01;   // jitter never swaps the edges
+        }
+    }
+    return s->count > 0 && c < s->fall;
+}
+
+// runs one case, pushes are read every cycle as by the DMA
+static struct Result simulate(uint8_t prog, uint16_t avg, double period, double duty) {
+    struct Result r = {0, 0, 1e9, -1e9};
+    struct EmuSm sm[2];
+    struct Signal s;
+    const struct EmuProgram* p = &programs[prog];
+    uint8_t sms = (prog == SIM_HR)? 2: 1;
+    signal_init(&s, period, duty);
+    if (prog == SIM_TS) {
+        emu_sm_init(&sm[0], p, emu_label(p, "entry"), 0);
+        sm[0].x = 0xffffffff;           // mov x, ~null executed by picopet_ts_program_init()
+    } else if (prog == SIM_HR) {
+        emu_sm_init(&sm[0], p, emu_label(p, "phase0"), 0);
+        emu_sm_init(&sm[1], p, emu_label(p, "phase1"), 0);
+        emu_tx_put(&sm[0], avg - 1);
+        emu_tx_put(&sm[1], avg - 1);
+        measure_start(PET_MODE_CYCLE_COUNT, PET_CAPTURE_INTERLEAVED, avg, 240000000);
+    } else {
+        emu_sm_init(&sm[0], p, 0, 0);
+        emu_tx_put(&sm[0], avg - 1);    // picopet_sp and picopet_de ignore it
+    }
+    uint32_t cor_offset = pet_cor_offset(avg, (prog == SIM_DE)? PET_CAPTURE_EDGES: PET_CAPTURE_PERIOD);
+    uint32_t pushes = 0;                // picopet_de, even ones are high times
+    uint32_t prev_edge = 0;
+    uint32_t prev_x = 0;
+    bool started = false;               // the first push spans the start of the program, not avg periods
+    uint64_t cycles = (uint64_t)(period * avg * (MIN_SAMPLES + 2));
+    cycles = (cycles < MAX_CYCLES)? MAX_CYCLES: cycles;
+    for (uint64_t c = 0; c < cycles; c++) {
+        uint32_t level = signal_level(&s, c);
+        for (uint8_t k = 0; k < sms; k++) {
+            emu_step(&sm[k], level);
+        }
+        uint32_t v;
+        for (uint8_t k = 0; k < sms; k++) {
+            while (emu_rx_get(&sm[k], &v)) {
+                uint32_t edge = s.count - 1;        // last rising edge before the push
+                double truth = s.edges[edge & (EDGE_RING - 1)] - s.edges[prev_edge & (EDGE_RING - 1)];
+                uint32_t edges = avg;               // rising edges the value spans
+                double cor;
+                if (prog == SIM_HR) {
+                    measure_out = false;
+                    measure_count_phase(&measure, 0, k, v);
+                    if (!measure_out) {
+                        continue;           // waiting for the other phase
+                    }
+                    cor = measure_cor;
+                } else if (prog == SIM_TS) {
+                    cor = 2.0*(uint32_t)(~v - ~prev_x);
+                } else {
+                    cor = 2.0*(~v) + cor_offset;
+                }
+                if (prog == SIM_DE) {
+                    // the high time ends on the falling edge of the last rising one, the low time
+                    // starts on the falling edge of the previous rising one
+                    bool high = (pushes++ & 1) == 0;
+                    truth = high? s.duty*s.period: truth - s.duty*s.period;
+                    edges = high? 0: 1;
+                }
+                if (started) {
+                    double err = cor - truth;
+                    r.samples++;
+                    r.missed += (edge - prev_edge) != edges;
+                    r.min_err = (err < r.min_err)? err: r.min_err;
+                    r.max_err = (err > r.max_err)? err: r.max_err;
+                }
+                started = true;
+                prev_edge = edge;
+                prev_x = v;
+            }
+        }
+    }
+    for (uint8_t k = 0; k < sms; k++) {
+        r.missed += sm[k].rx_dropped;
+    }
+    return r;
+}
+
+// runs one case with a timebase switch from freq to new_freq in the middle, the signal is
+// defined in cycles of freq, after the switch a cycle of clk_sys lasts freq/new_freq of them
+// delayed: the clock is checked periodically and the switch found by a later check
+static bool check_switch(uint8_t prog, uint16_t avg, double period, uint32_t freq, uint32_t new_freq, bool delayed) {
+    static const uint8_t captures[] = {PET_CAPTURE_PERIOD, PET_CAPTURE_PERIOD, PET_CAPTURE_TIMESTAMP, PET_CAPTURE_INTERLEAVED};
+    struct EmuSm sm[2];
+    struct Signal s;
+    const struct EmuProgram* p = &programs[prog];
+    uint8_t sms = (prog == SIM_HR)? 2: 1;
+    signal_init(&s, period, 0.5);
+    if (prog == SIM_TS) {
+        emu_sm_init(&sm[0], p, emu_label(p, "entry"), 0);
+        sm[0].x = 0xffffffff;
+    } else if (prog == SIM_HR) {
+        emu_sm_init(&sm[0], p, emu_label(p, "phase0"), 0);
+        emu_sm_init(&sm[1], p, emu_label(p, "phase1"), 0);
+        emu_tx_put(&sm[0], avg - 1);
+        emu_tx_put(&sm[1], avg - 1);
+    } else {
+        emu_sm_init(&sm[0], p, 0, 0);
+        emu_tx_put(&sm[0], avg - 1);
+    }
+    measure_start(PET_MODE_TIMEMARK, captures[prog], avg, freq);
+    double ratio = (double)freq / new_freq;
+    uint64_t cycles = (uint64_t)(period * avg * (2*MIN_SAMPLES + 2));
+    cycles = (cycles < MAX_CYCLES)? MAX_CYCLES: cycles;
+    uint64_t switch_cycle = cycles / 2;
+    uint64_t check_cycles = cycles / 10;
+    uint64_t found_cycle = switch_cycle;    // the values from here on are the next epoch
+    if (delayed) {
+        found_cycle = (switch_cycle + check_cycles / 3 + check_cycles - 1) / check_cycles * check_cycles;
+    }
+    bool switched = false;
+    uint64_t ts_ref = 0;
+    double first_edge = 0;
+    double first_tm = 0;
+    bool started = false;
+    uint32_t samples[2] = {0, 0};       // before, after the switch
+    uint32_t unchecked = 0;             // between the switch and finding it
+    double max_err[2] = {0, 0};
+    for (uint64_t c = 0; c < cycles; c++) {
+        if (delayed && c % check_cycles == 0 && c < switch_cycle) {
+            measure_clock_checked(&measure);
+        }
+        double t = (c < switch_cycle)? c: switch_cycle + (c - switch_cycle) * ratio;
+        uint32_t level = signal_level(&s, t);
+        for (uint8_t k = 0; k < sms; k++) {
+            emu_step(&sm[k], level);
+        }
+        uint32_t v;
+        for (uint8_t k = 0; k < sms; k++) {
+            while (emu_rx_get(&sm[k], &v)) {
+                if (c >= found_cycle && !switched) {
+                    // first value of the new epoch
+                    measure_set_clock(&measure, new_freq);
+                    switched = true;
+                }
+                measure_out = false;
+                if (prog == SIM_HR) {
+                    measure_count_phase(&measure, 0, k, v);
+                } else if (prog == SIM_TS) {
+                    ts_ref += (int32_t)(~v - (uint32_t)ts_ref);
+                    measure_timestamp(&measure, 0, ts_ref);
+                } else {
+                    measure_count(&measure, 0, v);
+                }
+                if (!measure_out) {
+                    continue;
+                }
+                uint32_t edge = s.count - 1;
+                double tm = (double)measure.tm[0] * freq / measure.clk_src_freq;
+                if (!started) {
+                    // the first timemark spans the start of the program, the others are relative to it
+                    first_edge = s.edges[edge & (EDGE_RING - 1)];
+                    first_tm = tm;
+                    started = true;
+                    continue;
+                }
+                double err = fabs((tm - first_tm) - (s.edges[edge & (EDGE_RING - 1)] - first_edge));
+                if (c >= switch_cycle && !switched) {
+                    unchecked++;
+                    continue;
+                }
+                samples[switched]++;
+                max_err[switched] = (err > max_err[switched])? err: max_err[switched];
+            }
+        }
+    }
+    // after the switch: the bridged interval is off by the error of the previous one and the jitter
+    double limit = resolution[prog] * (1 + ratio) + ratio + 6*jitter;
+    bool ok = samples[0] >= MIN_SAMPLES/2 && samples[1] >= MIN_SAMPLES/2 && max_err[0] <= resolution[prog] && max_err[1] <= limit;
+    printf("%-10s AVG=%-5u period %9.2f switch %u -> %u MHz %-7s  samples %4u %4u %4u  err %5.2f %5.2f (max %.2f)  %s\n", program_names[prog],
+        avg, period, freq / 1000000, new_freq / 1000000, delayed? "delayed": "", samples[0], unchecked, samples[1], max_err[0], max_err[1], limit,
+        ok? "OK": "FAIL");
+    return ok;
+}
+
+// picopet_de through measure_edge() in TIMEMARK, WIDTH and DUTY, the high time of every pulse
+// is exactly duty*period, so the width and duty of avg periods are known from the rising edges
+static bool check_edges(uint16_t avg, double period, double duty, uint32_t freq) {
+    static const uint8_t modes[] = {PET_MODE_TIMEMARK, PET_MODE_WIDTH, PET_MODE_DUTY};
+    const struct EmuProgram* p = &programs[SIM_DE];
+    const double res = resolution[SIM_DE];
+    uint32_t samples[3] = {0, 0, 0};
+    uint32_t falls = 0;                 // falling edge timemarks
+    double max_err[3] = {0, 0, 0};      // cycles of the timemarks and widths, fraction of the duty
+    double duty_limit = 0;
+    for (uint8_t k = 0; k < sizeof(modes); k++) {
+        struct EmuSm sm;
+        struct Signal s;
+        uint32_t pushes = 0;
+        bool started = false;
+        double first_edge = 0;
+        double first_tm = 0;
+        signal_init(&s, period, duty);
+        emu_sm_init(&sm, p, 0, 0);
+        measure_start(modes[k], PET_CAPTURE_EDGES, avg, freq);
+        uint64_t cycles = (uint64_t)(period * avg * (MIN_SAMPLES + 2));
+        cycles = (cycles < MAX_CYCLES)? MAX_CYCLES: cycles;
+        for (uint64_t c = 0; c < cycles; c++) {
+            uint32_t v;
+            emu_step(&sm, signal_level(&s, c));
+            if (!emu_rx_get(&sm, &v)) {
+                continue;
+            }
+            measure_out = false;
+            measure_edge(&measure, 0, pushes++ & 1, v);
+            if (!measure_out) {
+                continue;
+            }
+            uint32_t edge = s.count - 1;
+            double rise = s.edges[edge & (EDGE_RING - 1)];
+            double value = strtod(measure_line, NULL);
+            bool fall = strstr(measure_line, "-FALL") != NULL;
+            if (!started) {
+                // the first output spans the start of the program, the timemarks are relative to it
+                first_edge = rise;
+                first_tm = value * freq;
+                started = true;
+                continue;
+            }
+            double err;
+            if (modes[k] == PET_MODE_TIMEMARK) {
+                double truth = (fall? rise + duty*period: rise) - first_edge;
+                err = fabs(value * freq - first_tm - truth);
+                falls += fall;
+            } else if (modes[k] == PET_MODE_WIDTH) {
+                err = fabs(value * freq - duty*period);
+            } else {
+                // the error of every high time and of the sum of the periods
+                double sum = rise - s.edges[(edge - avg) & (EDGE_RING - 1)];
+                double limit = res * (avg + 1) / sum;
+                err = fabs(value - avg*duty*period / sum);
+                duty_limit = (limit > duty_limit)? limit: duty_limit;
+            }
+            samples[k]++;
+            max_err[k] = (err > max_err[k])? err: max_err[k];
+        }
+    }
+    // the output has 9 decimals of a second, a fraction of a cycle in both the timemark and the first one
+    double rounding = 2 * 0.5e-9 * freq;
+    bool ok = samples[0] >= MIN_SAMPLES && falls >= MIN_SAMPLES/2 && samples[1] >= MIN_SAMPLES/2 && samples[2] >= MIN_SAMPLES/2 &&
+        max_err[0] <= res + rounding && max_err[1] <= res + rounding && max_err[2] <= duty_limit;
+    printf("%-10s AVG=%-5u period %9.2f duty %.2f  timemarks %5u falling %5u err %5.2f  width err %5.2f  duty err %.2e (max %.2e)  %s\n",
+        program_names[SIM_DE], avg, period, duty, samples[0], falls, max_err[0], max_err[1], max_err[2], duty_limit, ok? "OK": "FAIL");
+    return ok;
+}
+
+// picopet_de with high and low times over 2^33 cycles: X is set close to 0 in the middle of
+// the high time of one pulse and of the low time of another, as after 2^32 decrements; every
+// phase has to be pushed once, its value modulo 2^32 less the decrements skipped
+static bool check_de_wrap(double high, double low, uint32_t skip_to) {
+    const struct EmuProgram* p = &programs[SIM_DE];
+    const double period = high + low;
+    struct EmuSm sm;
+    emu_sm_init(&sm, p, 0, 0);
+    uint32_t skipped = 0;               // decrements skipped in the current phase
+    uint32_t pushes = 0, wrong = 0;
+    double max_err = 0;
+    for (uint64_t c = 0; c < (uint64_t)(20 * period); c++) {
+        double t = c - 10.37;
+        uint32_t level = t >= 0 && fmod(t, period) < high;
+        uint32_t n = (t >= 0)? (uint32_t)(t / period): 0;
+        double in_phase = fmod(t, period) - (level? 0: high);
+        if ((n == 5 && level && in_phase >= high/2 && in_phase < high/2 + 1)
+                || (n == 9 && !level && in_phase >= low/2 && in_phase < low/2 + 1)) {
+            skipped = sm.x - skip_to;
+            sm.x = skip_to;
+        }
+        emu_step(&sm, level);
+        uint32_t v;
+        if (!emu_rx_get(&sm, &v)) {
+            continue;
+        }
+        if (pushes++ > 0) {
+            // pushes alternate high and low times starting with the high time, the first one spans the start
+            double cycles = 2.0 * (uint32_t)(~v - skipped) + pet_cor_offset(1, PET_CAPTURE_EDGES);
+            double err = fabs(cycles - ((pushes & 1)? high: low));
+            max_err = fmax(max_err, err);
+            wrong += err > resolution[SIM_DE] + 1;     // the wrap of the low loop takes one more cycle
+        }
+        skipped = 0;
+    }
+    bool ok = wrong == 0 && pushes >= 38;
+    printf("%-10s high %7.2f low %7.2f  X wrapped in both  pushes %2u  err max %5.2f  %s\n", program_names[SIM_DE], high, low, pushes, max_err,
+        ok? "OK": "FAIL");
+    return ok;
+}
+
+// the firmware self-calibration in the emulator, the clock output is synchronous to clk_sys
+static bool check_selfcal() {
+    struct CalRun run;
+    struct PetCal cal, expected;
+    char line[2*PET_LINE_LEN];
+    cal_run_init(&run);
+    double saved_jitter = jitter;
+    jitter = 0;
+    for (uint8_t point = 0; point < CAL_POINTS; point++) {
+        uint16_t avg = cal_points[point].avg_periods;
+        bool hr = cal_points[point].capture == PET_CAPTURE_INTERLEAVED;
+        const struct EmuProgram* p = &programs[hr? SIM_HR: (avg == 1)? SIM_SP: SIM_MP];
+        uint8_t sms = hr? 2: 1;
+        struct EmuSm sm[2];
+        struct Signal s;
+        uint16_t got[2] = {0, 0};
+        signal_init(&s, CAL_DIV, 0.5);
+        for (uint8_t k = 0; k < sms; k++) {
+            emu_sm_init(&sm[k], p, hr? emu_label(p, (k == 0)? "phase0": "phase1"): 0, 0);
+            emu_tx_put(&sm[k], avg - 1);
+        }
+        for (uint64_t c = 0; c < (uint64_t)CAL_DIV * avg * (CAL_SAMPLES + 2); c++) {
+            uint32_t level = signal_level(&s, c);
+            for (uint8_t k = 0; k < sms; k++) {
+                uint32_t v;
+                emu_step(&sm[k], level);
+                if (emu_rx_get(&sm[k], &v) && got[k]++ > 0 && got[k] <= CAL_SAMPLES + 1) {
+                    cal_run_add(&run, point, 0, v);
+                }
+            }
+        }
+    }
+    jitter = saved_jitter;
+    cal_default(&expected);
+    bool ok = cal_run_solve(&run, 1, &cal) && cal.sp[0] == expected.sp[0] && cal.mp_slope[0] == expected.mp_slope[0] &&
+        cal.mp_base[0] == expected.mp_base[0] && cal.hr_slope[0] == expected.hr_slope[0] && cal.hr_base[0] == expected.hr_base[0];
+    cal_format(line, sizeof(line), &cal, 0, "sim");
+    printf("self-calibration  %.*s  %s\n", (int)strcspn(line, "\n"), line, ok? "OK": "FAIL");
+    return ok;
+}
+
+static bool passed(uint8_t prog, const struct Result* r) {
+    return r->samples >= MIN_SAMPLES/2 && r->missed == 0 && r->min_err >= -resolution[prog] && r->max_err <= resolution[prog];
+}
+
+static bool check(uint8_t prog, uint16_t avg, double period, double duty) {
+    struct Result r = simulate(prog, avg, period, duty);
+    bool ok = passed(prog, &r);
+    printf("%-10s AVG=%-5u period %9.2f duty %.2f  samples %7u missed %5u  err %+6.2f %+6.2f  %s\n", program_names[prog], avg,
+        period, duty, r.samples, r.missed, r.min_err, r.max_err, ok? "OK": "FAIL");
+    return ok;
+}
+
+// shortest high and low pulse and highest rate with no missed edges
+static void limits(uint8_t prog, uint16_t avg) {
+    const double period = 100;
+    double high = 0, low = 0, rate = 0;
+    for (double h = 0.5; h < period/2 && high == 0; h += 0.5) {
+        struct Result r = simulate(prog, avg, period, h/period);
+        high = passed(prog, &r)? h: 0;
+    }
+    for (double l = 0.5; l < period/2 && low == 0; l += 0.5) {
+        struct Result r = simulate(prog, avg, period, 1 - l/period);
+        low = passed(prog, &r)? l: 0;
+    }
+    for (double p = 2; p < period && rate == 0; p += 0.5) {
+        struct Result r = simulate(prog, avg, p, 0.5);
+        rate = passed(prog, &r)? p: 0;
+    }
+    printf("%-10s AVG=%-5u shortest high %.1f, low %.1f cycles, shortest period %.1f cycles (%.2f MHz at 240 MHz clk_sys)\n",
+        program_names[prog], avg, high, low, rate, 240/rate);
+}
+
+int main(int argc, char** argv) {
+    const char* dir = PIO_DIR;
+    int only_avg = 0;
+    bool search_limits = false;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-d") == 0 && a+1 < argc) {
+            dir = argv[++a];
+        } else if (strcmp(argv[a], "-j") == 0 && a+1 < argc) {
+            jitter = atof(argv[++a]);
+        } else if (strcmp(argv[a], "-a") == 0 && a+1 < argc) {
+            only_avg = atoi(argv[++a]);
+        } else if (strcmp(argv[a], "-l") == 0) {
+            search_limits = true;
+        } else {
+            fprintf(stderr, "Usage: %s [-d dir] [-j jitter] [-a avg] [-l]\n", argv[0]);
+            return 2;
+        }
+    }
+    for (uint8_t p = 0; p < SIM_PROGRAMS; p++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir, program_files[p]);
+        if (!emu_load(&programs[p], path, program_names[p])) {
+            fprintf(stderr, "%s: %s\n", path, emu_error());
+            return 1;
+        }
+    }
+
+    static const double periods[] = {17.3, 20, 101.7, 1000.1, 12345.67};
+    static const double duties[] = {0.25, 0.5, 0.75};
+    static const uint16_t avgs[] = {2, 3, 5, 10, 100, 1000, PET_MAX_AVG_PERIODS};
+    uint32_t failed = 0, cases = 0;
+    srand(1);
+    for (uint8_t d = 0; d < sizeof(duties)/sizeof(duties[0]); d++) {
+        for (uint8_t k = 0; k < sizeof(periods)/sizeof(periods[0]); k++) {
+            if (only_avg == 0) {
+                failed += !check(SIM_SP, 1, periods[k], duties[d]);
+                failed += !check(SIM_TS, 1, periods[k], duties[d]);
+                failed += !check(SIM_HR, 1, periods[k], duties[d]);
+                cases += 3;
+                if (periods[k] * fmin(duties[d], 1 - duties[d]) >= DE_MIN_PULSE) {
+                    failed += !check(SIM_DE, 1, periods[k], duties[d]);
+                    cases++;
+                }
+                for (uint8_t a = 0; a < sizeof(avgs)/sizeof(avgs[0]); a++) {
+                    if (periods[k] * avgs[a] * MIN_SAMPLES <= MAX_CYCLES) {
+                        failed += !check(SIM_MP, avgs[a], periods[k], duties[d]);
+                        failed += !check(SIM_HR, avgs[a], periods[k], duties[d]);
+                        cases += 2;
+                    }
+                }
+            } else if (periods[k] * only_avg * MIN_SAMPLES <= MAX_CYCLES || k == 0) {
+                failed += !check((only_avg == 1)? SIM_SP: SIM_MP, only_avg, periods[k], duties[d]);
+                failed += !check(SIM_HR, only_avg, periods[k], duties[d]);
+                cases += 2;
+            }
+        }
+    }
+    static const double edge_periods[] = {101.7, 1000.1};
+    static const uint16_t edge_avgs[] = {1, 10};
+    for (uint8_t k = 0; k < sizeof(edge_periods)/sizeof(edge_periods[0]) && only_avg == 0; k++) {
+        for (uint8_t a = 0; a < sizeof(edge_avgs)/sizeof(edge_avgs[0]); a++) {
+            for (uint8_t d = 0; d < sizeof(duties)/sizeof(duties[0]); d++) {
+                failed += !check_edges(edge_avgs[a], edge_periods[k], duties[d], 240000000);
+                cases++;
+            }
+        }
+    }
+    static const double switch_periods[] = {101.7, 1000.1};
+    for (uint8_t k = 0; k < sizeof(switch_periods)/sizeof(switch_periods[0]) && only_avg == 0; k++) {
+        for (uint8_t delayed = 0; delayed < 2; delayed++) {
+            failed += !check_switch(SIM_SP, 1, switch_periods[k], 240000000, 200000000, delayed);
+            failed += !check_switch(SIM_MP, 10, switch_periods[k], 240000000, 200000000, delayed);
+            failed += !check_switch(SIM_TS, 1, switch_periods[k], 240000000, 200000000, delayed);
+            failed += !check_switch(SIM_HR, 1, switch_periods[k], 240000000, 200000000, delayed);
+            failed += !check_switch(SIM_SP, 1, switch_periods[k], 200000000, 240000000, delayed);
+            failed += !check_switch(SIM_TS, 1, switch_periods[k], 200000000, 240000000, delayed);
+            failed += !check_switch(SIM_HR, 10, switch_periods[k], 200000000, 240000000, delayed);
+            cases += 7;
+        }
+    }
+    if (only_avg == 0) {
+        failed += !check_de_wrap(301.3, 997.9, 7);
+        failed += !check_de_wrap(997.9, 301.3, 0);
+        failed += !check_selfcal();
+        cases += 3;
+    }
+    if (search_limits) {
+        limits(SIM_SP, 1);
+        limits(SIM_MP, 2);
+        limits(SIM_TS, 1);
+        limits(SIM_HR, 1);
+        limits(SIM_DE, 1);
+    }
+    printf("%u of %u cases failed\n", failed, cases);
+    return (failed == 0)? 0: 1;
+}
@@ -0,0 +1,132 @@
+/*
+    petspsc runs the core 0 -> core 1 record queue (spscQueue.c) with a producer and a
+    consumer thread, as the two cores use it in the firmware.
+
+    Usage: petspsc [-n records]
+        -n  records pushed per case, default 1000000
+    The records carry their sequence number in every field, the consumer checks that they
+    arrive in order and unchanged:
+      wait      the producer waits for room as do_count() does, nothing may be dropped
+      slow      the same with a consumer pausing every few records, the queue runs full
+      drop      the producer gives up on a full queue, the records lost have to be
+                exactly the ones counted in dropped
+      counter   head and tail start just below 2^32 and wrap during the case
+    Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include "spscQueue.h"
+
+struct Run
+{
+    struct SpscQueue q;
+    uint32_t records;
+    bool wait;                          // producer waits while the queue is full
+    uint32_t pause_every;               // consumer yields after this many records, 0 never
+    _Atomic bool done;
+    uint32_t popped;
+    uint32_t lost;                      // records skipped in the sequence
+    uint32_t errors;
+};
+
+static void make_record(struct PetRecord* r, uint32_t seq) {
+    r->channel = seq & 3;
+    r->flags = (seq >> 2) & 0x1f;
+    r->epoch = seq >> 7;
+    r->reserved = 0;
+    r->value = seq;
+    r->value_hi = ~seq;
+}
+
+static void* producer(void* arg) {
+    struct Run* run = arg;
+    struct PetRecord r;
+    for (uint32_t seq = 0; seq < run->records; seq++) {
+        make_record(&r, seq);
+        while (run->wait && spsc_level(&run->q) >= SPSC_RECORDS) {
+            sched_yield();              // do_count() leaves the value in the ring meanwhile
+        }
+        spsc_push(&run->q, &r);
+    }
+    atomic_store(&run->done, true);
+    return NULL;
+}
+
+static void* consumer(void* arg) {
+    struct Run* run = arg;
+    struct PetRecord r, expect;
+    uint32_t seq = 0;
+    for (;;) {
+        bool done = atomic_load(&run->done);
+        if (!spsc_pop(&run->q, &r)) {
+            if (done) {
+                break;                  // nothing pushed after done was set
+            }
+            continue;
+        }
+        if (r.value < seq) {
+            run->errors++;              // out of order or popped twice
+        }
+        run->lost += r.value - seq;
+        seq = r.value;
+        make_record(&expect, seq);
+        if (memcmp(&r, &expect, sizeof(r)) != 0) {
+            run->errors++;              // torn or stale record
+        }
+        seq++;
+        run->popped++;
+        if (run->pause_every != 0 && run->popped % run->pause_every == 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static bool check(const char* name, uint32_t start, bool wait, uint32_t pause_every, uint32_t records) {
+    static struct Run run;
+    spsc_init(&run.q);
+    atomic_store(&run.q.head, start);
+    atomic_store(&run.q.tail, start);
+    run.records = records;
+    run.wait = wait;
+    run.pause_every = pause_every;
+    atomic_store(&run.done, false);
+    run.popped = 0;
+    run.lost = 0;
+    run.errors = 0;
+    pthread_t p, c;
+    pthread_create(&c, NULL, consumer, &run);
+    pthread_create(&p, NULL, producer, &run);
+    pthread_join(p, NULL);
+    pthread_join(c, NULL);
+    uint32_t tail_lost = records - (run.popped + run.lost);     // dropped after the last record popped
+    bool ok = run.errors == 0 && run.lost + tail_lost == run.q.dropped && spsc_level(&run.q) == 0
+        && run.q.high_water <= SPSC_RECORDS && (!wait || run.q.dropped == 0);
+    printf("%-8s %s pushed %u popped %u dropped %u high water %u\n", name, ok? "OK  ": "FAIL", records, run.popped, run.q.dropped, run.q.high_water);
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    uint32_t records = 1000000;
+    for (int a = 1; a < argc; a++) {
+        if (strcmp(argv[a], "-n") == 0 && a+1 < argc) {
+            records = strtoul(argv[++a], NULL, 0);
+        } else {
+            fprintf(stderr, "Usage: %s [-n records]\n", argv[0]);
+            return 2;
+        }
+    }
+    uint32_t failed = 0, cases = 0;
+    failed += !check("wait", 0, true, 0, records);
+    failed += !check("slow", 0, true, 7, records);
+    failed += !check("drop", 0, false, 7, records);
+    failed += !check("counter", 0xffffffffu - SPSC_RECORDS / 2, true, 7, records);
+    failed += !check("counter", 0xffffffffu - SPSC_RECORDS / 2, false, 7, records);
+    cases += 5;
+    printf("%u of %u cases failed\n", failed, cases);
+    return (failed == 0)? 0: 1;
+}
@@ -0,0 +1,123 @@
+/*
+    pettic checks the pairing of MODE TIC (process_tic() of measure.c): the edges of ChB and
+    ChC against the reference ChA, processed in the order given by each case as core 1 gets
+    them from the queue.
+
+    Usage: pettic
+    Every case starts with one edge per channel (the first timestamp of a channel only starts
+    its interval) and a reference period of 1 ms, then feeds its edges through
+    measure_timestamp() with CAPTURE TS at 240 MHz and compares the printed intervals:
+      in order      stop edges after their reference edge, both signs
+      out of order  stop edges drained before their reference edge, before and after it in time
+      missing ref   a reference edge missing, the stop edges of that period are dropped and
+                    the reference period is kept
+      missing stop  a stop edge missing on one channel, only that pair is dropped
+      half period   stop edges just inside and outside half of the reference period
+      late stop     a second stop edge in the same period waits for the next reference edge
+    Exits with 1 if any case fails.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "measure.h"
+
+#define MAX_EDGES 16
+
+struct TicEdge
+{
+    uint8_t channel;
+    double us;                          // time of the edge in microseconds
+};
+
+struct TicCase
+{
+    const char* name;
+    struct TicEdge edges[MAX_EDGES];    // in the order of processing, channel 255 ends the list
+    const char* expect;                 // printed lines after the header
+};
+
+static char output[4096];
+static size_t output_len;
+
+static void capture(const char* buf, uint16_t len, bool binary) {
+    if (output_len + len < sizeof(output)) {
+        memcpy(output + output_len, buf, len);
+        output_len += len;
+    }
+}
+
+static void edge(struct PetMeasure* m, uint8_t i, double us) {
+    measure_timestamp(m, i, (uint64_t)(us * 120 + 0.5));   // ticks of 2 cycles at 240 MHz
+}
+
+static bool check(const struct TicCase* c) {
+    static const char* const names[PET_MAX_CHANNELS] = {"ChA", "ChB", "ChC", "ChD"};
+    static const char* header = "TIC ChA\t CHANNEL\n";
+    static struct PetMeasure m;
+    struct PetConfig cfg = {
+        .mode = PET_MODE_TIC,
+        .format = PET_FORMAT_TEXT,
+        .channels = 3,
+        .capture = PET_CAPTURE_TIMESTAMP,
+        .avg_periods = 1,
+        .tic_ref = 0,
+        .hist_width = 1,
+    };
+    output_len = 0;
+    measure_init(&m, &cfg, 240000000, names, capture);
+    measure_header(&m);
+    // first edges, then one period of the reference, its stop edges pair in order
+    edge(&m, 0, 100);
+    edge(&m, 1, 110);
+    edge(&m, 2, 120);
+    edge(&m, 0, 1100);
+    edge(&m, 1, 1101);
+    edge(&m, 2, 1102);
+    for (uint8_t k = 0; k < MAX_EDGES && c->edges[k].channel != 255; k++) {
+        edge(&m, c->edges[k].channel, c->edges[k].us);
+    }
+    output[output_len] = '\0';
+    const char* printed = output;
+    bool ok = strncmp(printed, header, strlen(header)) == 0;
+    printed += strlen(header);
+    static const char* first = "0.000001000\t ChB\n0.000002000\t ChC\n";
+    ok = ok && strncmp(printed, first, strlen(first)) == 0;
+    printed += ok? strlen(first): 0;
+    ok = ok && strcmp(printed, c->expect) == 0;
+    printf("%-13s %s\n", c->name, ok? "OK": "FAIL");
+    if (!ok) {
+        printf("printed:\n%sexpected:\n%s%s", output, header, first);
+        printf("%s", c->expect);
+    }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1) {
+        fprintf(stderr, "Usage: %s\n", argv[0]);
+        return 2;
+    }
+    static const struct TicCase cases[] = {
+        {"in order", {{0, 2100}, {1, 2110}, {2, 2090}, {0, 3100}, {2, 3100.5}, {1, 3099.25}, {255, 0}},
+            "0.000010000\t ChB\n-0.000010000\t ChC\n0.000000500\t ChC\n-0.000000750\t ChB\n"},
+        {"out of order", {{1, 2105}, {2, 2095}, {0, 2100}, {2, 3097}, {0, 3100}, {1, 3100.25}, {255, 0}},
+            "0.000005000\t ChB\n-0.000005000\t ChC\n-0.000003000\t ChC\n0.000000250\t ChB\n"},
+        {"missing ref", {{0, 2100}, {1, 2101}, {2, 2102}, {1, 3103}, {2, 3104}, {0, 4100}, {1, 4102}, {2, 4101}, {0, 5100}, {1, 5099}, {2, 5100},
+            {255, 0}},
+            "0.000001000\t ChB\n0.000002000\t ChC\n0.000002000\t ChB\n0.000001000\t ChC\n-0.000001000\t ChB\n0.000000000\t ChC\n"},
+        {"missing stop", {{0, 2100}, {2, 2107}, {0, 3100}, {1, 3103}, {2, 3104}, {1, 4101}, {0, 4100}, {2, 4102}, {255, 0}},
+            "0.000007000\t ChC\n0.000003000\t ChB\n0.000004000\t ChC\n0.000001000\t ChB\n0.000002000\t ChC\n"},
+        {"half period", {{0, 2100}, {1, 2599}, {2, 2601}, {0, 3100}, {255, 0}},
+            "0.000499000\t ChB\n-0.000499000\t ChC\n"},
+        {"late stop", {{0, 2100}, {1, 2101}, {1, 2700}, {0, 3100}, {1, 3102}, {255, 0}},
+            "0.000001000\t ChB\n-0.000400000\t ChB\n"},
+    };
+    uint32_t failed = 0, cases_run = 0;
+    for (uint8_t k = 0; k < sizeof(cases)/sizeof(cases[0]); k++) {
+        failed += !check(&cases[k]);
+        cases_run++;
+    }
+    printf("%u of %u cases failed\n", failed, cases_run);
+    return (failed == 0)? 0: 1;
+}
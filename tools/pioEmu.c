@@ -0,0 +1,419 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "pioEmu.h"
+
+// NOTE: host only, assembles the subset of the pioasm syntax used by the .pio files of this repo
+
+enum { JMP_ALWAYS, JMP_NOT_X, JMP_X_DEC, JMP_NOT_Y, JMP_Y_DEC, JMP_X_NE_Y, JMP_PIN, JMP_NOT_OSRE };
+enum { SRC_PINS, SRC_X, SRC_Y, SRC_NULL, SRC_PINDIRS, SRC_STATUS, SRC_ISR, SRC_OSR, SRC_PC, SRC_EXEC, SRC_GPIO, SRC_IRQ };
+enum { MOV_NONE, MOV_INVERT, MOV_REVERSE };
+
+static char error_msg[128];
+
+
+const char* emu_error() {
+    return error_msg;
+}
+
+static bool fail(int line, const char* msg, const char* tok) {
+    snprintf(error_msg, sizeof(error_msg), "line %d: %s %s", line, msg, (tok != NULL)? tok: "");
+    return false;
+}
+
+static int lookup(const char* s, const char* const* names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(s, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int emu_label(const struct EmuProgram* p, const char* label) {
+    for (uint8_t i = 0; i < p->label_count; i++) {
+        if (strcmp(p->labels[i], label) == 0) {
+            return p->label_addr[i];
+        }
+    }
+    return -1;
+}
+
+// splits a source line to lower case tokens, commas are separators
+static int tokenize(char* line, char** tok, int max) {
+    int n = 0;
+    for (char* c = line; *c; c++) {
+        *c = (*c == ',')? ' ': tolower((unsigned char)*c);
+    }
+    for (char* t = strtok(line, " \t\r\n"); t != NULL && n < max; t = strtok(NULL, " \t\r\n")) {
+        tok[n++] = t;
+    }
+    return n;
+}
+
+static int source(const char* s, uint8_t* op) {
+    static const char* names[] = {"pins", "x", "y", "null", "pindirs", "status", "isr", "osr", "pc", "exec", "gpio", "irq"};
+    *op = MOV_NONE;
+    if (s[0] == '!' || s[0] == '~') {
+        *op = MOV_INVERT;
+        s++;
+    } else if (s[0] == ':' && s[1] == ':') {
+        *op = MOV_REVERSE;
+        s += 2;
+    }
+    return lookup(s, names, sizeof(names)/sizeof(names[0]));
+}
+
+static bool assemble(struct EmuProgram* p, struct EmuInstr* in, char** tok, int n, int line) {
+    static const char* ops[] = {"jmp", "wait", "in", "out", "push", "pull", "mov", "irq", "set", "nop"};
+    static const char* conds[] = {"", "!x", "x--", "!y", "y--", "x!=y", "pin", "!osre"};
+    uint8_t mop;
+    memset(in, 0, sizeof(*in));
+    in->side = -1;
+    // delay and side-set are at the end of the instruction
+    while (n > 1) {
+        if (tok[n-1][0] == '[') {
+            in->delay = atoi(tok[n-1] + 1);
+            n--;
+        } else if (n > 2 && (strcmp(tok[n-2], "side") == 0 || strcmp(tok[n-2], "sideset") == 0)) {
+            in->side = atoi(tok[n-1]);
+            n -= 2;
+        } else {
+            break;
+        }
+    }
+    int op = lookup(tok[0], ops, sizeof(ops)/sizeof(ops[0]));
+    switch (op) {
+        case OP_JMP: {
+            const char* target = tok[n-1];
+            in->cond = (n == 3)? lookup(tok[1], conds, sizeof(conds)/sizeof(conds[0])): JMP_ALWAYS;
+            int addr = emu_label(p, target);
+            if (addr < 0 && isdigit((unsigned char)target[0])) {
+                addr = atoi(target);
+            }
+            if (addr < 0 || in->cond == 0xff || n < 2 || n > 3) {
+                return fail(line, "bad jmp", target);
+            }
+            in->arg2 = addr;
+            break;
+        }
+        case OP_WAIT:
+            if (n != 4) {
+                return fail(line, "bad wait", NULL);
+            }
+            in->arg1 = atoi(tok[1]);
+            in->cond = (strcmp(tok[2], "pin") == 0)? SRC_PINS: source(tok[2], &mop);
+            if (in->cond != SRC_PINS && in->cond != SRC_GPIO) {
+                return fail(line, "unsupported wait source", tok[2]);
+            }
+            in->arg2 = atoi(tok[3]);
+            break;
+        case OP_IN:
+        case OP_OUT:
+        case OP_SET:
+            if (n != 3) {
+                return fail(line, "bad operands", tok[0]);
+            }
+            in->cond = source(tok[1], &mop);
+            in->arg2 = atoi(tok[2]);
+            if (in->cond == 0xff) {
+                return fail(line, "bad operand", tok[1]);
+            }
+            break;
+        case OP_PUSH:
+        case OP_PULL:
+            in->arg2 = 1;           // block is the default
+            for (int i = 1; i < n; i++) {
+                if (strcmp(tok[i], "noblock") == 0) {
+                    in->arg2 = 0;
+                } else if (strcmp(tok[i], "iffull") == 0 || strcmp(tok[i], "ifempty") == 0) {
+                    in->arg1 = 1;
+                }
+            }
+            break;
+        case OP_MOV:
+            if (n != 3) {
+                return fail(line, "bad mov", NULL);
+            }
+            in->arg1 = source(tok[1], &mop);
+            in->cond = source(tok[2], &mop);
+            in->arg2 = mop;
+            if (in->arg1 == 0xff || in->cond == 0xff) {
+                return fail(line, "bad mov operand", NULL);
+            }
+            break;
+        case 9:                     // nop is mov y, y
+            op = OP_MOV;
+            in->arg1 = SRC_Y;
+            in->cond = SRC_Y;
+            break;
+        default:
+            return fail(line, "unsupported instruction", tok[0]);
+    }
+    in->op = op;
+    return true;
+}
+
+// loads the named program (or the first one if program_name is NULL) from a .pio source
+bool emu_load(struct EmuProgram* p, const char* path, const char* program_name) {
+    char lines[256][160];
+    int count = 0;
+    FILE* f = fopen(path, "r");
+    if (f == NULL) {
+        return fail(0, "can not open", path);
+    }
+    while (count < 256 && fgets(lines[count], sizeof(lines[count]), f) != NULL) {
+        count++;
+    }
+    fclose(f);
+
+    memset(p, 0, sizeof(*p));
+    // two passes, labels are resolved in the first one
+    for (int pass = 0; pass < 2; pass++) {
+        bool active = false, sdk = false, wrap_set = false;
+        p->length = 0;
+        for (int l = 0; l < count; l++) {
+            char buf[160];
+            char* tok[12];
+            strcpy(buf, lines[l]);
+            char* c = strchr(buf, ';');
+            if (c) *c = '\0';
+            c = strstr(buf, "//");
+            if (c) *c = '\0';
+            if (sdk) {
+                sdk = strstr(buf, "%}") == NULL;
+                continue;
+            }
+            if (strstr(buf, "% c-sdk") != NULL) {
+                sdk = true;
+                continue;
+            }
+            int n = tokenize(buf, tok, 12);
+            if (n == 0) {
+                continue;
+            }
+            if (strcmp(tok[0], ".program") == 0) {
+                if (active) {
+                    break;          // next program in the same file
+                }
+                active = n > 1 && (program_name == NULL || strcmp(tok[1], program_name) == 0);
+                if (active) {
+                    snprintf(p->name, EMU_NAME_LEN, "%s", tok[1]);
+                }
+                continue;
+            }
+            if (!active) {
+                continue;
+            }
+            if (strcmp(tok[0], ".side_set") == 0) {
+                p->side_set_bits = atoi(tok[1]);
+            } else if (strcmp(tok[0], ".wrap_target") == 0) {
+                p->wrap_target = p->length;
+            } else if (strcmp(tok[0], ".wrap") == 0) {
+                p->wrap = p->length - 1;
+                wrap_set = true;
+            } else if (tok[0][0] == '.') {
+                continue;           // .origin, .define, ... not used by the emulator
+            } else {
+                int t = (strcmp(tok[0], "public") == 0)? 1: 0;
+                size_t len = strlen(tok[t]);
+                if (tok[t][len-1] == ':') {
+                    if (pass == 0 && p->label_count < EMU_MAX_LABELS) {
+                        tok[t][len-1] = '\0';
+                        snprintf(p->labels[p->label_count], EMU_NAME_LEN, "%s", tok[t]);
+                        p->label_addr[p->label_count++] = p->length;
+                    }
+                    t++;
+                    if (t >= n) {
+                        continue;
+                    }
+                }
+                if (p->length >= EMU_MAX_INSTR) {
+                    return fail(l+1, "program too long", NULL);
+                }
+                if (pass == 1 && !assemble(p, &p->instr[p->length], tok + t, n - t, l+1)) {
+                    return false;
+                }
+                p->length++;
+            }
+        }
+        if (!wrap_set) {
+            p->wrap = p->length - 1;
+        }
+    }
+    if (p->length == 0) {
+        return fail(0, "program not found in", path);
+    }
+    return true;
+}
+
+void emu_sm_init(struct EmuSm* sm, const struct EmuProgram* p, uint8_t entry, uint8_t pin) {
+    memset(sm, 0, sizeof(*sm));
+    sm->prog = p;
+    sm->pc = entry;
+    sm->in_base = pin;
+    sm->jmp_pin = pin;
+    sm->in_shift_right = true;
+    sm->side_value = -1;
+}
+
+static bool fifo_put(struct EmuFifo* f, uint32_t v) {
+    if (f->level >= EMU_FIFO_DEPTH) {
+        return false;
+    }
+    f->data[f->level++] = v;
+    return true;
+}
+
+static bool fifo_get(struct EmuFifo* f, uint32_t* v) {
+    if (f->level == 0) {
+        return false;
+    }
+    *v = f->data[0];
+    memmove(f->data, f->data + 1, --f->level * sizeof(uint32_t));
+    return true;
+}
+
+bool emu_tx_put(struct EmuSm* sm, uint32_t v) {
+    return fifo_put(&sm->tx, v);
+}
+
+bool emu_rx_get(struct EmuSm* sm, uint32_t* v) {
+    return fifo_get(&sm->rx, v);
+}
+
+static uint32_t read_src(struct EmuSm* sm, uint8_t src, uint32_t gpio) {
+    switch (src) {
+        case SRC_PINS: return gpio >> sm->in_base;
+        case SRC_X: return sm->x;
+        case SRC_Y: return sm->y;
+        case SRC_ISR: return sm->isr;
+        case SRC_OSR: return sm->osr;
+        default: return 0;
+    }
+}
+
+static uint32_t reverse(uint32_t v) {
+    uint32_t r = 0;
+    for (int i = 0; i < 32; i++) {
+        r = (r << 1) | ((v >> i) & 1);
+    }
+    return r;
+}
+
+// executes one clk_sys cycle of the state machine with the given (synchronized) input pin levels
+void emu_step(struct EmuSm* sm, uint32_t gpio) {
+    if (sm->delay > 0) {
+        sm->delay--;
+        return;
+    }
+    const struct EmuInstr* in = &sm->prog->instr[sm->pc];
+    uint8_t next = (sm->pc == sm->prog->wrap)? sm->prog->wrap_target: sm->pc + 1;
+    uint32_t v;
+    bool cond;
+    switch (in->op) {
+        case OP_JMP:
+            switch (in->cond) {
+                case JMP_NOT_X: cond = sm->x == 0; break;
+                case JMP_X_DEC: cond = sm->x != 0; sm->x--; break;
+                case JMP_NOT_Y: cond = sm->y == 0; break;
+                case JMP_Y_DEC: cond = sm->y != 0; sm->y--; break;
+                case JMP_X_NE_Y: cond = sm->x != sm->y; break;
+                case JMP_PIN: cond = (gpio >> sm->jmp_pin) & 1; break;
+                case JMP_NOT_OSRE: cond = sm->osr_count < 32; break;
+                default: cond = true;
+            }
+            next = cond? in->arg2: next;
+            break;
+        case OP_WAIT:
+            v = (in->cond == SRC_GPIO)? gpio >> in->arg2: gpio >> (sm->in_base + in->arg2);
+            if ((v & 1) != in->arg1) {
+                sm->stalls++;
+                return;
+            }
+            break;
+        case OP_IN: {
+            uint8_t bits = in->arg2? in->arg2: 32;
+            v = read_src(sm, in->cond, gpio);
+            v = (bits == 32)? v: v & ((1u << bits) - 1);
+            if (bits == 32) {
+                sm->isr = v;
+            } else if (sm->in_shift_right) {
+                sm->isr = (sm->isr >> bits) | (v << (32 - bits));
+            } else {
+                sm->isr = (sm->isr << bits) | v;
+            }
+            sm->isr_count = (sm->isr_count + bits > 32)? 32: sm->isr_count + bits;
+            break;
+        }
+        case OP_OUT: {
+            uint8_t bits = in->arg2? in->arg2: 32;
+            v = (bits == 32)? sm->osr: sm->osr & ((1u << bits) - 1);
+            sm->osr = (bits == 32)? 0: sm->osr >> bits;
+            sm->osr_count = (sm->osr_count + bits > 32)? 32: sm->osr_count + bits;
+            if (in->cond == SRC_X) {
+                sm->x = v;
+            } else if (in->cond == SRC_Y) {
+                sm->y = v;
+            } else if (in->cond == SRC_PC) {
+                next = v;
+            }
+            break;
+        }
+        case OP_PUSH:
+            if (in->arg1 && sm->isr_count < 32) {
+                break;              // iffull
+            }
+            if (!fifo_put(&sm->rx, sm->isr)) {
+                if (in->arg2) {
+                    sm->stalls++;
+                    return;
+                }
+                sm->rx_dropped++;
+            }
+            sm->isr = 0;
+            sm->isr_count = 0;
+            break;
+        case OP_PULL:
+            if (in->arg1 && sm->osr_count < 32) {
+                break;              // ifempty
+            }
+            if (!fifo_get(&sm->tx, &v)) {
+                if (in->arg2) {
+                    sm->stalls++;
+                    return;
+                }
+                v = sm->x;          // non-blocking pull from empty FIFO copies X
+            }
+            sm->osr = v;
+            sm->osr_count = 0;
+            break;
+        case OP_MOV:
+            v = read_src(sm, in->cond, gpio);
+            v = (in->arg2 == MOV_INVERT)? ~v: (in->arg2 == MOV_REVERSE)? reverse(v): v;
+            switch (in->arg1) {
+                case SRC_X: sm->x = v; break;
+                case SRC_Y: sm->y = v; break;
+                case SRC_ISR: sm->isr = v; sm->isr_count = 0; break;
+                case SRC_OSR: sm->osr = v; sm->osr_count = 0; break;
+                case SRC_PC: next = v; break;
+                default: break;
+            }
+            break;
+        case OP_SET:
+            if (in->cond == SRC_X) {
+                sm->x = in->arg2;
+            } else if (in->cond == SRC_Y) {
+                sm->y = in->arg2;
+            }
+            break;
+        default:
+            break;
+    }
+    if (in->side >= 0) {
+        sm->side_value = in->side;
+    }
+    sm->pc = next;
+    sm->delay = in->delay;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+
+// Cycle accurate emulator of the PIO instruction subset used by the PicoPET programs
+// (jmp, wait, in, out, push, pull, mov, set, nop with side-set and delays).
+// Programs are assembled directly from the .pio sources, so the emulator always runs
+// the same code as the firmware.
+
+#define EMU_MAX_INSTR 32
+#define EMU_MAX_LABELS 32
+#define EMU_FIFO_DEPTH 4
+#define EMU_NAME_LEN 32
+
+enum { OP_JMP, OP_WAIT, OP_IN, OP_OUT, OP_PUSH, OP_PULL, OP_MOV, OP_IRQ, OP_SET };
+
+struct EmuInstr
+{
+    uint8_t op;
+    uint8_t cond;                       // jmp condition, wait source, in/out/mov/set source or destination
+    uint8_t arg1;                       // wait polarity, mov destination, push/pull iffull/ifempty
+    uint8_t arg2;                       // jmp target, wait index, bit count, mov operation, set value, block flag
+    uint8_t delay;
+    int8_t side;                        // -1 if no side-set value
+};
+
+struct EmuProgram
+{
+    char name[EMU_NAME_LEN];
+    struct EmuInstr instr[EMU_MAX_INSTR];
+    uint8_t length;
+    uint8_t wrap_target;
+    uint8_t wrap;
+    uint8_t side_set_bits;
+    char labels[EMU_MAX_LABELS][EMU_NAME_LEN];
+    uint8_t label_addr[EMU_MAX_LABELS];
+    uint8_t label_count;
+};
+
+struct EmuFifo
+{
+    uint32_t data[EMU_FIFO_DEPTH];
+    uint8_t level;
+};
+
+struct EmuSm
+{
+    const struct EmuProgram* prog;
+    uint8_t pc;
+    uint32_t x, y, isr, osr;
+    uint8_t isr_count, osr_count;
+    uint16_t delay;                     // remaining delay cycles of the last instruction
+    uint8_t in_base;
+    uint8_t jmp_pin;
+    bool in_shift_right;
+    struct EmuFifo rx, tx;
+    uint32_t rx_dropped;                // values lost by push noblock on full FIFO
+    uint32_t stalls;                    // cycles spent stalled
+    int8_t side_value;
+};
+
+bool emu_load(struct EmuProgram* p, const char* path, const char* program_name);
+
+int emu_label(const struct EmuProgram* p, const char* label);
+
+void emu_sm_init(struct EmuSm* sm, const struct EmuProgram* p, uint8_t entry, uint8_t pin);
+
+bool emu_tx_put(struct EmuSm* sm, uint32_t v);
+
+bool emu_rx_get(struct EmuSm* sm, uint32_t* v);
+
+void emu_step(struct EmuSm* sm, uint32_t gpio);
+
+const char* emu_error();